@@ -0,0 +1,131 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bench.h"
+
+// Native arithmetic against Forth emulations
+//
+// Times `um*` and `*/` against versions written in Forth from the words
+// that were there before them: a double cell product built from half
+// cell products, and a shift-subtract division. The emulated versions
+// have to give the same results as the native ones, and the loop around
+// each call is timed separately and taken off.
+
+enum {
+	CELL_BITS = sizeof(minift_cell_t) * 8,
+};
+
+static const char *emulation =
+	": half %s ;\n"
+	": um*f- { a b ll lh hl mid -- lo hi }\n"
+	"  a half mod b half mod *  to ll\n"
+	"  a half mod b half /   *  to lh\n"
+	"  a half /   b half mod *  to hl\n"
+	"  ll half / lh half mod + hl half mod +  to mid\n"
+	"  ll half mod mid half mod half * +\n"
+	"  a half / b half / *  lh half / +  hl half / +  mid half / + ;\n"
+	": um*f 0 0 0 0 um*f- ;\n"
+	": top? 0 1 - 2 / > ;\n"
+	": um/modf { lo hi d -- rem quot }\n"
+	"  %u while dup begin\n"
+	"    hi top?  hi 2 * lo top? + to hi  lo 2 * to lo\n"
+	"    hi d < 0 = + if then hi d - to hi lo 1 + to lo end\n"
+	"    1 -\n"
+	"  repeat drop\n"
+	"  hi lo ;\n"
+	": */f { a b c } a b um*f c um/modf nip ;\n";
+
+static const char *loops =
+	": b-none  while dup begin dup 1234567 drop drop 1 - repeat drop ;\n"
+	": b-um    while dup begin dup 1234567 um* drop drop 1 - repeat drop ;\n"
+	": b-umf   while dup begin dup 1234567 um*f drop drop 1 - repeat drop ;\n"
+	": b-sc    while dup begin dup 1234567 7 */ drop 1 - repeat drop ;\n"
+	": b-scf   while dup begin dup 1234567 7 */f drop 1 - repeat drop ;\n";
+
+// `*/` is signed and the emulation isn't, so these stay positive
+static const minift_cell_t cases[][3] = {
+	{ 1234567, 7, 3 },
+	{ 0, 99, 1 },
+	{ (minift_cell_t)-1 >> 1, 2, 3 },
+	{ (minift_cell_t)-1 >> 1, (minift_cell_t)-1 >> 1, (minift_cell_t)-1 >> 1 },
+	{ (minift_cell_t)1 << (CELL_BITS - 2), 12345, 54321 },
+};
+
+static bench_vm_t b;
+
+// nanoseconds per time round `word`'s loop, the best of a few runs
+static double per_call( minift_vm_t *vm, const char *word, unsigned long count ){
+	uint64_t best = UINT64_MAX;
+	char src[64];
+
+	snprintf( src, sizeof(src), "%lu %s\n", count, word );
+
+	for ( unsigned i = 0; i < 3; i++ ){
+		uint64_t start = bench_now( );
+
+		bench_check( bench_eval( vm, src ), word );
+
+		uint64_t ns = bench_now( ) - start;
+		best = (ns < best)? ns : best;
+	}
+
+	return (double)best / count;
+}
+
+// runs `native` and `emulated` on the same arguments, which have to leave
+// the same `results` cells
+static void compare( minift_vm_t *vm, const minift_cell_t *args, unsigned count,
+                     const char *native, const char *emulated, unsigned results )
+{
+	minift_stack_t *s = &vm->param_stack;
+	char src[32];
+
+	s->ptr = s->start;
+
+	for ( unsigned pass = 0; pass < 2; pass++ ){
+		for ( unsigned i = 0; i < count; i++ ){
+			minift_push( vm, s, args[i] );
+		}
+
+		snprintf( src, sizeof(src), "%s\n", pass? emulated : native );
+		bench_check( bench_eval( vm, src ), src );
+	}
+
+	bench_check( s->ptr - s->start == 2 * results, native );
+
+	for ( unsigned i = 0; i < results; i++ ){
+		bench_check( s->start[i] == s->start[results + i], native );
+	}
+
+	s->ptr = s->start;
+}
+
+int main( void ){
+	static char src[2048];
+	minift_vm_t *vm = bench_vm_init( &b );
+
+	// literals only go up to 32 bits, so half a cell is built up
+	snprintf( src, sizeof(src), emulation,
+	          (CELL_BITS == 64)? "65536 65536 *" : "65536", CELL_BITS );
+	bench_check( bench_eval( vm, src ), "defining the emulations" );
+	bench_check( bench_eval( vm, loops ), "defining the loops" );
+
+	for ( unsigned i = 0; i < sizeof(cases) / sizeof(cases[0]); i++ ){
+		compare( vm, cases[i], 2, "um*", "um*f", 2 );
+		compare( vm, cases[i], 3, "*/", "*/f", 1 );
+	}
+
+	// the loops with `*/` push the divisor too, but have one less `drop`
+	// than `b-none`, so it's taken off all of them
+	double none  = per_call( vm, "b-none", 1000000 );
+	double um    = per_call( vm, "b-um", 1000000 ) - none;
+	double umf   = per_call( vm, "b-umf", 30000 ) - none;
+	double sc    = per_call( vm, "b-sc", 1000000 ) - none;
+	double scf   = per_call( vm, "b-scf", 3000 ) - none;
+
+	printf( "per call, with the loop taken off\n" );
+	printf( "  um*  %8.3fus native  %9.3fus emulated  %6.0fx\n",
+	        um / 1e3, umf / 1e3, umf / um );
+	printf( "  */   %8.3fus native  %9.3fus emulated  %6.0fx\n",
+	        sc / 1e3, scf / 1e3, scf / sc );
+
+	return 0;
+}
@@ -0,0 +1,126 @@
+#ifndef _MINIFORTH_BENCH_H
+#define _MINIFORTH_BENCH_H 1
+#include <miniforth/miniforth.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Shared by the benchmarks in bench/, each of which is a single program
+// linked against out/miniforth.a and run by `make bench`. They print what
+// they measure, and exit with 1 if the vm didn't compute what it should
+// have, so they double as tests.
+//
+// Each program includes this once, so the stubs the library needs are
+// defined here.
+
+enum {
+	BENCH_DATA_CELLS  = 16384,
+	BENCH_STACK_CELLS = 1024,
+};
+
+typedef struct bench_vm {
+	minift_cell_t  data[BENCH_DATA_CELLS];
+	minift_cell_t  calls[BENCH_STACK_CELLS];
+	minift_cell_t  params[BENCH_STACK_CELLS];
+	minift_stack_t data_stack;
+	minift_stack_t call_stack;
+	minift_stack_t param_stack;
+	minift_vm_t    vm;
+} bench_vm_t;
+
+static inline uint64_t bench_now( void ){
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline void bench_sleep( unsigned long us ){
+	struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+
+	nanosleep( &ts, NULL );
+}
+
+char minift_get_char( void ){
+	return '\n';
+}
+
+void minift_put_char( char c ){
+	putchar( c );
+}
+
+// microseconds, like the posix stub
+unsigned long minift_clock( void ){
+	return bench_now( ) / 1000;
+}
+
+static inline void bench_stacks( bench_vm_t *b ){
+	b->data_stack  = (minift_stack_t){ b->data, b->data + BENCH_DATA_CELLS, b->data };
+	b->call_stack  = (minift_stack_t){ b->calls, b->calls + BENCH_STACK_CELLS, b->calls };
+	b->param_stack = (minift_stack_t){ b->params, b->params + BENCH_STACK_CELLS, b->params };
+}
+
+static inline minift_vm_t *bench_vm_init( bench_vm_t *b ){
+	bench_stacks( b );
+
+	return minift_init_vm( &b->vm, &b->call_stack, &b->data_stack,
+	                       &b->param_stack, NULL );
+}
+
+// Feeds `src` to the vm without running it.
+static inline void bench_feed( minift_vm_t *vm, const char *src ){
+	minift_feed( vm, src, strlen( src ));
+}
+
+// Runs `src` to the end, returning false if anything in it failed.
+static inline bool bench_eval( minift_vm_t *vm, const char *src ){
+	bool ok = true;
+	int ret;
+
+	bench_feed( vm, src );
+
+	while ( (ret = minift_run_for( vm, 0, 0 )) != MINIFT_RUN_WAITING ){
+		if ( ret == MINIFT_RUN_HALTED ){
+			return false;
+		}
+
+		ok &= ret != MINIFT_RUN_ERROR;
+	}
+
+	return ok;
+}
+
+// the cell on top of the vm's parameter stack, or `fallback` if it's empty
+static inline minift_cell_t bench_top( minift_vm_t *vm, minift_cell_t fallback ){
+	minift_stack_t *s = &vm->param_stack;
+
+	return (s->ptr > s->start)? s->ptr[-1] : fallback;
+}
+
+static inline void bench_check( bool ok, const char *what ){
+	if ( !ok ){
+		fprintf( stderr, "FAILED: %s\n", what );
+		exit( 1 );
+	}
+}
+
+static int bench_cmp( const void *a, const void *b ){
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+// Prints the spread of `count` samples in nanoseconds, sorting them.
+static inline void bench_percentiles( const char *label, uint64_t *ns, unsigned count ){
+	qsort( ns, count, sizeof(ns[0]), bench_cmp );
+
+	printf( "  %-24s min %8.2fus  p50 %8.2fus  p99 %8.2fus  max %8.2fus\n",
+	        label, ns[0] / 1e3, ns[count / 2] / 1e3,
+	        ns[count * 99 / 100] / 1e3, ns[count - 1] / 1e3 );
+}
+
+#endif
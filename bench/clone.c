@@ -0,0 +1,70 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bench.h"
+
+// Cloning against starting cold
+//
+// Gets a vm ready to run a program that needs a library of definitions
+// loaded first, either by starting a fresh vm and loading the library
+// into it each time, or by loading it once into a template and cloning
+// that with minift_vm_clone(). Both have to leave a vm that can run the
+// library's words.
+
+enum {
+	WORDS  = 200,
+	ROUNDS = 1000,
+};
+
+static char library[WORDS * 64];
+static bench_vm_t template, vm;
+
+static void make_library( void ){
+	char *p = library;
+	char *end = library + sizeof(library);
+
+	for ( unsigned i = 0; i < WORDS; i++ ){
+		p += snprintf( p, end - p, ": w%u dup %u + swap drop ;\n", i, i );
+	}
+
+	snprintf( p, end - p, "create buf 16 cells allot\n" );
+}
+
+static void check( minift_vm_t *v ){
+	bench_check( bench_eval( v, "5 w199 buf !\nbuf @\n" )
+	          && bench_top( v, 0 ) == 5 + 199, "running a library word" );
+}
+
+int main( void ){
+	make_library( );
+
+	uint64_t start = bench_now( );
+
+	for ( unsigned i = 0; i < ROUNDS; i++ ){
+		bench_check( bench_eval( bench_vm_init( &vm ), library ), "loading" );
+	}
+
+	uint64_t cold = bench_now( ) - start;
+	check( &vm.vm );
+
+	bench_check( bench_eval( bench_vm_init( &template ), library ), "loading" );
+	start = bench_now( );
+
+	for ( unsigned i = 0; i < ROUNDS; i++ ){
+		bench_stacks( &vm );
+		bench_check( minift_vm_clone( &vm.vm, &template.vm, &vm.call_stack,
+		                              &vm.data_stack, &vm.param_stack ) != NULL,
+		             "cloning" );
+	}
+
+	uint64_t cloned = bench_now( ) - start;
+	check( &vm.vm );
+
+	unsigned long used = (template.vm.data_stack.ptr - template.data)
+	                   * sizeof(minift_cell_t);
+
+	printf( "%u definitions, %lu bytes of data space\n", WORDS, used );
+	printf( "  init and load  %8.2fus\n", cold / 1e3 / ROUNDS );
+	printf( "  clone          %8.2fus  %.0fx faster\n",
+	        cloned / 1e3 / ROUNDS, (double)cold / cloned );
+
+	return 0;
+}
@@ -0,0 +1,107 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bench.h"
+
+// Code size and speed of each code format
+//
+// The same corpus of definitions is compiled and run under each
+// MINIFT_CODE_FORMAT. The format is fixed when the library is built, so
+// the Makefile builds this once more for each format, as
+// out/bench/codesize-<format>, with it's own copy of the library. Run
+// with no arguments, this runs each of those and prints what they report:
+// the bytes of code the corpus compiled to, the data space it took in
+// all, and the time to run it. Every format has to get the same result.
+
+enum {
+	ITERATIONS = 5000,
+	FORMATS    = 3,
+};
+
+static const char *corpus =
+	": sq dup * ;\n"
+	": cube dup sq * ;\n"
+	": clamp { x lo hi } x lo < if then lo else x hi > if then hi else x end end ;\n"
+	": collatz 0 swap while dup 1 != begin\n"
+	"  dup 2 mod if then 3 * 1 + else 2 / end swap 1 + swap repeat drop ;\n"
+	": big 100000 + 70000 - 123456789 + ;\n"
+	": greet \"hello\" drop ;\n"
+	"create tbl 64 cells allot\n"
+	": fill 0 while dup 64 < begin dup cube 1000 mod over cells tbl + ! 1 + repeat drop ;\n"
+	"0 value acc\n"
+	": step greet dup 1 + collatz over 7 mod 2 5 clamp + big acc + to acc ;\n"
+	": mix 0 while dup 64 < begin dup cells tbl + @ acc + to acc 1 + repeat drop ;\n"
+	": run 0 to acc fill 0 while dup %u < begin step 1 + repeat drop mix acc ;\n";
+
+static const char *names[FORMATS] = { "cells", "compact", "bytes" };
+
+static bench_vm_t b;
+
+// compiles and runs the corpus in this build's format
+static void measure( void ){
+	static char src[2048];
+	minift_vm_t *vm = bench_vm_init( &b );
+	minift_define_t *before = vm->definitions;
+	minift_cell_t *start = vm->data_stack.ptr;
+	unsigned long code = 0;
+
+	snprintf( src, sizeof(src), corpus, ITERATIONS );
+	bench_check( bench_eval( vm, src ), "compiling the corpus" );
+
+	for ( minift_define_t *def = vm->definitions; def != before; def = def->previous ){
+		minift_define_size_t size;
+
+		minift_define_size( vm, def, &size );
+		code += size.code;
+	}
+
+	unsigned long data = (vm->data_stack.ptr - start) * sizeof(minift_cell_t);
+	uint64_t best = UINT64_MAX;
+	minift_cell_t result = 0;
+
+	for ( unsigned i = 0; i < 3; i++ ){
+		uint64_t begin = bench_now( );
+
+		bench_check( bench_eval( vm, "run\n" ), "running the corpus" );
+
+		uint64_t ns = bench_now( ) - begin;
+		best = (ns < best)? ns : best;
+		result = minift_pop( vm, &vm->param_stack );
+	}
+
+	printf( "%lu %lu %llu %lu\n", code, data, (unsigned long long)best,
+	        (unsigned long)result );
+}
+
+int main( int argc, char **argv ){
+	unsigned long want = 0;
+
+	if ( argc > 1 && strcmp( argv[1], "--measure" ) == 0 ){
+		measure( );
+		return 0;
+	}
+
+	printf( "corpus run %u times\n", ITERATIONS );
+
+	for ( unsigned f = 0; f < FORMATS; f++ ){
+		char cmd[64], line[128];
+		unsigned long code = 0, data = 0, result = 0;
+		unsigned long long ns = 0;
+
+		snprintf( cmd, sizeof(cmd), "out/bench/codesize-%u --measure", f );
+
+		FILE *fp = popen( cmd, "r" );
+
+		bench_check( fp != NULL, "starting a build" );
+
+		bool ok = fgets( line, sizeof(line), fp )
+		       && sscanf( line, "%lu %lu %llu %lu", &code, &data, &ns, &result ) == 4;
+
+		bench_check( pclose( fp ) == 0 && ok, names[f] );
+		bench_check( f == 0 || result == want, "same result in every format" );
+		want = result;
+
+		printf( "  %-8s %6lu bytes of code  %6lu bytes of data space  %8.2fms\n",
+		        names[f], code, data, ns / 1e6 );
+	}
+
+	return 0;
+}
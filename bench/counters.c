@@ -0,0 +1,133 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bench.h"
+#include <unistd.h>
+
+// Hardware counters per loop iteration
+//
+// Runs a few loops in `out/miniforth --perf` and divides what the
+// counters read by the number of times round the loop, giving the cycles,
+// instructions and misses each iteration costs. Counters the machine
+// doesn't have are shown as "-", as --perf shows them. Every run has to
+// print the loop's count.
+
+enum {
+	ITERATIONS = 2000000,
+};
+
+typedef struct loop {
+	const char *label;
+	const char *source;
+} loop_t;
+
+static const loop_t loops[] = {
+	{ "empty loop",
+	  ": f 0 while dup %u < begin 1 + repeat ; f . cr\n" },
+	{ "arithmetic",
+	  ": f 0 while dup %u < begin dup 3 * 7 + drop 1 + repeat ; f . cr\n" },
+	{ "calls",
+	  ": inc 1 + ; : f 0 while dup %u < begin inc repeat ; f . cr\n" },
+	{ "memory",
+	  "create buf 64 cells allot\n"
+	  ": f 0 while dup %u < begin dup dup 64 mod cells buf + ! 1 + repeat ; f . cr\n" },
+};
+
+// the counters --perf prints, in the order they're shown here
+static const char *events[] = {
+	"cycles", "instructions", "branch-misses", "cache-misses", "task-clock",
+};
+
+enum {
+	EVENTS = sizeof(events) / sizeof(events[0]),
+};
+
+// runs `script` in --perf, filling `counts` with what each event read, or
+// with -1 for ones that couldn't be counted
+static void run( const char *script, const char *report, double *counts ){
+	char cmd[256], line[256];
+	unsigned long result = 0;
+
+	snprintf( cmd, sizeof(cmd), "out/miniforth --perf < %s 2> %s", script, report );
+
+	FILE *fp = popen( cmd, "r" );
+
+	bench_check( fp != NULL, "starting miniforth" );
+
+	if ( fgets( line, sizeof(line), fp )){
+		result = strtoul( line, NULL, 10 );
+	}
+
+	bench_check( pclose( fp ) == 0 && result == ITERATIONS, "count of the loop" );
+
+	for ( unsigned ev = 0; ev < EVENTS; ev++ ){
+		counts[ev] = -1;
+	}
+
+	fp = fopen( report, "r" );
+	bench_check( fp != NULL, "reading the counters" );
+
+	while ( fgets( line, sizeof(line), fp )){
+		char value[32], name[64];
+
+		if ( sscanf( line, "%31s %63[^, \n]", value, name ) != 2 ){
+			continue;
+		}
+
+		for ( unsigned ev = 0; ev < EVENTS; ev++ ){
+			if ( strcmp( name, events[ev] ) == 0 && strcmp( value, "-" ) != 0 ){
+				counts[ev] = strtod( value, NULL );
+			}
+		}
+	}
+
+	fclose( fp );
+}
+
+static void print_count( double count, double scale ){
+	if ( count < 0 ){
+		printf( " %13s", "-" );
+
+	} else {
+		printf( " %13.2f", count * scale / ITERATIONS );
+	}
+}
+
+int main( void ){
+	char script[64], report[64];
+
+	snprintf( script, sizeof(script), "/tmp/miniforth-bench-%d.fs", (int)getpid( ));
+	snprintf( report, sizeof(report), "/tmp/miniforth-bench-%d.perf", (int)getpid( ));
+
+	printf( "%u iterations, per iteration\n", ITERATIONS );
+	printf( "  %-12s", "" );
+
+	for ( unsigned ev = 0; ev < EVENTS; ev++ ){
+		printf( " %13s", ev == EVENTS - 1? "ns" : events[ev] );
+	}
+
+	printf( "\n" );
+
+	for ( unsigned l = 0; l < sizeof(loops) / sizeof(loops[0]); l++ ){
+		double counts[EVENTS];
+		FILE *fp = fopen( script, "w" );
+
+		bench_check( fp != NULL, "writing a script" );
+		fprintf( fp, loops[l].source, ITERATIONS );
+		fclose( fp );
+
+		run( script, report, counts );
+
+		printf( "  %-12s", loops[l].label );
+
+		for ( unsigned ev = 0; ev < EVENTS; ev++ ){
+			// task-clock is printed in milliseconds
+			print_count( counts[ev], ev == EVENTS - 1? 1e6 : 1 );
+		}
+
+		printf( "\n" );
+	}
+
+	unlink( script );
+	unlink( report );
+
+	return 0;
+}
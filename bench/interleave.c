@@ -0,0 +1,84 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bench.h"
+
+// Interleaving vms with minift_run_for()
+//
+// Runs the same counting loop in several vms, first one after another
+// and then round robin in slices of a few sizes, and reports how much
+// slicing costs over running each to completion. Every vm has to end up
+// with the full count either way.
+
+enum {
+	VMS   = 8,
+	LIMIT = 200000,
+};
+
+static const unsigned long slices[] = { 100000, 10000, 1000, 100, 10 };
+
+static bench_vm_t vms[VMS];
+
+static void start( void ){
+	static char src[128];
+
+	snprintf( src, sizeof(src), ": count 0 while dup %d < begin 1 + repeat ;\n", LIMIT );
+
+	for ( unsigned i = 0; i < VMS; i++ ){
+		minift_vm_t *vm = bench_vm_init( vms + i );
+
+		bench_check( bench_eval( vm, src ), "defining count" );
+		bench_feed( vm, "count\n" );
+	}
+}
+
+static void check( void ){
+	for ( unsigned i = 0; i < VMS; i++ ){
+		bench_check( bench_top( &vms[i].vm, 0 ) == LIMIT, "count" );
+	}
+}
+
+// runs every vm until it's waiting for input again, `steps` at a time
+static uint64_t run( unsigned long steps ){
+	uint64_t start_ns = bench_now( );
+	unsigned left = VMS;
+	bool done[VMS] = { false };
+
+	while ( left ){
+		for ( unsigned i = 0; i < VMS; i++ ){
+			if ( done[i] ){
+				continue;
+			}
+
+			int ret = minift_run_for( &vms[i].vm, steps, 0 );
+
+			bench_check( ret == MINIFT_RUN_YIELDED || ret == MINIFT_RUN_WAITING,
+			             "running count" );
+
+			if ( ret == MINIFT_RUN_WAITING ){
+				done[i] = true;
+				left--;
+			}
+		}
+	}
+
+	return bench_now( ) - start_ns;
+}
+
+int main( void ){
+	start( );
+	uint64_t base = run( 0 );
+	check( );
+
+	printf( "%u vms counting to %u\n", VMS, LIMIT );
+	printf( "  one after another      %8.2fms\n", base / 1e6 );
+
+	for ( unsigned i = 0; i < sizeof(slices) / sizeof(slices[0]); i++ ){
+		start( );
+		uint64_t ns = run( slices[i] );
+		check( );
+
+		printf( "  slices of %-6lu steps  %8.2fms  %+6.1f%%\n",
+		        slices[i], ns / 1e6, (double)ns * 100 / base - 100 );
+	}
+
+	return 0;
+}
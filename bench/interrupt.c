@@ -0,0 +1,114 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bench.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <unistd.h>
+
+// Interrupt latency
+//
+// A vm runs a busy loop while a second thread sends it SIGUSR1, which a C
+// signal handler turns into an interrupt with minift_interrupt(), the way
+// `on-signal` in the posix stub does. The Forth handler calls `mark`,
+// which notes the time. Reports the time from sending the signal to the
+// C handler running, and to the Forth handler running. Every signal has
+// to reach the Forth handler.
+
+enum {
+	SIGNALS   = 1000,
+	INTERRUPT = 10,
+};
+
+static minift_vm_t *vm;
+static pthread_t vm_thread;
+
+static _Atomic uint64_t sent;
+static _Atomic unsigned handled;
+static atomic_bool done;
+
+static uint64_t to_signal[SIGNALS];
+static uint64_t to_handler[SIGNALS];
+
+static void on_signal( int sig ){
+	unsigned n = atomic_load( &handled );
+
+	if ( n < SIGNALS ){
+		to_signal[n] = bench_now( ) - atomic_load( &sent );
+	}
+
+	minift_interrupt( vm, INTERRUPT );
+}
+
+static bool mark( minift_vm_t *v ){
+	unsigned n = atomic_load( &handled );
+
+	if ( n < SIGNALS ){
+		to_handler[n] = bench_now( ) - atomic_load( &sent );
+	}
+
+	atomic_store( &handled, n + 1 );
+
+	return true;
+}
+
+static minift_arc_ent_t entries[] = {
+	{ "mark", mark, 0 },
+};
+
+static minift_archive_t archive = {
+	.name    = "bench",
+	.entries = entries,
+	.size    = sizeof(entries) / sizeof(minift_arc_ent_t),
+};
+
+static void *sender( void *arg ){
+	for ( unsigned i = 0; i < SIGNALS; i++ ){
+		atomic_store( &sent, bench_now( ));
+		pthread_kill( vm_thread, SIGUSR1 );
+
+		// one at a time, so signals can't be merged while one is pending
+		for ( unsigned wait = 0; atomic_load( &handled ) <= i && wait < 100000; wait++ ){
+			bench_sleep( 10 );
+		}
+
+		bench_sleep( 200 );
+	}
+
+	atomic_store( &done, true );
+
+	return NULL;
+}
+
+int main( void ){
+	static bench_vm_t b;
+	static char setup[128];
+	struct sigaction sa = { .sa_handler = on_signal };
+	pthread_t thread;
+
+	vm = bench_vm_init( &b );
+	minift_archive_add( vm, &archive );
+
+	snprintf( setup, sizeof(setup), ": h mark ; ' h %d on-interrupt\n"
+	          ": spin 0 while 1 begin 1 + repeat ;\n", INTERRUPT );
+	bench_check( bench_eval( vm, setup ), "setting up the handler" );
+
+	sigemptyset( &sa.sa_mask );
+	sigaction( SIGUSR1, &sa, NULL );
+	vm_thread = pthread_self( );
+
+	bench_feed( vm, "spin\n" );
+	pthread_create( &thread, NULL, sender, NULL );
+
+	while ( !atomic_load( &done )){
+		minift_run_for( vm, 100000, 0 );
+	}
+
+	pthread_join( thread, NULL );
+	bench_check( atomic_load( &handled ) == SIGNALS, "every signal handled" );
+
+	printf( "%u signals to a vm running a busy loop\n", SIGNALS );
+	bench_percentiles( "to the C handler", to_signal, SIGNALS );
+	bench_percentiles( "to the Forth handler", to_handler, SIGNALS );
+
+	return 0;
+}
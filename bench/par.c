@@ -0,0 +1,99 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bench.h"
+#include <unistd.h>
+
+// Scaling of par-map and par-reduce
+//
+// Runs a word that loops a while over every cell of an array, then sums
+// the array, in `out/miniforth` with a plain loop and then with `par-map`
+// and `par-reduce` on pools of a few sizes. Every run has to print the
+// same sum. Speedups need as many free cores as workers.
+
+enum {
+	CELLS = 200,
+	WORK  = 20000,
+};
+
+static const char *setup =
+	"create buf %u cells allot\n"
+	": fill 0 while dup %u < begin dup dup cells buf + ! 1 + repeat drop ; fill\n"
+	": work 0 while dup %u < begin 1 + repeat + ;\n";
+
+static const char *serial =
+	": run 0 while dup %u < begin dup cells buf + dup @ work swap ! 1 + repeat drop ; run\n"
+	"0 value acc\n"
+	": sum 0 while dup %u < begin dup cells buf + @ acc + to acc 1 + repeat drop acc ;\n"
+	"sum . cr\n";
+
+static const char *parallel =
+	"buf %u ' work par-map\n"
+	"buf %u 0 ' + par-reduce . cr\n";
+
+static const unsigned pools[] = { 1, 2, 4, 8 };
+
+// runs `script` with `args`, returning the time it took
+static uint64_t run( const char *script, const char *args, unsigned long want ){
+	char cmd[256], out[64];
+	unsigned long sum = 0;
+
+	snprintf( cmd, sizeof(cmd), "out/miniforth %s < %s", args, script );
+
+	uint64_t start = bench_now( );
+	FILE *fp = popen( cmd, "r" );
+
+	bench_check( fp != NULL, "starting miniforth" );
+
+	if ( fgets( out, sizeof(out), fp )){
+		sum = strtoul( out, NULL, 10 );
+	}
+
+	bench_check( pclose( fp ) == 0 && sum == want, "sum of the array" );
+
+	return bench_now( ) - start;
+}
+
+static void write_script( const char *path, const char *body ){
+	FILE *fp = fopen( path, "w" );
+
+	bench_check( fp != NULL, "writing a script" );
+	fprintf( fp, setup, CELLS, CELLS, WORK );
+	fprintf( fp, body, CELLS, CELLS );
+	fclose( fp );
+}
+
+int main( void ){
+	char serial_path[64], par_path[64];
+	unsigned long want = (unsigned long)CELLS * (CELLS - 1) / 2
+	                   + (unsigned long)CELLS * WORK;
+
+	snprintf( serial_path, sizeof(serial_path), "/tmp/miniforth-bench-%d-serial.fs",
+	          (int)getpid( ));
+	snprintf( par_path, sizeof(par_path), "/tmp/miniforth-bench-%d-par.fs",
+	          (int)getpid( ));
+
+	write_script( serial_path, serial );
+	write_script( par_path, parallel );
+
+	printf( "%u cells, %u iterations each, %ld cpus online\n",
+	        CELLS, WORK, sysconf( _SC_NPROCESSORS_ONLN ));
+
+	uint64_t base = run( serial_path, "", want );
+
+	printf( "  plain loop      %8.2fms\n", base / 1e6 );
+
+	for ( unsigned i = 0; i < sizeof(pools) / sizeof(pools[0]); i++ ){
+		char args[32];
+
+		snprintf( args, sizeof(args), "--par %u", pools[i] );
+
+		uint64_t ns = run( par_path, args, want );
+
+		printf( "  --par %-2u        %8.2fms  %.2fx\n",
+		        pools[i], ns / 1e6, (double)base / ns );
+	}
+
+	unlink( serial_path );
+	unlink( par_path );
+
+	return 0;
+}
@@ -0,0 +1,156 @@
+#define _POSIX_C_SOURCE 200809L
+#include "bench.h"
+#include <pthread.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Load on the evaluation server
+//
+// Starts `out/miniforth --serve` with a few worker counts, and has a
+// number of clients send it requests at once, each on a new connection
+// that's closed once the answer is read. Reports requests per second and
+// the time from connecting to reading the whole answer, which has to be
+// what the request prints.
+
+enum {
+	CLIENTS  = 16,
+	REQUESTS = 500,
+};
+
+typedef struct load {
+	const char *label;
+	const char *request;
+	const char *answer;
+	unsigned    per_client;
+} load_t;
+
+static const load_t loads[] = {
+	{ "short request", ": sq dup * ; 5 sq . cr\n", "25\n", REQUESTS },
+	{ "60k iteration loop",
+	  ": count 0 while dup 60000 < begin 1 + repeat ; count . cr\n",
+	  "60000\n", 4 },
+};
+
+static const unsigned workers[] = { 1, 4, 8 };
+
+static struct sockaddr_un addr = { .sun_family = AF_UNIX };
+static const load_t *load;
+static uint64_t *times;
+
+static bool request( void ){
+	int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+	char answer[256];
+	size_t len = 0;
+	ssize_t n;
+
+	if ( fd < 0 || connect( fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ){
+		if ( fd >= 0 ){
+			close( fd );
+		}
+
+		return false;
+	}
+
+	bool ok = write( fd, load->request, strlen( load->request ))
+	          == (ssize_t)strlen( load->request );
+
+	shutdown( fd, SHUT_WR );
+
+	while ( (n = read( fd, answer + len, sizeof(answer) - 1 - len )) > 0 ){
+		len += n;
+	}
+
+	close( fd );
+	answer[len] = '\0';
+
+	return ok && strcmp( answer, load->answer ) == 0;
+}
+
+static void *client( void *arg ){
+	uint64_t *t = arg;
+
+	for ( unsigned i = 0; i < load->per_client; i++ ){
+		uint64_t start = bench_now( );
+
+		bench_check( request( ), "answer from the server" );
+		t[i] = bench_now( ) - start;
+	}
+
+	return NULL;
+}
+
+static pid_t start_server( unsigned count ){
+	char arg[16];
+	pid_t pid;
+
+	snprintf( arg, sizeof(arg), "%u", count );
+	unlink( addr.sun_path );
+
+	if ( (pid = fork( )) == 0 ){
+		execl( "out/miniforth", "miniforth", "--serve", addr.sun_path,
+		       "--workers", arg, (char *)NULL );
+		_exit( 127 );
+	}
+
+	// wait for it to be listening
+	for ( unsigned i = 0; i < 500 && access( addr.sun_path, F_OK ); i++ ){
+		bench_sleep( 10000 );
+	}
+
+	bench_check( pid > 0 && access( addr.sun_path, F_OK ) == 0, "starting the server" );
+
+	return pid;
+}
+
+static void stop_server( pid_t pid ){
+	kill( pid, SIGTERM );
+	waitpid( pid, NULL, 0 );
+	unlink( addr.sun_path );
+}
+
+int main( void ){
+	pthread_t threads[CLIENTS];
+
+	snprintf( addr.sun_path, sizeof(addr.sun_path), "/tmp/miniforth-bench-%d.sock",
+	          (int)getpid( ));
+
+	printf( "%u clients, a new connection per request\n", CLIENTS );
+
+	for ( unsigned l = 0; l < sizeof(loads) / sizeof(loads[0]); l++ ){
+		load  = loads + l;
+		times = calloc( CLIENTS * load->per_client, sizeof(uint64_t) );
+		bench_check( times != NULL, "allocating" );
+
+		printf( "%s:\n", load->label );
+
+		for ( unsigned w = 0; w < sizeof(workers) / sizeof(workers[0]); w++ ){
+			char label[32];
+			pid_t pid = start_server( workers[w] );
+			uint64_t start = bench_now( );
+
+			for ( unsigned i = 0; i < CLIENTS; i++ ){
+				pthread_create( threads + i, NULL, client, times + i * load->per_client );
+			}
+
+			for ( unsigned i = 0; i < CLIENTS; i++ ){
+				pthread_join( threads[i], NULL );
+			}
+
+			uint64_t elapsed = bench_now( ) - start;
+			unsigned count = CLIENTS * load->per_client;
+
+			stop_server( pid );
+
+			snprintf( label, sizeof(label), "%u workers %7.0f req/s",
+			          workers[w], count / (elapsed / 1e9) );
+			bench_percentiles( label, times, count );
+		}
+
+		free( times );
+	}
+
+	return 0;
+}
@@ -0,0 +1,143 @@
+#ifndef _MINIFORTH_CODE_H
+#define _MINIFORTH_CODE_H 1
+#include <miniforth/miniforth.h>
+
+// Helpers for reading compiled code, which hide the differences between
+// the code formats in config.h. Operands that need a full cell are
+// aligned to a cell boundary, so they can be read directly.
+
+#if MINIFT_CODE_FORMAT != MINIFT_CODE_CELLS
+// branches are relative to the branch operand
+#define MINIFT_BRANCH_ABSOLUTE 0
+#else
+#define MINIFT_BRANCH_ABSOLUTE 1
+#endif
+
+// word hash for a token
+static inline minift_cell_t minift_code_word( minift_vm_t *vm,
+                                              minift_token_t token )
+{
+#if MINIFT_CODE_FORMAT != MINIFT_CODE_CELLS
+	return vm->words.start[token];
+#else
+	return token;
+#endif
+}
+
+static inline minift_token_t *minift_code_body( minift_define_t *def ){
+	return (void *)((uint8_t *)def + sizeof(minift_define_t));
+}
+
+static inline void *minift_code_align( void *ptr ){
+	uintptr_t temp = (uintptr_t)ptr;
+	uintptr_t size = sizeof(minift_cell_t);
+
+	return (void *)((temp + size - 1) & ~(size - 1));
+}
+
+// cell operand following the word at `ip`
+static inline minift_cell_t *minift_code_cell( minift_token_t *ip ){
+#if MINIFT_CODE_FORMAT == MINIFT_CODE_CELLS
+	return (minift_cell_t *)(ip + 1);
+#else
+	return minift_code_align( ip + 1 );
+#endif
+}
+
+// the word after a word with a cell operand
+static inline minift_token_t *minift_code_after_cell( minift_token_t *ip ){
+	return (minift_token_t *)(minift_code_cell( ip ) + 1);
+}
+
+// 16 bit operands, used for relative branches, string sizes and `pushs`,
+// take two tokens in byte code
+#if MINIFT_CODE_FORMAT == MINIFT_CODE_BYTES
+#define MINIFT_SHORT_TOKENS 2
+#else
+#define MINIFT_SHORT_TOKENS 1
+#endif
+
+static inline minift_cell_t minift_code_short( minift_token_t *ref ){
+#if MINIFT_CODE_FORMAT == MINIFT_CODE_BYTES
+	return ref[0] | (ref[1] << 8);
+#else
+	return *ref;
+#endif
+}
+
+static inline void minift_code_set_short( minift_token_t *ref,
+                                          minift_cell_t value )
+{
+#if MINIFT_CODE_FORMAT == MINIFT_CODE_BYTES
+	ref[0] = value & 0xff;
+	ref[1] = (value >> 8) & 0xff;
+#else
+	*ref = value;
+#endif
+}
+
+// target of the branch at `ip`
+static inline minift_token_t *minift_code_target( minift_token_t *ip ){
+#if MINIFT_BRANCH_ABSOLUTE
+	return (minift_token_t *)ip[1];
+#else
+	return ip + 1 + (int16_t)minift_code_short( ip + 1 );
+#endif
+}
+
+// sets the target of a branch operand, returns false if it's out of range
+static inline bool minift_code_set_target( minift_token_t *ref,
+                                           minift_token_t *target )
+{
+#if MINIFT_BRANCH_ABSOLUTE
+	*ref = (minift_cell_t)target;
+	return true;
+#else
+	intptr_t offset = target - ref;
+
+	minift_code_set_short( ref, (uint16_t)offset );
+	return offset >= INT16_MIN && offset <= INT16_MAX;
+#endif
+}
+
+// Variable length constants are zigzag encoded, so small negative numbers
+// stay short, and then stored 7 bits at a time with the high bit set on
+// all but the last byte.
+static inline minift_token_t *minift_varint_read( minift_token_t *ip,
+                                                  minift_cell_t *value )
+{
+	minift_cell_t temp = 0;
+	unsigned shift = 0;
+
+	do {
+		temp |= (minift_cell_t)(*ip & 0x7f) << shift;
+		shift += 7;
+	} while ( *ip++ & 0x80 );
+
+	*value = (temp >> 1) ^ -(temp & 1);
+
+	return ip;
+}
+
+static inline minift_token_t *minift_varint_write( minift_token_t *ip,
+                                                   minift_cell_t value )
+{
+	minift_cell_t temp = (value << 1) ^ -(value >> (sizeof(value) * 8 - 1));
+
+	while ( temp >= 0x80 ){
+		*ip++ = (temp & 0x7f) | 0x80;
+		temp >>= 7;
+	}
+
+	*ip++ = temp;
+
+	return ip;
+}
+
+static inline unsigned minift_bytes_to_tokens( unsigned bytes ){
+	unsigned size = sizeof(minift_token_t);
+
+	return (bytes + size - 1) / size;
+}
+
+#endif
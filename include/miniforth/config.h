@@ -0,0 +1,69 @@
+#ifndef _MINIFORTH_CONFIG_H
+#define _MINIFORTH_CONFIG_H 1
+
+// Compile-time configuration, any of these can be overridden with -D
+
+// Type of the cells on the stacks and in the data space. Has to be
+// unsigned and big enough to hold a pointer.
+#ifndef MINIFT_CELL
+#define MINIFT_CELL unsigned long
+#endif
+
+// Format used for compiled code:
+//
+// MINIFT_CODE_CELLS:   each word is a full cell holding the word's hash,
+//                      branches hold absolute addresses
+// MINIFT_CODE_COMPACT: each word is a 16 bit index into the vm's word
+//                      table, branches are relative, and small constants
+//                      fit in a single token
+// MINIFT_CODE_BYTES:   each word is a one byte index into the word table,
+//                      branches are relative, and constants are stored as
+//                      variable length integers
+#define MINIFT_CODE_CELLS   0
+#define MINIFT_CODE_COMPACT 1
+#define MINIFT_CODE_BYTES   2
+
+#ifndef MINIFT_CODE_FORMAT
+#define MINIFT_CODE_FORMAT MINIFT_CODE_CELLS
+#endif
+
+// Number of entries in the word table used by compact and byte code, taken
+// from the end of the data space. The builtins take up the first entries,
+// and once it's full any other words are called by hash instead.
+#ifndef MINIFT_WORD_TABLE_SIZE
+#define MINIFT_WORD_TABLE_SIZE 256
+#endif
+
+// Number of fraction bits in the fixed point numbers used by `q*` and
+// `q/`, see src/arith.c
+#ifndef MINIFT_Q_BITS
+#define MINIFT_Q_BITS 16
+#endif
+
+// Call the vm's trace hook, if it has one, before each step. It's off by
+// default since the check is on every step, stubs that profile turn it on
+#ifndef MINIFT_TRACE
+#define MINIFT_TRACE 0
+#endif
+
+// Track the peak usage of each stack, set to 0 to compile it out
+#ifndef MINIFT_MEMSTATS
+#define MINIFT_MEMSTATS 1
+#endif
+
+// Give the optional stubs do-nothing defaults, see src/defaults.c. They're
+// weak symbols, so this needs a compiler that supports them, and with it
+// set to 0 the stub has to provide every one itself.
+#ifndef MINIFT_DEFAULT_STUBS
+#ifdef __GNUC__
+#define MINIFT_DEFAULT_STUBS 1
+#else
+#define MINIFT_DEFAULT_STUBS 0
+#endif
+#endif
+
+#if MINIFT_CODE_FORMAT == MINIFT_CODE_BYTES && MINIFT_WORD_TABLE_SIZE > 256
+#error "byte code can't index more than 256 words"
+#endif
+
+#endif
@@ -2,14 +2,39 @@
 #define _MINIFORTH_H 1
 #include <stdint.h>
 #include <stdbool.h>
+#include <miniforth/config.h>
 #include <miniforth/stubs.h>
+#include <miniforth/phash.h>
 
 #define NULL ((void *)0)
 
+typedef MINIFT_CELL minift_cell_t;
+
+_Static_assert( sizeof(minift_cell_t) >= sizeof(void *),
+                "cells need to be able to hold a pointer" );
+
+// one word in compiled code
+#if MINIFT_CODE_FORMAT == MINIFT_CODE_COMPACT
+typedef uint16_t minift_token_t;
+#elif MINIFT_CODE_FORMAT == MINIFT_CODE_BYTES
+typedef uint8_t minift_token_t;
+#else
+typedef minift_cell_t minift_token_t;
+#endif
+
 enum {
 	MINIFT_TYPE_INT          = 0,
 	MINIFT_TYPE_WORD         = 1,
 	MINIFT_TYPE_ADDR         = 2,
+	MINIFT_TYPE_NONE         = 3,
+};
+
+// reader states
+enum {
+	MINIFT_READ_SKIP,
+	MINIFT_READ_COMMENT,
+	MINIFT_READ_WORD,
+	MINIFT_READ_STRING,
 };
 
 enum {
@@ -17,85 +42,582 @@ enum {
 	MINIFT_ERR_RECOVERABLE = true,
 };
 
+// return values for minift_run_for()
+enum {
+	MINIFT_RUN_YIELDED = 0,
+	MINIFT_RUN_WAITING = 1,
+	MINIFT_RUN_HALTED  = 2,
+	MINIFT_RUN_ERROR   = 3,
+};
+
 enum {
 	MINIFT_MAX_WORDSIZE = 16,
+	MINIFT_CLOCK_STEPS  = 32,
+	MINIFT_TASK_STACK   = 32,
+	MINIFT_MAX_NESTING  = 8,
+	MINIFT_BLOCK_SIZE   = 1024,
+	MINIFT_LINE_CACHE   = 8,
+	MINIFT_PARSE_BITS   = 5,
+	MINIFT_SEEN_BITS    = 6,
+	MINIFT_MAX_LOCALS   = 16,
+	MINIFT_INTERRUPTS   = 32,
+	MINIFT_NATIVE_ARGS  = 6,
+};
+
+// flags for archive entries
+enum {
+	// typed natives with no side effects, so calls with constant arguments
+	// can be folded
+	MINIFT_NATIVE_PURE  = 1 << 0,
+	// reads from the input, like `value` or `parse`, or runs input of it's
+	// own, like `include`, see src/lines.c
+	MINIFT_ENTRY_PARSES = 1 << 1,
 };
 
 typedef struct minift_stack         minift_stack_t;
 typedef struct minift_archive       minift_archive_t;
 typedef struct minift_archive_entry minift_archive_entry_t;
 typedef struct minift_vm            minift_vm_t;
+typedef struct minift_task          minift_task_t;
+typedef struct minift_segment       minift_segment_t;
+typedef struct minift_string        minift_string_t;
+typedef struct minift_strpool       minift_strpool_t;
+typedef struct minift_persist       minift_persist_t;
+typedef struct minift_blocks        minift_blocks_t;
+typedef struct minift_lines         minift_lines_t;
+
+// kinds of operands following words in compiled code, see src/code.c
+enum {
+	MINIFT_OPERAND_NONE,
+	MINIFT_OPERAND_CONST,     // a cell
+	MINIFT_OPERAND_SHORT,     // a 16 bit constant
+	MINIFT_OPERAND_VARINT,    // a variable length constant
+	MINIFT_OPERAND_ADDR,      // a cell holding an absolute address
+	MINIFT_OPERAND_BRANCH,    // a branch target, either absolute or relative
+	MINIFT_OPERAND_WORD,      // a token naming a word
+	MINIFT_OPERAND_STRING,    // a 16 bit size in tokens, then the string
+	MINIFT_OPERAND_END,
+};
 
 typedef struct minift_read_ret {
 	unsigned type;
-	unsigned long token;
+	minift_cell_t token;
 } minift_read_ret_t;
 
+typedef bool (*minift_token_handler_t)( minift_vm_t *vm,
+                                        minift_read_ret_t token );
+
+// Called by minift_step() before it runs `word` from compiled code, or
+// with 0 before it reads input.
+typedef void (*minift_trace_t)( minift_vm_t *vm, minift_cell_t word );
+
 typedef struct minift_stack {
-	unsigned long *start;
-	unsigned long *end;
-	unsigned long *ptr;
+	minift_cell_t *start;
+	minift_cell_t *end;
+	minift_cell_t *ptr;
+
+#if MINIFT_MEMSTATS
+	// highest ptr has been, see src/meminfo.c
+	minift_cell_t *peak;
+#endif
 } minift_stack_t;
 
+// C function for a typed native entry, called through a pointer of the
+// right type for it's arity, see src/native.c
+typedef void (*minift_native_t)( void );
+
 typedef struct minift_archive_entry {
 	const char    *name;
 	bool (*func)(struct minift_vm *);
-	unsigned long  hash;
+	minift_cell_t  hash;
+
+	// typed native entries have `native` set instead of `func`, and take
+	// `args` cells from the stack as arguments, leaving `results` (0 or 1)
+	minift_native_t native;
+	uint8_t         args;
+	uint8_t         results;
+	uint8_t         flags;
 } minift_arc_ent_t;
 
+#define MINIFT_NATIVE( name, fn, args, results, flags ) \
+	{ (name), NULL, 0, (minift_native_t)(fn), (args), (results), (flags) }
+
 typedef struct minift_archive {
 	char             *name;
 	minift_arc_ent_t *entries;
 	minift_archive_t *next;
 	unsigned          size;
+
+	// optional, for archives generated by tools/mkarchive, where entry
+	// hashes are already filled in and lookups take a single probe
+	const minift_phash_t *phash;
 } minift_archive_t;
 
 typedef struct minift_define {
-	unsigned long         hash;
+	minift_cell_t         hash;
 	struct minift_define *previous;
 } minift_define_t;
 
+// A task is a seperate thread of execution inside a vm, with it's own
+// stacks and instruction pointer but sharing the dictionary and archives.
+// Tasks are kept in a ring and switched round-robin by minift_run, either
+// when the running task calls `pause` or after `task_budget` steps.
+typedef struct minift_task {
+	minift_stack_t      call_stack;
+	minift_stack_t      param_stack;
+	minift_token_t     *ip;
+	minift_task_t      *next;
+
+	// carved out of the data space by `spawn`, and reused by it once the
+	// task has finished
+	bool                spawned;
+} minift_task_t;
+
+// A frozen, read-only dictionary which any number of vms can link to as
+// the base of their own, see src/segment.c
+typedef struct minift_segment {
+	minift_define_t  *definitions;
+	minift_cell_t    *start;
+	minift_cell_t    *end;
+	minift_segment_t *parent;
+
+	// word table, for compact code
+	minift_cell_t    *words;
+	unsigned          word_count;
+} minift_segment_t;
+
+// An interned string, the text follows the header and is nul terminated
+typedef struct minift_string {
+	minift_string_t *next;
+	minift_cell_t    hash;
+	minift_cell_t    length;
+	char             text[];
+} minift_string_t;
+
+// Pool of interned string literals in caller-provided memory, see
+// src/strings.c
+typedef struct minift_strpool {
+	minift_string_t **buckets;
+	unsigned          bucket_bits;
+	uint8_t          *ptr;
+	uint8_t          *end;
+} minift_strpool_t;
+
+// Layout of a persistent region, see src/persist.c. Everything in it is
+// stored as offsets from the start of the region, so it can be mapped
+// at a different address each time.
+enum {
+	MINIFT_PERSIST_MAGIC   = 0x5250464d, // "MFPR"
+	MINIFT_PERSIST_VERSION = 1,
+};
+
+typedef struct minift_persist_header {
+	uint32_t          magic;
+	uint16_t          version;
+	uint8_t           cell_size;
+	uint8_t           reserved;
+	minift_cell_t     size;
+	minift_cell_t     used;
+	minift_cell_t     newest;
+} minift_persist_header_t;
+
+// A named allocation in the region, the data follows the entry
+typedef struct minift_persist_entry {
+	minift_cell_t     hash;
+	minift_cell_t     previous;
+	minift_cell_t     size;
+} minift_persist_entry_t;
+
+typedef struct minift_persist {
+	minift_persist_header_t *header;
+
+	// entry from the last `pcreate`, and how much has been allotted to it
+	// since then
+	minift_persist_entry_t  *last;
+	minift_cell_t            allotted;
+	bool                     fresh;
+} minift_persist_t;
+
+// Layout of a compiled module in the cache, see src/module.c. The module's
+// data space comes first, then the hashes it added to the word table, and
+// this header is at the end, so the data can be read straight into place.
+enum {
+	MINIFT_MODULE_MAGIC   = 0x444d464d, // "MFMD"
+	MINIFT_MODULE_VERSION = 1,
+};
+
+typedef struct minift_module_header {
+	uint32_t          magic;
+	uint16_t          version;
+	uint8_t           cell_size;
+	uint8_t           code_format;
+	minift_cell_t     key;
+
+	// addresses in the vm it was compiled in, for relocating
+	minift_cell_t     data_base;
+	minift_cell_t     data_end;
+	minift_cell_t     start;
+	minift_cell_t     definitions;
+	minift_cell_t     data_start;
+
+	minift_cell_t     size;
+	minift_cell_t     words;
+} minift_module_header_t;
+
+// One block buffer, see src/block.c
+typedef struct minift_block_buf {
+	minift_cell_t     block;
+	unsigned long     used;
+	uint8_t          *data;
+	bool              valid;
+	bool              dirty;
+} minift_block_buf_t;
+
+// Cache of block buffers in caller-provided memory
+typedef struct minift_blocks {
+	minift_block_buf_t *bufs;
+	unsigned            count;
+	unsigned long       clock;
+
+	// buffer from the last `block` or `buffer`, which `update` marks
+	minift_block_buf_t *current;
+} minift_blocks_t;
+
+// Input is fed to the vm in chunks with minift_feed(), and the reader
+// picks up where it left off when a token is split between chunks.
+typedef struct minift_reader {
+	const char       *start;
+	const char       *ptr;
+	const char       *end;
+	unsigned          state;
+
+	// partial word
+	char              buf[MINIFT_MAX_WORDSIZE];
+	unsigned          len;
+
+	// partial string, written straight into the data space
+	char             *str;
+	char             *str_ptr;
+	minift_token_t   *str_size;
+
+	// input for minift_run(), which pulls from minift_get_char()
+	char              in_char;
+} minift_reader_t;
+
+// state for the definition being compiled, `code` is where the next
+// token goes
+typedef struct minift_compiler {
+	minift_token_t   *code;
+	minift_token_t   *forward[MINIFT_MAX_NESTING];
+	minift_token_t   *backward[MINIFT_MAX_NESTING];
+	unsigned          forward_count;
+	unsigned          backward_count;
+
+	// run of constants just compiled, for folding calls to pure natives
+	minift_token_t   *fold_at[MINIFT_NATIVE_ARGS];
+	minift_cell_t     fold_values[MINIFT_NATIVE_ARGS];
+	minift_token_t   *fold_end;
+	unsigned          fold_count;
+
+	// locals declared with `{ ... }`, by hash, in the order they were
+	// declared, and where the compiler is in a declaration
+	minift_cell_t     locals[MINIFT_MAX_LOCALS];
+	unsigned          local_count;
+	unsigned          local_state;
+} minift_compiler_t;
+
+// A line in the line cache, the text is copied after the code so hits can
+// be checked against it
+typedef struct minift_line {
+	minift_cell_t     hash;
+	unsigned long     length;
+	minift_token_t   *code;
+	const char       *text;
+} minift_line_t;
+
+// Space for compiling lines of input, in caller-provided memory, see
+// src/lines.c
+typedef struct minift_lines {
+	uint8_t          *start;
+	uint8_t          *ptr;
+	uint8_t          *end;
+
+	minift_line_t     cache[MINIFT_LINE_CACHE];
+	unsigned          next;
+
+	// dictionary the cached lines were compiled against
+	minift_define_t  *definitions;
+	minift_cell_t    *words;
+
+	// input before this is left to the interpreter, when it doesn't hold
+	// a whole line or the line is only being interpreted
+	const char       *plain_until;
+
+	// hashes of lines interpreted once, compiled if they come round again
+	minift_cell_t     seen[1 << MINIFT_SEEN_BITS];
+
+	// the line being compiled, the reader's end is moved to the end of it
+	// until it's finished
+	const char       *text;
+	unsigned long     length;
+	minift_cell_t     hash;
+	const char       *input_end;
+	bool              active;
+	bool              cacheable;
+
+	// code compiled for the line so far, and the data stack pointers that
+	// are swapped with the vm's while compiling it
+	minift_token_t   *code;
+	minift_cell_t    *swap_ptr;
+	minift_cell_t    *swap_end;
+	bool              open;
+
+	// parsing word that ended the last stretch of code, run once it's done
+	minift_cell_t     pending;
+	bool              has_pending;
+
+	// whether words parse, by hash, for the dictionary in
+	// `parse_definitions`
+	minift_cell_t     parse_words[1 << MINIFT_PARSE_BITS];
+	bool              parse_results[1 << MINIFT_PARSE_BITS];
+	minift_define_t  *parse_definitions;
+} minift_lines_t;
+
+// usage of one stack, in cells
+typedef struct minift_stack_info {
+	unsigned long used;
+	unsigned long peak;
+	unsigned long size;
+} minift_stack_info_t;
+
+typedef struct minift_meminfo {
+	minift_stack_info_t data;
+	minift_stack_info_t params;
+	minift_stack_info_t calls;
+} minift_meminfo_t;
+
+// space taken by a definition, in bytes
+typedef struct minift_define_size {
+	unsigned long code;
+	unsigned long data;
+} minift_define_size_t;
+
+typedef struct minift_code_iter {
+	minift_vm_t      *vm;
+	minift_token_t   *ip;
+	void             *operand;
+	minift_cell_t     word;
+	unsigned          kind;
+
+	minift_token_t   *next;
+} minift_code_iter_t;
+
 typedef struct minift_vm {
 	minift_stack_t    data_stack;
 	minift_stack_t    call_stack;
 	minift_stack_t    param_stack;
-	unsigned long    *ip;
+	minift_token_t   *ip;
 	minift_archive_t *archives;
 	minift_define_t  *definitions;
+	minift_segment_t *segment;
+	minift_cell_t    *data_base;
+	minift_strpool_t *strings;
+	minift_persist_t *persist;
+	minift_blocks_t  *blocks;
+	minift_lines_t   *lines;
+
+	// maps tokens in compact code to word hashes
+	minift_stack_t    words;
 
 	bool              running;
 	bool              compiling;
+	bool              error;
 	minift_archive_t  base_archive;
+
+	// the currently running task, the one started by minift_init_vm
+	// is main_task, which runs the interpreter
+	minift_task_t    *task;
+	minift_task_t     main_task;
+	unsigned long     task_budget;
+
+	// finished tasks made by `spawn`, linked through `next`
+	minift_task_t    *free_tasks;
+	unsigned long     task_steps;
+	bool              task_yield;
+
+	minift_reader_t        reader;
+	minift_compiler_t      compiler;
+	minift_token_handler_t token_handler;
+	minift_task_t         *token_task;
+	bool                   waiting;
+
+	// interrupts raised and not handled yet, a bit each, and the words
+	// that handle them, see src/interrupt.c
+	_Atomic uint32_t       interrupts;
+	minift_cell_t          interrupt_words[MINIFT_INTERRUPTS];
+	bool                   in_interrupt;
+	minift_token_t         interrupt_return[2];
+
+	// count of source files loaded, see src/module.c
+	unsigned long          loads;
+
+	// optional hook for instrumenting each step, see MINIFT_TRACE
+	minift_trace_t         trace;
 } minift_vm_t;
 
 minift_vm_t *minift_init_vm( minift_vm_t *vm,
                              minift_stack_t *calls,
                              minift_stack_t *data,
                              minift_stack_t *params,
-                             unsigned long  *ip );
+                             minift_token_t *ip );
 
 void minift_step( minift_vm_t *vm );
 void minift_run( minift_vm_t *vm );
+int  minift_run_for( minift_vm_t *vm,
+                     unsigned long max_steps,
+                     unsigned long deadline );
 void minift_error( minift_vm_t *vm, bool recoverable, char *msg );
-bool minift_exec_word( minift_vm_t *vm, unsigned long word );
+bool minift_exec_word( minift_vm_t *vm, minift_cell_t word );
+void minift_feed( minift_vm_t *vm, const char *buf, unsigned long len );
 minift_read_ret_t minift_read_token( minift_vm_t *vm );
+bool minift_with_token( minift_vm_t *vm, minift_token_handler_t handler );
 void minift_compile( minift_vm_t *vm );
-minift_define_t *minift_make_variable( minift_vm_t *vm, unsigned long word );
-unsigned long *minift_define_data( minift_define_t *define );
+void minift_compile_token( minift_vm_t *vm, minift_read_ret_t token );
+minift_define_t *minift_make_variable( minift_vm_t *vm, minift_cell_t word );
+minift_cell_t *minift_define_data( minift_define_t *define );
+
+minift_define_t *minift_define_lookup( minift_vm_t *vm, minift_cell_t hash );
+
+bool minift_forget( minift_vm_t *vm, minift_define_t *def );
+unsigned long minift_compact( minift_vm_t *vm );
+
+void minift_segment_freeze( minift_vm_t *vm, minift_segment_t *seg );
+bool minift_segment_link( minift_vm_t *vm, minift_segment_t *seg );
+bool minift_is_shared( minift_vm_t *vm, void *ptr );
+minift_segment_t *minift_segment_owner( minift_vm_t *vm, void *ptr );
+minift_define_t *minift_define_private( minift_vm_t *vm,
+                                        minift_define_t *def );
+minift_define_t *minift_define_resolve( minift_vm_t *vm,
+                                        minift_define_t *def );
+
+void minift_meminfo( minift_vm_t *vm, minift_meminfo_t *info );
+void minift_define_size( minift_vm_t *vm,
+                         minift_define_t *def,
+                         minift_define_size_t *size );
 
-minift_define_t *minift_define_lookup( minift_vm_t *vm, unsigned long hash );
+minift_token_t minift_code_token( minift_vm_t *vm, minift_cell_t word );
+void minift_code_begin( minift_code_iter_t *it,
+                        minift_vm_t *vm,
+                        minift_define_t *def );
+bool minift_code_next( minift_code_iter_t *it );
+
+minift_vm_t *minift_vm_clone( minift_vm_t *dst,
+                              minift_vm_t *src,
+                              minift_stack_t *calls,
+                              minift_stack_t *data,
+                              minift_stack_t *params );
+
+minift_task_t *minift_task_spawn( minift_vm_t *vm,
+                                  minift_task_t *task,
+                                  minift_stack_t *calls,
+                                  minift_stack_t *params,
+                                  minift_cell_t word );
+void minift_task_switch( minift_vm_t *vm );
+void minift_pause( minift_vm_t *vm );
 
 void minift_archive_add( minift_vm_t *vm, minift_archive_t *archive );
 void minift_archive_init_base( minift_vm_t *vm );
-minift_arc_ent_t *minift_archive_lookup( minift_vm_t *vm, unsigned long hash );
+minift_arc_ent_t *minift_archive_lookup( minift_vm_t *vm, minift_cell_t hash );
+bool minift_native_call( minift_vm_t *vm,
+                         minift_arc_ent_t *ent,
+                         minift_cell_t *args,
+                         minift_cell_t *result );
+bool minift_native_exec( minift_vm_t *vm, minift_arc_ent_t *ent );
+
+bool minift_strpool_init( minift_vm_t *vm,
+                          minift_strpool_t *pool,
+                          void *mem,
+                          unsigned long size );
+bool minift_persist_init( minift_vm_t *vm,
+                          minift_persist_t *persist,
+                          void *mem,
+                          unsigned long size );
+minift_persist_entry_t *minift_persist_lookup( minift_vm_t *vm,
+                                               minift_cell_t hash );
+minift_persist_entry_t *minift_persist_alloc( minift_vm_t *vm,
+                                              minift_cell_t hash );
+bool minift_persist_allot( minift_vm_t *vm, minift_cell_t bytes );
+void *minift_persist_data( minift_persist_entry_t *ent );
+
+bool minift_blocks_init( minift_vm_t *vm,
+                         minift_blocks_t *blocks,
+                         void *mem,
+                         unsigned long size );
+void *minift_block( minift_vm_t *vm, minift_cell_t block, bool read );
+void minift_block_update( minift_vm_t *vm );
+bool minift_blocks_save( minift_vm_t *vm );
+bool minift_blocks_flush( minift_vm_t *vm );
+
+bool minift_lines_init( minift_vm_t *vm,
+                        minift_lines_t *lines,
+                        void *mem,
+                        unsigned long size );
+minift_token_t *minift_lines_lookup( minift_vm_t *vm,
+                                     const char *text,
+                                     unsigned long len,
+                                     minift_cell_t hash );
+bool minift_lines_seen( minift_vm_t *vm, minift_cell_t hash );
+minift_token_t *minift_lines_space( minift_vm_t *vm );
+void minift_lines_add( minift_vm_t *vm,
+                       const char *text,
+                       unsigned long len,
+                       minift_cell_t hash,
+                       minift_token_t *code,
+                       minift_token_t *end );
+void minift_lines_forget_parses( minift_vm_t *vm, minift_lines_t *lines );
+
+void minift_interrupts_init( minift_vm_t *vm );
+void minift_interrupt( minift_vm_t *vm, unsigned n );
+bool minift_on_interrupt( minift_vm_t *vm, minift_cell_t n, minift_cell_t word );
+void minift_interrupt_dispatch( minift_vm_t *vm );
+
+const char *minift_source( minift_vm_t *vm, unsigned long *len );
+unsigned long minift_input_offset( minift_vm_t *vm );
+void minift_set_input_offset( minift_vm_t *vm, unsigned long offset );
+const char *minift_parse( minift_vm_t *vm, char delim, unsigned long *len );
+const char *minift_parse_name( minift_vm_t *vm, unsigned long *len );
+void minift_skip( minift_vm_t *vm, char delim );
+
+bool minift_evaluate( minift_vm_t *vm, const char *text, unsigned long len );
+bool minift_include( minift_vm_t *vm, const char *name, bool once );
+
+const char *minift_intern( minift_vm_t *vm, const char *str, unsigned long len );
+minift_string_t *minift_strpool_entry( minift_vm_t *vm, const char *str );
+unsigned long minift_str_length( const char *str );
+bool minift_str_equal( const char *a, const char *b, unsigned long len );
+int  minift_str_compare( const char *a, unsigned long alen,
+                         const char *b, unsigned long blen );
+const char *minift_str_search( const char *str, unsigned long len,
+                               const char *pat, unsigned long patlen );
+const char *minift_str_scan( const char *str, unsigned long len, char delim );
+const char *minift_str_skip( const char *str, unsigned long len, char delim );
+minift_cell_t minift_str_hash( const char *str, unsigned long len );
 
 // TODO: move these to a seperate util source file
-unsigned long minift_hash( const char *str );
+minift_cell_t minift_hash( const char *str );
 unsigned minift_bytes_to_cells( unsigned bytes );
 void minift_puts( const char *s );
 
-unsigned long minift_pop( minift_vm_t *vm, minift_stack_t *stack );
-void minift_push( minift_vm_t *vm, minift_stack_t *stack, unsigned long data );
-unsigned long minift_peek( minift_vm_t *vm, minift_stack_t *stack );
+minift_cell_t minift_pop( minift_vm_t *vm, minift_stack_t *stack );
+void minift_push( minift_vm_t *vm, minift_stack_t *stack, minift_cell_t data );
+minift_cell_t minift_peek( minift_vm_t *vm, minift_stack_t *stack );
+
+static inline void minift_stack_mark( minift_stack_t *stack ){
+#if MINIFT_MEMSTATS
+	if ( stack->ptr > stack->peak ){
+		stack->peak = stack->ptr;
+	}
+#endif
+}
 
 #endif
@@ -0,0 +1,22 @@
+#ifndef _MINIFORTH_PHASH_H
+#define _MINIFORTH_PHASH_H 1
+#include <stdint.h>
+
+// Perfect hash tables for static archives, generated at build time by
+// tools/mkarchive. Only the low 32 bits of a word hash are used to find
+// the slot, so the same table works regardless of the width of
+// unsigned long on the target.
+typedef struct minift_phash {
+	const uint16_t *slots;
+	uint32_t        mult;
+	unsigned        bits;
+} minift_phash_t;
+
+static inline uint32_t minift_phash_slot( uint32_t hash,
+                                          uint32_t mult,
+                                          unsigned bits )
+{
+	return (uint32_t)(hash * mult) >> (32 - bits);
+}
+
+#endif
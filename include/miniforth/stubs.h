@@ -1,7 +1,31 @@
 #ifndef _MINIFORTH_STUBS_H
 #define _MINIFORTH_STUBS_H 1
+#include <stdbool.h>
 
 char minift_get_char( void );
 void minift_put_char( char c );
 
+// monotonic time, in whatever units the platform likes, only used to
+// compare against deadlines passed to minift_run_for()
+unsigned long minift_clock( void );
+
+// block storage, in MINIFT_BLOCK_SIZE byte blocks. Writes are handed
+// `count` buffers for consecutive blocks starting at `block`, so they can
+// be written back together.
+bool minift_block_read( unsigned long block, void *buf );
+bool minift_block_write( unsigned long block, void *const *bufs, unsigned count );
+
+// source files for `include` and `require`. minift_source_read() returns
+// the whole text of the file and sets `len`, or returns NULL if it can't
+// be read, and the text is handed back to minift_source_done() once it's
+// been run.
+const char *minift_source_read( const char *name, unsigned long *len );
+void minift_source_done( const char *text, unsigned long len );
+
+// cache of compiled modules, by key. Reads copy the module into `buf` and
+// return it's size, or 0 if it isn't cached or doesn't fit. Stubs with
+// nowhere to keep them can just return 0 and false.
+unsigned long minift_cache_read( unsigned long key, void *buf, unsigned long size );
+bool minift_cache_write( unsigned long key, const void *data, unsigned long size );
+
 #endif
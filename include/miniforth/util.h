@@ -9,7 +9,7 @@ int  minift_atoi( const char *s );
 int  minift_hextoi( const char *s );
 int  minift_strlen( const char *s );
 char minift_lowercase( char c );
-void minift_print_int( unsigned long n );
-void minift_print_hex( unsigned long n );
+void minift_print_int( minift_cell_t n );
+void minift_print_hex( minift_cell_t n );
 
 #endif
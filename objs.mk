@@ -2,12 +2,34 @@
 
 minift-src = $(wildcard $(LIBRARY_ROOT)/miniforth/src/*.c)
 minift-obj = $(minift-src:.c=.o)
+minift-gen = $(LIBRARY_ROOT)/miniforth/src/builtins_arc.h \
+             $(LIBRARY_ROOT)/miniforth/src/words_hash.h
+minift-tool = $(LIBRARY_ROOT)/miniforth/tools/mkarchive
+
+HOSTCC ?= cc
+
+$(minift-tool): $(LIBRARY_ROOT)/miniforth/tools/mkarchive.c
+	$(HOSTCC) -I$(LIBRARY_ROOT)/miniforth/include -Wall -std=c11 -o $@ $<
+
+$(LIBRARY_ROOT)/miniforth/src/%_arc.h: $(LIBRARY_ROOT)/miniforth/src/%.arc $(minift-tool)
+	$(minift-tool) minift_$* < $< > $@ || (rm -f $@; false)
+
+$(LIBRARY_ROOT)/miniforth/src/%_hash.h: $(LIBRARY_ROOT)/miniforth/src/%.hash $(minift-tool)
+	$(minift-tool) -d HASH_ < $< > $@ || (rm -f $@; false)
+
+$(LIBRARY_ROOT)/miniforth/src/builtins.o: $(LIBRARY_ROOT)/miniforth/src/builtins_arc.h \
+                                          $(LIBRARY_ROOT)/miniforth/src/words_hash.h
+$(LIBRARY_ROOT)/miniforth/src/miniforth.o: $(LIBRARY_ROOT)/miniforth/src/words_hash.h
+$(LIBRARY_ROOT)/miniforth/src/interrupt.o: $(LIBRARY_ROOT)/miniforth/src/words_hash.h
+$(LIBRARY_ROOT)/miniforth/src/code.o: $(LIBRARY_ROOT)/miniforth/src/words_hash.h
+$(LIBRARY_ROOT)/miniforth/src/segment.o: $(LIBRARY_ROOT)/miniforth/src/words_hash.h
+$(LIBRARY_ROOT)/miniforth/src/module.o: $(LIBRARY_ROOT)/miniforth/src/words_hash.h
 
 $(BUILD)/lib/miniforth.a: $(minift-obj)
 	ar rvs $@ $^
 
 .PHONY: minift-clean
 minift-clean:
-	rm -f $(minift-obj)
+	rm -f $(minift-obj) $(minift-gen) $(minift-tool)
 
 ALL_CLEAN += minift-clean
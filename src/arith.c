@@ -0,0 +1,382 @@
+#include <miniforth/miniforth.h>
+#include <stdint.h>
+
+// Double cell and scaled arithmetic
+//
+// The base words treat cells as unsigned. These add signed comparison
+// and division, and words that go through a double cell intermediate so
+// that products don't overflow before they're scaled back down:
+//
+//   s< s>           ( a b -- flag )              signed comparison
+//   s/ smod         ( a b -- n )                 signed division
+//   */              ( a b c -- a*b/c )
+//   */mod           ( a b c -- rem a*b/c )
+//   um* m*          ( a b -- lo hi )             unsigned, signed product
+//   um/mod          ( lo hi d -- rem quot )      unsigned
+//   d+ d-           ( lo hi lo hi -- lo hi )
+//   dnegate         ( lo hi -- lo hi )
+//   sqrt            ( u -- n )                   floor of the square root
+//   q* q/           ( a b -- n )                 fixed point
+//
+// Doubles are two cells with the high one on top. Signed division rounds
+// towards zero like C does, so remainders take the sign of the dividend.
+// Fixed point numbers have MINIFT_Q_BITS bits after the point, so with
+// the default of 16, `1.5` is 0x18000.
+//
+// Where the compiler has a 128 bit type the double cell products and
+// quotients use it, otherwise they're built out of half cell operations.
+// Division by zero, and quotients too big for a cell, are recoverable
+// errors rather than traps.
+
+typedef minift_cell_t cell;
+
+#define CELL_BITS (sizeof(cell) * 8)
+#define HALF_BITS (CELL_BITS / 2)
+#define HALF_MASK (((cell)1 << HALF_BITS) - 1)
+
+_Static_assert( MINIFT_Q_BITS > 0 && MINIFT_Q_BITS < sizeof(minift_cell_t) * 8,
+                "MINIFT_Q_BITS has to leave room for an integer part" );
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 dcell;
+
+_Static_assert( sizeof(cell) <= 8, "cells must fit twice in 128 bits" );
+#endif
+
+static inline bool is_negative( cell x ){
+	return x >> (CELL_BITS - 1);
+}
+
+static inline cell magnitude( cell x ){
+	return is_negative( x )? -x : x;
+}
+
+static inline void negate( cell *lo, cell *hi ){
+	*lo = -*lo;
+	*hi = ~*hi + (*lo == 0);
+}
+
+static inline void umul( cell a, cell b, cell *lo, cell *hi ){
+#ifdef __SIZEOF_INT128__
+	dcell p = (dcell)a * b;
+
+	*lo = p;
+	*hi = p >> CELL_BITS;
+#else
+#ifdef __GNUC__
+	// most products still fit in a cell
+	if ( !__builtin_mul_overflow( a, b, lo )){
+		*hi = 0;
+		return;
+	}
+#endif
+
+	cell al = a & HALF_MASK, ah = a >> HALF_BITS;
+	cell bl = b & HALF_MASK, bh = b >> HALF_BITS;
+
+	cell ll  = al * bl;
+	cell mid = (ll >> HALF_BITS) + (al * bh & HALF_MASK) + (ah * bl & HALF_MASK);
+
+	*lo = (ll & HALF_MASK) | (mid << HALF_BITS);
+	*hi = ah * bh + (al * bh >> HALF_BITS) + (ah * bl >> HALF_BITS)
+	    + (mid >> HALF_BITS);
+#endif
+}
+
+// signed product, from the unsigned one with the high half corrected for
+// negative operands
+static inline void smul( cell a, cell b, cell *lo, cell *hi ){
+	umul( a, b, lo, hi );
+
+	*hi -= (is_negative( a )? b : 0) + (is_negative( b )? a : 0);
+}
+
+// Divides `hi:lo` by `d`, which has to be greater than `hi` so that the
+// quotient fits in a cell.
+static inline cell udiv( cell lo, cell hi, cell d, cell *rem ){
+	if ( !hi ){
+		*rem = lo % d;
+		return lo / d;
+	}
+
+#ifdef __SIZEOF_INT128__
+	dcell n = ((dcell)hi << CELL_BITS) | lo;
+
+	*rem = n % d;
+	return n / d;
+#else
+	// one bit of quotient at a time, shifted into the bottom of `lo` as
+	// the dividend is shifted out of the top of it
+	for ( unsigned i = 0; i < CELL_BITS; i++ ){
+		bool carry = is_negative( hi );
+
+		hi = (hi << 1) | (lo >> (CELL_BITS - 1));
+		lo <<= 1;
+
+		if ( carry || hi >= d ){
+			hi -= d;
+			lo |= 1;
+		}
+	}
+
+	*rem = hi;
+	return lo;
+#endif
+}
+
+static bool check_divisor( minift_vm_t *vm, cell hi, cell d ){
+	if ( d == 0 ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "division by zero" );
+		return false;
+	}
+
+	if ( hi >= d ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "division overflow" );
+		return false;
+	}
+
+	return true;
+}
+
+// Signed division of `hi:lo` by `d`, rounding towards zero.
+static bool sdiv( minift_vm_t *vm, cell lo, cell hi, cell d,
+                  cell *quot, cell *rem )
+{
+	bool neg_n = is_negative( hi );
+	bool neg_q = neg_n != is_negative( d );
+	cell md = magnitude( d );
+
+	if ( neg_n ){
+		negate( &lo, &hi );
+	}
+
+	if ( !check_divisor( vm, hi, md )){
+		return false;
+	}
+
+	cell q = udiv( lo, hi, md, rem );
+
+	// the most negative cell is the only quotient without a positive
+	// counterpart
+	if ( q > (cell)neg_q + (~(cell)0 >> 1) ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "division overflow" );
+		return false;
+	}
+
+	*quot = neg_q? -q : q;
+	*rem  = neg_n? -*rem : *rem;
+
+	return true;
+}
+
+// sign extends a cell to a double
+static inline cell high_of( cell x ){
+	return is_negative( x )? ~(cell)0 : 0;
+}
+
+minift_cell_t minift_native_signed_less( minift_cell_t a, minift_cell_t b ){
+	cell sign = (cell)1 << (CELL_BITS - 1);
+
+	return (a ^ sign) < (b ^ sign);
+}
+
+minift_cell_t minift_native_signed_greater( minift_cell_t a, minift_cell_t b ){
+	return minift_native_signed_less( b, a );
+}
+
+// Digit by digit, two bits of the argument for each bit of the result.
+minift_cell_t minift_native_sqrt( minift_cell_t x ){
+	cell res = 0;
+	cell bit = (cell)1 << (CELL_BITS - 2);
+
+	while ( bit > x ){
+		bit >>= 2;
+	}
+
+	for ( ; bit; bit >>= 2 ){
+		if ( x >= res + bit ){
+			x  -= res + bit;
+			res = (res >> 1) + bit;
+
+		} else {
+			res >>= 1;
+		}
+	}
+
+	return res;
+}
+
+// The product is shifted down as a double, so it rounds towards negative
+// infinity and only overflows if the result doesn't fit.
+minift_cell_t minift_native_fixed_multiply( minift_cell_t a, minift_cell_t b ){
+	cell lo, hi;
+
+	smul( a, b, &lo, &hi );
+
+	return (lo >> MINIFT_Q_BITS) | (hi << (CELL_BITS - MINIFT_Q_BITS));
+}
+
+// pops a divisor and the two cells below it, for the `a b c` words
+static inline void pop3( minift_vm_t *vm, cell *a, cell *b, cell *c ){
+	*c = minift_pop( vm, &vm->param_stack );
+	*b = minift_pop( vm, &vm->param_stack );
+	*a = minift_pop( vm, &vm->param_stack );
+}
+
+static inline void push2( minift_vm_t *vm, cell a, cell b ){
+	minift_push( vm, &vm->param_stack, a );
+	minift_push( vm, &vm->param_stack, b );
+}
+
+static bool signed_divide( minift_vm_t *vm, bool want_rem ){
+	cell b = minift_pop( vm, &vm->param_stack );
+	cell a = minift_pop( vm, &vm->param_stack );
+	cell quot, rem;
+
+	if ( !sdiv( vm, a, high_of( a ), b, &quot, &rem )){
+		return false;
+	}
+
+	minift_push( vm, &vm->param_stack, want_rem? rem : quot );
+
+	return true;
+}
+
+// ( a b -- quot )
+bool minift_builtin_signed_divide( minift_vm_t *vm ){
+	return signed_divide( vm, false );
+}
+
+// ( a b -- rem )
+bool minift_builtin_signed_modulo( minift_vm_t *vm ){
+	return signed_divide( vm, true );
+}
+
+static bool scale( minift_vm_t *vm, bool want_rem ){
+	cell a, b, c, lo, hi, quot, rem;
+
+	pop3( vm, &a, &b, &c );
+	smul( a, b, &lo, &hi );
+
+	if ( !sdiv( vm, lo, hi, c, &quot, &rem )){
+		return false;
+	}
+
+	if ( want_rem ){
+		minift_push( vm, &vm->param_stack, rem );
+	}
+
+	minift_push( vm, &vm->param_stack, quot );
+
+	return true;
+}
+
+// ( a b c -- quot )
+bool minift_builtin_scale( minift_vm_t *vm ){
+	return scale( vm, false );
+}
+
+// ( a b c -- rem quot )
+bool minift_builtin_scale_mod( minift_vm_t *vm ){
+	return scale( vm, true );
+}
+
+// ( a b -- lo hi )
+bool minift_builtin_umul( minift_vm_t *vm ){
+	cell b = minift_pop( vm, &vm->param_stack );
+	cell a = minift_pop( vm, &vm->param_stack );
+	cell lo, hi;
+
+	umul( a, b, &lo, &hi );
+	push2( vm, lo, hi );
+
+	return true;
+}
+
+// ( a b -- lo hi )
+bool minift_builtin_smul( minift_vm_t *vm ){
+	cell b = minift_pop( vm, &vm->param_stack );
+	cell a = minift_pop( vm, &vm->param_stack );
+	cell lo, hi;
+
+	smul( a, b, &lo, &hi );
+	push2( vm, lo, hi );
+
+	return true;
+}
+
+// ( lo hi d -- rem quot )
+bool minift_builtin_umod_divide( minift_vm_t *vm ){
+	cell lo, hi, d, rem;
+
+	pop3( vm, &lo, &hi, &d );
+
+	if ( !check_divisor( vm, hi, d )){
+		return false;
+	}
+
+	cell quot = udiv( lo, hi, d, &rem );
+
+	push2( vm, rem, quot );
+
+	return true;
+}
+
+static inline void pop_doubles( minift_vm_t *vm,
+                                cell *alo, cell *ahi, cell *blo, cell *bhi )
+{
+	*bhi = minift_pop( vm, &vm->param_stack );
+	*blo = minift_pop( vm, &vm->param_stack );
+	*ahi = minift_pop( vm, &vm->param_stack );
+	*alo = minift_pop( vm, &vm->param_stack );
+}
+
+// ( alo ahi blo bhi -- lo hi )
+bool minift_builtin_double_add( minift_vm_t *vm ){
+	cell alo, ahi, blo, bhi;
+
+	pop_doubles( vm, &alo, &ahi, &blo, &bhi );
+
+	cell lo = alo + blo;
+
+	push2( vm, lo, ahi + bhi + (lo < alo) );
+
+	return true;
+}
+
+// ( alo ahi blo bhi -- lo hi )
+bool minift_builtin_double_subtract( minift_vm_t *vm ){
+	cell alo, ahi, blo, bhi;
+
+	pop_doubles( vm, &alo, &ahi, &blo, &bhi );
+	push2( vm, alo - blo, ahi - bhi - (alo < blo) );
+
+	return true;
+}
+
+// ( lo hi -- lo hi )
+bool minift_builtin_double_negate( minift_vm_t *vm ){
+	cell hi = minift_pop( vm, &vm->param_stack );
+	cell lo = minift_pop( vm, &vm->param_stack );
+
+	negate( &lo, &hi );
+	push2( vm, lo, hi );
+
+	return true;
+}
+
+// ( a b -- a/b ), with `a` shifted up by MINIFT_Q_BITS as a double first
+bool minift_builtin_fixed_divide( minift_vm_t *vm ){
+	cell b = minift_pop( vm, &vm->param_stack );
+	cell a = minift_pop( vm, &vm->param_stack );
+	cell hi = (high_of( a ) << MINIFT_Q_BITS) | (a >> (CELL_BITS - MINIFT_Q_BITS));
+	cell quot, rem;
+
+	if ( !sdiv( vm, a << MINIFT_Q_BITS, hi, b, &quot, &rem )){
+		return false;
+	}
+
+	minift_push( vm, &vm->param_stack, quot );
+
+	return true;
+}
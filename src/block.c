@@ -0,0 +1,204 @@
+#include <miniforth/miniforth.h>
+#include <stdint.h>
+
+// Block storage
+//
+// `block` and `buffer` give the address of a MINIFT_BLOCK_SIZE byte
+// buffer for a block, which the stub reads from and writes to wherever it
+// keeps them. Buffers are cached in memory given to minift_blocks_init(),
+// and the least recently used one is reused when a block isn't cached.
+// `update` marks the current buffer as changed, and it's written back when
+// it's reused or by `save-buffers`, which writes runs of consecutive
+// blocks together.
+
+// Carves the headers and as many buffers as will fit out of `mem`, data
+// first so it stays aligned.
+bool minift_blocks_init( minift_vm_t *vm,
+                         minift_blocks_t *blocks,
+                         void *mem,
+                         unsigned long size )
+{
+	unsigned count = size / (MINIFT_BLOCK_SIZE + sizeof(minift_block_buf_t));
+	uint8_t *data = mem;
+
+	if ( count == 0 ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "no room for block buffers" );
+		return false;
+	}
+
+	blocks->bufs    = (void *)(data + count * MINIFT_BLOCK_SIZE);
+	blocks->count   = count;
+	blocks->clock   = 0;
+	blocks->current = NULL;
+
+	for ( unsigned i = 0; i < count; i++ ){
+		minift_block_buf_t *buf = blocks->bufs + i;
+
+		buf->block = 0;
+		buf->used  = 0;
+		buf->data  = data + i * MINIFT_BLOCK_SIZE;
+		buf->valid = false;
+		buf->dirty = false;
+	}
+
+	vm->blocks = blocks;
+
+	return true;
+}
+
+static bool write_back( minift_vm_t *vm, minift_block_buf_t *buf ){
+	void *data = buf->data;
+
+	if ( !minift_block_write( buf->block, &data, 1 )){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "block write failed" );
+		return false;
+	}
+
+	buf->dirty = false;
+
+	return true;
+}
+
+// cached buffer for a block, or the least recently used one to reuse
+static minift_block_buf_t *find_buffer( minift_blocks_t *blocks,
+                                        minift_cell_t block )
+{
+	minift_block_buf_t *oldest = blocks->bufs;
+
+	for ( unsigned i = 0; i < blocks->count; i++ ){
+		minift_block_buf_t *buf = blocks->bufs + i;
+
+		if ( buf->valid && buf->block == block ){
+			return buf;
+		}
+
+		if ( !buf->valid || (oldest->valid && buf->used < oldest->used) ){
+			oldest = buf;
+		}
+	}
+
+	return oldest;
+}
+
+// Returns the buffer for `block`, reading it in if `read` is set. Without
+// it the buffer is assigned to the block as is, for overwriting it all.
+void *minift_block( minift_vm_t *vm, minift_cell_t block, bool read ){
+	minift_blocks_t *blocks = vm->blocks;
+	minift_block_buf_t *buf = blocks->current;
+
+	// the same block again is the usual case
+	if ( !buf || !buf->valid || buf->block != block ){
+		buf = find_buffer( blocks, block );
+	}
+
+	if ( !buf->valid || buf->block != block ){
+		if ( buf->valid && buf->dirty && !write_back( vm, buf )){
+			return NULL;
+		}
+
+		buf->valid = false;
+		buf->block = block;
+
+		if ( read && !minift_block_read( block, buf->data )){
+			minift_error( vm, MINIFT_ERR_RECOVERABLE, "block read failed" );
+			return NULL;
+		}
+
+		buf->valid = true;
+	}
+
+	buf->used = ++blocks->clock;
+	blocks->current = buf;
+
+	return buf->data;
+}
+
+void minift_block_update( minift_vm_t *vm ){
+	minift_block_buf_t *buf = vm->blocks->current;
+
+	if ( buf && buf->valid ){
+		buf->dirty = true;
+	}
+}
+
+enum {
+	MAX_RUN = 16,
+};
+
+static minift_block_buf_t *find_dirty( minift_blocks_t *blocks,
+                                       minift_cell_t block )
+{
+	for ( unsigned i = 0; i < blocks->count; i++ ){
+		minift_block_buf_t *buf = blocks->bufs + i;
+
+		if ( buf->valid && buf->dirty && buf->block == block ){
+			return buf;
+		}
+	}
+
+	return NULL;
+}
+
+// Writes back every changed buffer, lowest block first, handing runs of
+// consecutive blocks to the stub together.
+bool minift_blocks_save( minift_vm_t *vm ){
+	minift_blocks_t *blocks = vm->blocks;
+	minift_block_buf_t *run[MAX_RUN];
+	void *data[MAX_RUN];
+
+	for (;;){
+		minift_block_buf_t *first = NULL;
+
+		for ( unsigned i = 0; i < blocks->count; i++ ){
+			minift_block_buf_t *buf = blocks->bufs + i;
+
+			if ( buf->valid && buf->dirty
+			  && (!first || buf->block < first->block ))
+			{
+				first = buf;
+			}
+		}
+
+		if ( !first ){
+			return true;
+		}
+
+		// extend the run for as long as the next block is dirty too
+		minift_cell_t start = first->block;
+		unsigned count = 0;
+
+		for ( minift_block_buf_t *buf = first; buf && count < MAX_RUN; ){
+			run[count]  = buf;
+			data[count] = buf->data;
+			count++;
+
+			buf = find_dirty( blocks, buf->block + 1 );
+		}
+
+		if ( !minift_block_write( start, data, count )){
+			minift_error( vm, MINIFT_ERR_RECOVERABLE, "block write failed" );
+			return false;
+		}
+
+		for ( unsigned i = 0; i < count; i++ ){
+			run[i]->dirty = false;
+		}
+	}
+}
+
+// Saves and then forgets all of the buffers.
+bool minift_blocks_flush( minift_vm_t *vm ){
+	minift_blocks_t *blocks = vm->blocks;
+
+	if ( !minift_blocks_save( vm )){
+		return false;
+	}
+
+	for ( unsigned i = 0; i < blocks->count; i++ ){
+		blocks->bufs[i].valid = false;
+	}
+
+	blocks->current = NULL;
+
+	return true;
+}
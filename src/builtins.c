@@ -1,21 +1,36 @@
 #include <miniforth/miniforth.h>
+#include <miniforth/code.h>
 #include <miniforth/util.h>
+#include <stddef.h>
+#include "words_hash.h"
+
+// the generated archive tables hold 32 bit hashes at least
+_Static_assert( sizeof(minift_cell_t) >= 4, "cells need to be at least 32 bits" );
 
 bool minift_builtin_compile( minift_vm_t *vm );
 bool minift_builtin_return( minift_vm_t *vm );
 bool minift_builtin_jump( minift_vm_t *vm );
 bool minift_builtin_jump_false( minift_vm_t *vm );
 bool minift_builtin_push_const( minift_vm_t *vm );
-
-bool minift_builtin_add( minift_vm_t *vm );
-bool minift_builtin_subtract( minift_vm_t *vm );
-bool minift_builtin_multiply( minift_vm_t *vm );
-bool minift_builtin_divide( minift_vm_t *vm );
-bool minift_builtin_modulo( minift_vm_t *vm );
-bool minift_builtin_less_than( minift_vm_t *vm );
-bool minift_builtin_greater_than( minift_vm_t *vm );
-bool minift_builtin_equal( minift_vm_t *vm );
-bool minift_builtin_not_equal( minift_vm_t *vm );
+bool minift_builtin_push_short( minift_vm_t *vm );
+bool minift_builtin_push_varint( minift_vm_t *vm );
+bool minift_builtin_call_word( minift_vm_t *vm );
+bool minift_builtin_push_string( minift_vm_t *vm );
+bool minift_builtin_locals( minift_vm_t *vm );
+bool minift_builtin_unlocals( minift_vm_t *vm );
+bool minift_builtin_local_fetch( minift_vm_t *vm );
+bool minift_builtin_local_store( minift_vm_t *vm );
+bool minift_builtin_interrupt_return( minift_vm_t *vm );
+
+minift_cell_t minift_native_add( minift_cell_t a, minift_cell_t b );
+minift_cell_t minift_native_subtract( minift_cell_t a, minift_cell_t b );
+minift_cell_t minift_native_multiply( minift_cell_t a, minift_cell_t b );
+minift_cell_t minift_native_divide( minift_cell_t a, minift_cell_t b );
+minift_cell_t minift_native_modulo( minift_cell_t a, minift_cell_t b );
+minift_cell_t minift_native_less_than( minift_cell_t a, minift_cell_t b );
+minift_cell_t minift_native_greater_than( minift_cell_t a, minift_cell_t b );
+minift_cell_t minift_native_equal( minift_cell_t a, minift_cell_t b );
+minift_cell_t minift_native_not_equal( minift_cell_t a, minift_cell_t b );
 
 bool minift_builtin_char_at( minift_vm_t *vm );
 bool minift_builtin_char_set( minift_vm_t *vm );
@@ -37,6 +52,7 @@ bool minift_builtin_newline( minift_vm_t *vm );
 
 bool minift_builtin_value( minift_vm_t *vm );
 bool minift_builtin_value_set( minift_vm_t *vm );
+bool minift_builtin_value_set_wide( minift_vm_t *vm );
 
 bool minift_builtin_cells( minift_vm_t *vm );
 bool minift_builtin_create( minift_vm_t *vm );
@@ -44,58 +60,64 @@ bool minift_builtin_allot( minift_vm_t *vm );
 bool minift_builtin_fetch( minift_vm_t *vm );
 bool minift_builtin_store( minift_vm_t *vm );
 
+bool minift_builtin_tick( minift_vm_t *vm );
+bool minift_builtin_execute( minift_vm_t *vm );
+bool minift_builtin_spawn( minift_vm_t *vm );
+bool minift_builtin_pause( minift_vm_t *vm );
+bool minift_builtin_task_budget( minift_vm_t *vm );
+bool minift_builtin_interrupt( minift_vm_t *vm );
+bool minift_builtin_on_interrupt( minift_vm_t *vm );
+
 bool minift_builtin_exit( minift_vm_t *vm );
 bool minift_builtin_print_archives( minift_vm_t *vm );
 bool minift_builtin_meminfo( minift_vm_t *vm );
-
-static minift_archive_entry_t minift_builtins[] = {
-	{ ":",      minift_builtin_compile,      0 },
-	{ ";",      minift_builtin_return,       0 },
-	{ "jump",   minift_builtin_jump,         0 },
-	{ "jumpf",  minift_builtin_jump_false,   0 },
-	{ "pushc",  minift_builtin_push_const,   0 },
-
-	{ "+",      minift_builtin_add,          0 },
-	{ "-",      minift_builtin_subtract,     0 },
-	{ "*",      minift_builtin_multiply,     0 },
-	{ "/",      minift_builtin_divide,       0 },
-	{ "mod",    minift_builtin_modulo,       0 },
-	{ "<",      minift_builtin_less_than,    0 },
-	{ ">",      minift_builtin_greater_than, 0 },
-	{ "=",      minift_builtin_equal,        0 },
-	{ "!=",     minift_builtin_not_equal,    0 },
-
-	{ "c@",     minift_builtin_char_at,      0 },
-	{ "c!",     minift_builtin_char_set,     0 },
-	{ "emit",   minift_builtin_display_char, 0 },
-
-	{ "test",   minift_builtin_test,         0 },
-	{ "drop",   minift_builtin_drop,         0 },
-	{ "dup",    minift_builtin_dup,          0 },
-	{ "swap",   minift_builtin_swap,         0 },
-	{ "over",   minift_builtin_over,         0 },
-	{ "tuck",   minift_builtin_tuck,         0 },
-	{ "nip",    minift_builtin_nip,          0 },
-	{ "swap2",  minift_builtin_twoswap,      0 },
-	{ "over2",  minift_builtin_twoover,      0 },
-
-	{ ".",      minift_builtin_display,      0 },
-	{ ".x",     minift_builtin_display_hex,  0 },
-	{ "cr",     minift_builtin_newline,      0 },
-
-	{ "value",  minift_builtin_value,        0 },
-	{ "to",     minift_builtin_value_set,    0 },
-
-	{ "cells",  minift_builtin_cells,        0 },
-	{ "create", minift_builtin_create,       0 },
-	{ "allot",  minift_builtin_allot,        0 },
-	{ "@",      minift_builtin_fetch,        0 },
-	{ "!",      minift_builtin_store,        0 },
-
-	{ "exit",   minift_builtin_exit,         0 },
-	{ "print-archives", minift_builtin_print_archives, 0 },
-	{ "push-meminfo",   minift_builtin_meminfo,        0 },
-};
+bool minift_builtin_meminfo_peak( minift_vm_t *vm );
+bool minift_builtin_marker( minift_vm_t *vm );
+bool minift_builtin_unmark( minift_vm_t *vm );
+bool minift_builtin_forget( minift_vm_t *vm );
+bool minift_builtin_compact( minift_vm_t *vm );
+bool minift_builtin_size( minift_vm_t *vm );
+bool minift_builtin_count( minift_vm_t *vm );
+bool minift_builtin_type( minift_vm_t *vm );
+bool minift_builtin_str_equal( minift_vm_t *vm );
+bool minift_builtin_str_compare( minift_vm_t *vm );
+bool minift_builtin_str_search( minift_vm_t *vm );
+bool minift_builtin_str_hash( minift_vm_t *vm );
+bool minift_builtin_sizes( minift_vm_t *vm );
+bool minift_builtin_pcreate( minift_vm_t *vm );
+bool minift_builtin_pallot( minift_vm_t *vm );
+bool minift_builtin_pfresh( minift_vm_t *vm );
+bool minift_builtin_block( minift_vm_t *vm );
+bool minift_builtin_buffer( minift_vm_t *vm );
+bool minift_builtin_update( minift_vm_t *vm );
+bool minift_builtin_save_buffers( minift_vm_t *vm );
+bool minift_builtin_flush( minift_vm_t *vm );
+bool minift_builtin_include( minift_vm_t *vm );
+bool minift_builtin_require( minift_vm_t *vm );
+bool minift_builtin_source( minift_vm_t *vm );
+bool minift_builtin_input_offset( minift_vm_t *vm );
+bool minift_builtin_set_input_offset( minift_vm_t *vm );
+bool minift_builtin_parse( minift_vm_t *vm );
+bool minift_builtin_parse_name( minift_vm_t *vm );
+bool minift_builtin_skip( minift_vm_t *vm );
+
+minift_cell_t minift_native_signed_less( minift_cell_t a, minift_cell_t b );
+minift_cell_t minift_native_signed_greater( minift_cell_t a, minift_cell_t b );
+minift_cell_t minift_native_sqrt( minift_cell_t x );
+minift_cell_t minift_native_fixed_multiply( minift_cell_t a, minift_cell_t b );
+bool minift_builtin_signed_divide( minift_vm_t *vm );
+bool minift_builtin_signed_modulo( minift_vm_t *vm );
+bool minift_builtin_scale( minift_vm_t *vm );
+bool minift_builtin_scale_mod( minift_vm_t *vm );
+bool minift_builtin_umul( minift_vm_t *vm );
+bool minift_builtin_smul( minift_vm_t *vm );
+bool minift_builtin_umod_divide( minift_vm_t *vm );
+bool minift_builtin_double_add( minift_vm_t *vm );
+bool minift_builtin_double_subtract( minift_vm_t *vm );
+bool minift_builtin_double_negate( minift_vm_t *vm );
+bool minift_builtin_fixed_divide( minift_vm_t *vm );
+
+#include "builtins_arc.h"
 
 void minift_archive_init_base( minift_vm_t *vm ){
 	minift_archive_t *arc = &vm->base_archive;
@@ -104,18 +126,30 @@ void minift_archive_init_base( minift_vm_t *vm ){
 	arc->entries = minift_builtins;
 	arc->size    = sizeof(minift_builtins) / sizeof(minift_archive_entry_t);
 	arc->next    = NULL;
+	arc->phash   = &minift_builtins_phash;
 }
 
 bool minift_builtin_compile( minift_vm_t *vm ){
 	minift_compile( vm );
 
-	return false;
+	return true;
 }
 
 bool minift_builtin_return( minift_vm_t *vm ){
-	unsigned long ret = minift_pop( vm, &vm->call_stack );
+	minift_cell_t ret = minift_pop( vm, &vm->call_stack );
 
-	vm->ip = (unsigned long *)ret;
+	vm->ip = (minift_token_t *)ret;
+
+	// returns and jumps are where interrupts are handled, see
+	// src/interrupt.c
+	if ( vm->interrupts ){
+		if ( vm->ip ){
+			vm->ip++;
+		}
+
+		minift_interrupt_dispatch( vm );
+		return false;
+	}
 
 	return true;
 }
@@ -127,8 +161,11 @@ bool minift_builtin_jump( minift_vm_t *vm ){
 		return false;
 	}
 
-	unsigned long *new_ip = vm->ip + 1;
-	vm->ip = (unsigned long *)*new_ip;
+	vm->ip = minift_code_target( vm->ip );
+
+	if ( vm->interrupts ){
+		minift_interrupt_dispatch( vm );
+	}
 
 	return false;
 }
@@ -140,14 +177,13 @@ bool minift_builtin_jump_false( minift_vm_t *vm ){
 		return false;
 	}
 
-	unsigned long test = minift_pop( vm, &vm->param_stack );
+	minift_cell_t test = minift_pop( vm, &vm->param_stack );
 
 	if ( test == false ){
-		unsigned long *new_ip = vm->ip + 1;
-		vm->ip = (unsigned long *)*new_ip;
+		vm->ip = minift_code_target( vm->ip );
 
 	} else {
-		vm->ip += 2;
+		vm->ip += 1 + MINIFT_SHORT_TOKENS;
 	}
 
 	return false;
@@ -161,97 +197,241 @@ bool minift_builtin_push_const( minift_vm_t *vm ){
 		return false;
 	}
 
-	unsigned long *constant = vm->ip + 1;
+	minift_cell_t *constant = minift_code_cell( vm->ip );
 	minift_push( vm, &vm->param_stack, *constant );
 
-	vm->ip += 2;
+	vm->ip = minift_code_after_cell( vm->ip );
 
 	return false;
 }
 
-bool minift_builtin_add( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
+// pushes a constant stored in the token after it, sign extended
+bool minift_builtin_push_short( minift_vm_t *vm ){
+	if ( !vm->ip ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "pushs call from non-compiled context" );
 
-	minift_push( vm, &vm->param_stack, a + b );
+		return false;
+	}
 
-	return true;
+	int16_t constant = minift_code_short( vm->ip + 1 );
+	minift_push( vm, &vm->param_stack, (minift_cell_t)(intptr_t)constant );
+
+	vm->ip += 1 + MINIFT_SHORT_TOKENS;
+
+	return false;
 }
 
-bool minift_builtin_subtract( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
+bool minift_builtin_push_varint( minift_vm_t *vm ){
+	if ( !vm->ip ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "pushv call from non-compiled context" );
+
+		return false;
+	}
 
-	minift_push( vm, &vm->param_stack, b - a );
+	minift_cell_t constant;
+	vm->ip = minift_varint_read( vm->ip + 1, &constant );
+	minift_push( vm, &vm->param_stack, constant );
 
-	return true;
+	return false;
 }
 
-bool minift_builtin_multiply( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
+// calls the word with the hash in the cell after it, for words that don't
+// fit in the word table
+bool minift_builtin_call_word( minift_vm_t *vm ){
+	if ( !vm->ip ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "callw call from non-compiled context" );
 
-	minift_push( vm, &vm->param_stack, b * a );
+		return false;
+	}
 
-	return true;
+	minift_cell_t word = *minift_code_cell( vm->ip );
+
+	// returns advance the ip by one token, so point it at the last token of
+	// the operand
+	vm->ip = minift_code_after_cell( vm->ip ) - 1;
+
+	return minift_exec_word( vm, word );
 }
 
-bool minift_builtin_divide( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
+bool minift_builtin_push_string( minift_vm_t *vm ){
+	if ( !vm->ip ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "lits call from non-compiled context" );
+
+		return false;
+	}
 
-	minift_push( vm, &vm->param_stack, b / a );
+	minift_cell_t tokens = minift_code_short( vm->ip + 1 );
+	minift_token_t *str = vm->ip + 1 + MINIFT_SHORT_TOKENS;
+	minift_push( vm, &vm->param_stack, (minift_cell_t)str );
 
-	return true;
+	vm->ip = str + tokens;
+
+	return false;
 }
 
-bool minift_builtin_modulo( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
+// Locals declared with `{ a b c -- }` live in a frame on the call stack,
+// above the return address. `locals` moves that many cells from the
+// parameter stack into a new frame, keeping their order, and `unlocals`
+// drops it again before the definition returns. Locals are addressed by
+// their distance from the top of the call stack, which is the top of the
+// frame whenever the definition's own code is running.
+bool minift_builtin_locals( minift_vm_t *vm ){
+	if ( !vm->ip ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "locals call from non-compiled context" );
+		return false;
+	}
 
-	minift_push( vm, &vm->param_stack, b % a );
+	minift_cell_t count = minift_code_short( vm->ip + 1 );
+	minift_cell_t *from = vm->param_stack.ptr - count;
+	minift_cell_t *to   = vm->call_stack.ptr;
 
-	return true;
+	if ( from < vm->param_stack.start ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "reached beginning of stack" );
+		return false;
+	}
+
+	if ( to + count > vm->call_stack.end ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "reached end of stack" );
+		return false;
+	}
+
+	for ( minift_cell_t i = 0; i < count; i++ ){
+		to[i] = from[i];
+	}
+
+	vm->param_stack.ptr = from;
+	vm->call_stack.ptr  = to + count;
+	minift_stack_mark( &vm->call_stack );
+
+	vm->ip += 1 + MINIFT_SHORT_TOKENS;
+
+	return false;
 }
 
-bool minift_builtin_less_than( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
+bool minift_builtin_unlocals( minift_vm_t *vm ){
+	if ( !vm->ip ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "unlocals call from non-compiled context" );
+		return false;
+	}
 
-	minift_push( vm, &vm->param_stack, b < a );
+	ptrdiff_t count = minift_code_short( vm->ip + 1 );
 
-	return true;
+	if ( count > vm->call_stack.ptr - vm->call_stack.start ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "reached beginning of stack" );
+		return false;
+	}
+
+	vm->call_stack.ptr -= count;
+	vm->ip += 1 + MINIFT_SHORT_TOKENS;
+
+	return false;
 }
 
-bool minift_builtin_greater_than( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
+// Locals are addressed by how far below the top of the call stack they
+// are, counting from 1, which has to be within the stack for the code to
+// have been compiled with a matching `locals`.
+static inline minift_cell_t *local_cell( minift_vm_t *vm, char *name ){
+	if ( !vm->ip ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, name );
+		return NULL;
+	}
 
-	minift_push( vm, &vm->param_stack, b > a );
+	ptrdiff_t offset = minift_code_short( vm->ip + 1 );
 
-	return true;
+	if ( offset < 1 || offset > vm->call_stack.ptr - vm->call_stack.start ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "local outside of frame" );
+		return NULL;
+	}
+
+	return vm->call_stack.ptr - offset;
 }
 
-bool minift_builtin_equal( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
+bool minift_builtin_local_fetch( minift_vm_t *vm ){
+	minift_cell_t *local =
+		local_cell( vm, "local@ call from non-compiled context" );
 
-	minift_push( vm, &vm->param_stack, b == a );
+	if ( !local ){
+		return false;
+	}
 
-	return true;
+	minift_push( vm, &vm->param_stack, *local );
+	vm->ip += 1 + MINIFT_SHORT_TOKENS;
+
+	return false;
 }
 
-bool minift_builtin_not_equal( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
+bool minift_builtin_local_store( minift_vm_t *vm ){
+	minift_cell_t *local =
+		local_cell( vm, "local! call from non-compiled context" );
 
-	minift_push( vm, &vm->param_stack, b != a );
+	if ( !local ){
+		return false;
+	}
 
-	return true;
+	*local = minift_pop( vm, &vm->param_stack );
+	vm->ip += 1 + MINIFT_SHORT_TOKENS;
+
+	return false;
+}
+
+// interrupt handlers return into `reti`, which goes back to the code that
+// was interrupted
+bool minift_builtin_interrupt_return( minift_vm_t *vm ){
+	vm->ip = (minift_token_t *)minift_pop( vm, &vm->call_stack );
+	vm->in_interrupt = false;
+
+	// anything raised while the handler ran
+	if ( vm->interrupts ){
+		minift_interrupt_dispatch( vm );
+	}
+
+	return false;
+}
+
+minift_cell_t minift_native_add( minift_cell_t a, minift_cell_t b ){
+	return a + b;
+}
+
+minift_cell_t minift_native_subtract( minift_cell_t a, minift_cell_t b ){
+	return a - b;
+}
+
+minift_cell_t minift_native_multiply( minift_cell_t a, minift_cell_t b ){
+	return a * b;
+}
+
+minift_cell_t minift_native_divide( minift_cell_t a, minift_cell_t b ){
+	return a / b;
+}
+
+minift_cell_t minift_native_modulo( minift_cell_t a, minift_cell_t b ){
+	return a % b;
+}
+
+minift_cell_t minift_native_less_than( minift_cell_t a, minift_cell_t b ){
+	return a < b;
+}
+
+minift_cell_t minift_native_greater_than( minift_cell_t a, minift_cell_t b ){
+	return a > b;
+}
+
+minift_cell_t minift_native_equal( minift_cell_t a, minift_cell_t b ){
+	return a == b;
+}
+
+minift_cell_t minift_native_not_equal( minift_cell_t a, minift_cell_t b ){
+	return a != b;
 }
 
 bool minift_builtin_char_at( minift_vm_t *vm ){
-	unsigned long addr = minift_pop( vm, &vm->param_stack );
+	minift_cell_t addr = minift_pop( vm, &vm->param_stack );
 
 	char c = *(char *)addr;
 
@@ -264,7 +444,7 @@ bool minift_builtin_char_set( minift_vm_t *vm ){
 }
 
 bool minift_builtin_display_char( minift_vm_t *vm ){
-	unsigned long c = minift_pop( vm, &vm->param_stack );
+	minift_cell_t c = minift_pop( vm, &vm->param_stack );
 
 	minift_put_char( c );
 	return true;
@@ -289,8 +469,8 @@ bool minift_builtin_dup( minift_vm_t *vm ){
 }
 
 bool minift_builtin_swap( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
+	minift_cell_t a = minift_pop( vm, &vm->param_stack );
+	minift_cell_t b = minift_pop( vm, &vm->param_stack );
 
 	minift_push( vm, &vm->param_stack, a );
 	minift_push( vm, &vm->param_stack, b );
@@ -299,8 +479,8 @@ bool minift_builtin_swap( minift_vm_t *vm ){
 }
 
 bool minift_builtin_over( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
+	minift_cell_t a = minift_pop( vm, &vm->param_stack );
+	minift_cell_t b = minift_pop( vm, &vm->param_stack );
 
 	minift_push( vm, &vm->param_stack, b );
 	minift_push( vm, &vm->param_stack, a );
@@ -310,8 +490,8 @@ bool minift_builtin_over( minift_vm_t *vm ){
 }
 
 bool minift_builtin_tuck( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
+	minift_cell_t a = minift_pop( vm, &vm->param_stack );
+	minift_cell_t b = minift_pop( vm, &vm->param_stack );
 
 	minift_push( vm, &vm->param_stack, a );
 	minift_push( vm, &vm->param_stack, b );
@@ -321,7 +501,7 @@ bool minift_builtin_tuck( minift_vm_t *vm ){
 }
 
 bool minift_builtin_nip( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
+	minift_cell_t a = minift_pop( vm, &vm->param_stack );
 	minift_pop( vm, &vm->param_stack );
 
 	minift_push( vm, &vm->param_stack, a );
@@ -330,10 +510,10 @@ bool minift_builtin_nip( minift_vm_t *vm ){
 }
 
 bool minift_builtin_twoswap( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
-	unsigned long c = minift_pop( vm, &vm->param_stack );
-	unsigned long d = minift_pop( vm, &vm->param_stack );
+	minift_cell_t a = minift_pop( vm, &vm->param_stack );
+	minift_cell_t b = minift_pop( vm, &vm->param_stack );
+	minift_cell_t c = minift_pop( vm, &vm->param_stack );
+	minift_cell_t d = minift_pop( vm, &vm->param_stack );
 
 	minift_push( vm, &vm->param_stack, b );
 	minift_push( vm, &vm->param_stack, a );
@@ -345,10 +525,10 @@ bool minift_builtin_twoswap( minift_vm_t *vm ){
 }
 
 bool minift_builtin_twoover( minift_vm_t *vm ){
-	unsigned long a = minift_pop( vm, &vm->param_stack );
-	unsigned long b = minift_pop( vm, &vm->param_stack );
-	unsigned long c = minift_pop( vm, &vm->param_stack );
-	unsigned long d = minift_pop( vm, &vm->param_stack );
+	minift_cell_t a = minift_pop( vm, &vm->param_stack );
+	minift_cell_t b = minift_pop( vm, &vm->param_stack );
+	minift_cell_t c = minift_pop( vm, &vm->param_stack );
+	minift_cell_t d = minift_pop( vm, &vm->param_stack );
 
 	minift_push( vm, &vm->param_stack, d );
 	minift_push( vm, &vm->param_stack, c );
@@ -361,7 +541,7 @@ bool minift_builtin_twoover( minift_vm_t *vm ){
 }
 
 bool minift_builtin_display( minift_vm_t *vm ){
-	unsigned long token = minift_peek( vm, &vm->param_stack );
+	minift_cell_t token = minift_peek( vm, &vm->param_stack );
 
 	minift_print_int( token );
 
@@ -369,7 +549,7 @@ bool minift_builtin_display( minift_vm_t *vm ){
 }
 
 bool minift_builtin_display_hex( minift_vm_t *vm ){
-	unsigned long token = minift_peek( vm, &vm->param_stack );
+	minift_cell_t token = minift_peek( vm, &vm->param_stack );
 
 	minift_print_hex( token );
 
@@ -382,9 +562,8 @@ bool minift_builtin_newline( minift_vm_t *vm ){
 	return true;
 }
 
-bool minift_builtin_value( minift_vm_t *vm ){
-	minift_read_ret_t word = minift_read_token( vm );
-	unsigned long value    = minift_pop( vm, &vm->param_stack );
+static bool value_named( minift_vm_t *vm, minift_read_ret_t word ){
+	minift_cell_t value = minift_pop( vm, &vm->param_stack );
 
 	if ( word.type == MINIFT_TYPE_WORD ){
 		minift_define_t *def = minift_make_variable( vm, word.token );
@@ -393,67 +572,105 @@ bool minift_builtin_value( minift_vm_t *vm ){
 			return false;
 		}
 
-		unsigned long *data = minift_define_data( def );
+		minift_cell_t *data = minift_define_data( def );
 		*data = value;
 	}
 
 	return true;
 }
 
-bool minift_builtin_value_set( minift_vm_t *vm ){
-	unsigned long word = 0;
-	unsigned long value = minift_pop( vm, &vm->param_stack );
-	bool inc_ip = true;
+bool minift_builtin_value( minift_vm_t *vm ){
+	return minift_with_token( vm, value_named );
+}
 
-	if ( vm->ip ){
-		word = *(vm->ip + 1);
-		vm->ip += 2;
-		inc_ip = false;
+static bool set_value( minift_vm_t *vm, minift_cell_t word, minift_cell_t value ){
+	minift_define_t *def = minift_define_lookup( vm, word );
 
-	} else {
-		minift_read_ret_t temp = minift_read_token( vm );
-		word = temp.token;
+	if ( def ){
+		def = minift_define_private( vm, def );
 	}
 
-	minift_define_t *def = minift_define_lookup( vm, word );
-
 	if ( !def ){
 		minift_error( vm, MINIFT_ERR_RECOVERABLE,
 		              "value set for undefined word" );
 		return false;
 	}
 
-	unsigned long *data = minift_define_data( def );
+	minift_cell_t *data = minift_define_data( def );
 	*data = value;
 
-	return inc_ip;
+	return true;
+}
+
+static bool value_set_named( minift_vm_t *vm, minift_read_ret_t word ){
+	minift_cell_t value = minift_pop( vm, &vm->param_stack );
+
+	return set_value( vm, word.token, value );
+}
+
+bool minift_builtin_value_set( minift_vm_t *vm ){
+	if ( vm->ip ){
+		minift_cell_t value = minift_pop( vm, &vm->param_stack );
+		minift_cell_t word  = minift_code_word( vm, vm->ip[1] );
+
+		vm->ip += 2;
+		set_value( vm, word, value );
+
+		return false;
+	}
+
+	return minift_with_token( vm, value_set_named );
+}
+
+// `to` with the value's hash in a cell, for words that aren't in the word
+// table, as `callw` is for calls
+bool minift_builtin_value_set_wide( minift_vm_t *vm ){
+	if ( !vm->ip ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "tow call from non-compiled context" );
+
+		return false;
+	}
+
+	minift_cell_t value = minift_pop( vm, &vm->param_stack );
+	minift_cell_t word  = *minift_code_cell( vm->ip );
+
+	vm->ip = minift_code_after_cell( vm->ip );
+	set_value( vm, word, value );
+
+	return false;
 }
 
 bool minift_builtin_cells( minift_vm_t *vm ){
-	unsigned long cells = minift_pop( vm, &vm->param_stack );
-	cells *= sizeof( unsigned long );
+	minift_cell_t cells = minift_pop( vm, &vm->param_stack );
+	cells *= sizeof( minift_cell_t );
 	minift_push( vm, &vm->param_stack, cells );
 
 	return true;
 }
 
-bool minift_builtin_create( minift_vm_t *vm ){
-	unsigned long word = minift_read_token( vm ).token;
-	minift_define_t *def = minift_make_variable( vm, word );
-	unsigned long  *dptr = vm->data_stack.ptr;
+static bool create_named( minift_vm_t *vm, minift_read_ret_t word ){
+	minift_define_t *def = minift_make_variable( vm, word.token );
+	minift_cell_t  *dptr = vm->data_stack.ptr;
 
 	if ( !def ){
 		return false;
 	}
 
-	unsigned long *data = minift_define_data( def );
-	*data = (unsigned long)dptr;
+	// `pusha` marks the constant as an address, so it can be relocated
+	minift_cell_t *data = minift_define_data( def );
+	*minift_code_body( def ) = minift_code_token( vm, HASH_PUSH_ADDR );
+	*data = (minift_cell_t)dptr;
 
 	return true;
 }
 
+bool minift_builtin_create( minift_vm_t *vm ){
+	return minift_with_token( vm, create_named );
+}
+
 bool minift_builtin_allot( minift_vm_t *vm ){
-	unsigned long bytes = minift_pop( vm, &vm->param_stack );
+	minift_cell_t bytes = minift_pop( vm, &vm->param_stack );
 
 	vm->data_stack.ptr += minift_bytes_to_cells( bytes );
 	
@@ -466,8 +683,8 @@ bool minift_builtin_allot( minift_vm_t *vm ){
 }
 
 bool minift_builtin_fetch( minift_vm_t *vm ){
-	unsigned long  temp = minift_pop( vm, &vm->param_stack );
-	unsigned long *addr = (void *)temp;
+	minift_cell_t  temp = minift_pop( vm, &vm->param_stack );
+	minift_cell_t *addr = (void *)temp;
 
 	minift_push( vm, &vm->param_stack, *addr );
 
@@ -475,15 +692,130 @@ bool minift_builtin_fetch( minift_vm_t *vm ){
 }
 
 bool minift_builtin_store( minift_vm_t *vm ){
-	unsigned long  temp = minift_pop( vm, &vm->param_stack );
-	unsigned long value = minift_pop( vm, &vm->param_stack );
-	unsigned long *addr = (void *)temp;
+	minift_cell_t  temp = minift_pop( vm, &vm->param_stack );
+	minift_cell_t value = minift_pop( vm, &vm->param_stack );
+	minift_cell_t *addr = (void *)temp;
 
 	*addr = value;
 
 	return true;
 }
 
+static bool tick_named( minift_vm_t *vm, minift_read_ret_t word ){
+	minift_push( vm, &vm->param_stack, word.token );
+
+	return true;
+}
+
+bool minift_builtin_tick( minift_vm_t *vm ){
+	return minift_with_token( vm, tick_named );
+}
+
+bool minift_builtin_execute( minift_vm_t *vm ){
+	minift_cell_t word = minift_pop( vm, &vm->param_stack );
+
+	return minift_exec_word( vm, word );
+}
+
+// a finished task's space is reused before any more is carved out of the
+// data space
+static bool spawn_reused( minift_vm_t *vm, minift_cell_t word ){
+	minift_task_t *task = vm->free_tasks;
+
+	minift_stack_t calls = {
+		.start = task->call_stack.start,
+		.end   = task->call_stack.end,
+		.ptr   = task->call_stack.start,
+	};
+
+	minift_stack_t params = {
+		.start = task->param_stack.start,
+		.end   = task->param_stack.end,
+		.ptr   = task->param_stack.start,
+	};
+
+	vm->free_tasks = task->next;
+
+	if ( !minift_task_spawn( vm, task, &calls, &params, word )){
+		task->next = vm->free_tasks;
+		vm->free_tasks = task;
+		return false;
+	}
+
+	task->spawned = true;
+
+	return true;
+}
+
+bool minift_builtin_spawn( minift_vm_t *vm ){
+	minift_cell_t word = minift_pop( vm, &vm->param_stack );
+	unsigned task_cells = minift_bytes_to_cells( sizeof(minift_task_t ));
+	minift_cell_t *ptr = vm->data_stack.ptr;
+
+	if ( vm->free_tasks ){
+		return spawn_reused( vm, word );
+	}
+
+	if ( ptr + task_cells + 2 * MINIFT_TASK_STACK >= vm->data_stack.end ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "out of data space" );
+		return false;
+	}
+
+	// carve the task and it's stacks out of the data space
+	minift_task_t *task = (void *)ptr;
+	ptr += task_cells;
+
+	minift_stack_t calls = {
+		.start = ptr,
+		.end   = ptr + MINIFT_TASK_STACK,
+		.ptr   = ptr,
+	};
+
+	ptr += MINIFT_TASK_STACK;
+
+	minift_stack_t params = {
+		.start = ptr,
+		.end   = ptr + MINIFT_TASK_STACK,
+		.ptr   = ptr,
+	};
+
+	ptr += MINIFT_TASK_STACK;
+
+	if ( !minift_task_spawn( vm, task, &calls, &params, word )){
+		return false;
+	}
+
+	task->spawned = true;
+	vm->data_stack.ptr = ptr;
+
+	return true;
+}
+
+bool minift_builtin_pause( minift_vm_t *vm ){
+	minift_pause( vm );
+
+	return true;
+}
+
+bool minift_builtin_task_budget( minift_vm_t *vm ){
+	vm->task_budget = minift_pop( vm, &vm->param_stack );
+
+	return true;
+}
+
+bool minift_builtin_interrupt( minift_vm_t *vm ){
+	minift_interrupt( vm, minift_pop( vm, &vm->param_stack ));
+
+	return true;
+}
+
+bool minift_builtin_on_interrupt( minift_vm_t *vm ){
+	minift_cell_t n    = minift_pop( vm, &vm->param_stack );
+	minift_cell_t word = minift_pop( vm, &vm->param_stack );
+
+	return minift_on_interrupt( vm, n, word );
+}
+
 bool minift_builtin_exit( minift_vm_t *vm ){
 	vm->running = false;
 
@@ -529,9 +861,9 @@ bool minift_builtin_meminfo( minift_vm_t *vm ){
 	uintptr_t call_len  = (uintptr_t)vm->call_stack.end
 	                    - (uintptr_t)vm->call_stack.ptr;
 
-	data_len  /= sizeof( unsigned long );
-	param_len /= sizeof( unsigned long );
-	call_len  /= sizeof( unsigned long );
+	data_len  /= sizeof( minift_cell_t );
+	param_len /= sizeof( minift_cell_t );
+	call_len  /= sizeof( minift_cell_t );
 
 	minift_push( vm, &vm->param_stack, data_len );
 	minift_push( vm, &vm->param_stack, param_len );
@@ -539,3 +871,422 @@ bool minift_builtin_meminfo( minift_vm_t *vm ){
 
 	return true;
 }
+
+// pushes the most cells each stack has had in use
+bool minift_builtin_meminfo_peak( minift_vm_t *vm ){
+	minift_meminfo_t info;
+
+	minift_meminfo( vm, &info );
+
+	minift_push( vm, &vm->param_stack, info.data.peak );
+	minift_push( vm, &vm->param_stack, info.params.peak );
+	minift_push( vm, &vm->param_stack, info.calls.peak );
+
+	return true;
+}
+
+bool minift_builtin_size( minift_vm_t *vm ){
+	minift_cell_t word = minift_pop( vm, &vm->param_stack );
+	minift_define_t *def = minift_define_lookup( vm, word );
+	minift_define_size_t size;
+
+	if ( !def ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "size of undefined word" );
+		return false;
+	}
+
+	minift_define_size( vm, def, &size );
+	minift_push( vm, &vm->param_stack, size.code );
+	minift_push( vm, &vm->param_stack, size.data );
+
+	return true;
+}
+
+// prints the hash, code size and data size of every definition, names
+// aren't kept around so `' foo size` is the way to look up a single word
+bool minift_builtin_sizes( minift_vm_t *vm ){
+	minift_define_t *def = vm->definitions;
+
+	for ( ; def; def = def->previous ){
+		minift_define_size_t size;
+
+		minift_define_size( vm, def, &size );
+
+		minift_print_hex( def->hash );
+		minift_put_char( ' ' );
+		minift_print_int( size.code );
+		minift_put_char( ' ' );
+		minift_print_int( size.data );
+		minift_put_char( '\n' );
+	}
+
+	return true;
+}
+
+// `marker foo` compiles to `unmark <word table size> ;`, so running `foo`
+// forgets foo and everything after it, including any words it added to
+// the word table
+static bool marker_named( minift_vm_t *vm, minift_read_ret_t word ){
+	minift_cell_t words = vm->words.ptr - vm->words.start;
+	minift_define_t *def = minift_make_variable( vm, word.token );
+
+	if ( !def ){
+		return false;
+	}
+
+	*minift_code_body( def ) = minift_code_token( vm, HASH_UNMARK );
+	*minift_define_data( def ) = words;
+
+	return true;
+}
+
+bool minift_builtin_marker( minift_vm_t *vm ){
+	return minift_with_token( vm, marker_named );
+}
+
+bool minift_builtin_unmark( minift_vm_t *vm ){
+	if ( !vm->ip ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "unmark call from non-compiled context" );
+		return false;
+	}
+
+	minift_define_t *def = (void *)((uint8_t *)vm->ip - sizeof(minift_define_t));
+	minift_cell_t words  = *minift_code_cell( vm->ip );
+
+	if ( !minift_forget( vm, def )){
+		return false;
+	}
+
+	vm->words.ptr = vm->words.start + words;
+
+	// return from the marker, it's code is still intact until something
+	// else is allocated
+	return minift_builtin_return( vm );
+}
+
+static bool forget_named( minift_vm_t *vm, minift_read_ret_t word ){
+	minift_define_t *def = minift_define_lookup( vm, word.token );
+
+	if ( !def ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "forget of undefined word" );
+		return false;
+	}
+
+	return minift_forget( vm, def );
+}
+
+bool minift_builtin_forget( minift_vm_t *vm ){
+	return minift_with_token( vm, forget_named );
+}
+
+bool minift_builtin_compact( minift_vm_t *vm ){
+	minift_compact( vm );
+
+	return true;
+}
+
+// ( addr -- addr len ), strings in the pool have their length stored, and
+// others are read up to their nul, but not past the end of the data space
+// or segment they're in
+bool minift_builtin_count( minift_vm_t *vm ){
+	minift_cell_t addr = minift_peek( vm, &vm->param_stack );
+	minift_string_t *ent = minift_strpool_entry( vm, (char *)addr );
+	minift_segment_t *seg = minift_segment_owner( vm, (void *)addr );
+	const char *str = (char *)addr;
+	const char *end = NULL;
+	minift_cell_t len = 0;
+
+	if ( ent ){
+		len = ent->length;
+
+	} else if ( seg ){
+		end = (char *)seg->end;
+
+	} else if ( str >= (char *)vm->data_base && str < (char *)vm->data_stack.end ){
+		end = (char *)vm->data_stack.end;
+
+	} else if ( addr ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "count of a string outside the data space" );
+		return false;
+	}
+
+	while ( end && str + len < end && str[len] ){
+		len++;
+	}
+
+	minift_push( vm, &vm->param_stack, len );
+
+	return true;
+}
+
+// ( addr len -- )
+bool minift_builtin_type( minift_vm_t *vm ){
+	minift_cell_t len  = minift_pop( vm, &vm->param_stack );
+	minift_cell_t addr = minift_pop( vm, &vm->param_stack );
+	const char *str = (void *)addr;
+
+	for ( minift_cell_t i = 0; i < len; i++ ){
+		minift_put_char( str[i] );
+	}
+
+	return true;
+}
+
+static void pop_strings( minift_vm_t *vm,
+                         const char **a, minift_cell_t *alen,
+                         const char **b, minift_cell_t *blen )
+{
+	*blen = minift_pop( vm, &vm->param_stack );
+	*b    = (void *)minift_pop( vm, &vm->param_stack );
+	*alen = minift_pop( vm, &vm->param_stack );
+	*a    = (void *)minift_pop( vm, &vm->param_stack );
+}
+
+// ( a alen b blen -- flag )
+bool minift_builtin_str_equal( minift_vm_t *vm ){
+	const char *a, *b;
+	minift_cell_t alen, blen;
+
+	pop_strings( vm, &a, &alen, &b, &blen );
+
+	bool equal = alen == blen && minift_str_equal( a, b, alen );
+	minift_push( vm, &vm->param_stack, equal );
+
+	return true;
+}
+
+// ( a alen b blen -- n ), n is -1, 0 or 1
+bool minift_builtin_str_compare( minift_vm_t *vm ){
+	const char *a, *b;
+	minift_cell_t alen, blen;
+
+	pop_strings( vm, &a, &alen, &b, &blen );
+
+	int ret = minift_str_compare( a, alen, b, blen );
+	minift_push( vm, &vm->param_stack, (minift_cell_t)(intptr_t)ret );
+
+	return true;
+}
+
+// ( a alen b blen -- addr len flag ), leaves the rest of `a` starting at
+// the first match of `b` if there is one, or all of `a` if not
+bool minift_builtin_str_search( minift_vm_t *vm ){
+	const char *a, *b;
+	minift_cell_t alen, blen;
+
+	pop_strings( vm, &a, &alen, &b, &blen );
+
+	const char *found = minift_str_search( a, alen, b, blen );
+
+	if ( found ){
+		alen -= found - a;
+		a = found;
+	}
+
+	minift_push( vm, &vm->param_stack, (uintptr_t)a );
+	minift_push( vm, &vm->param_stack, alen );
+	minift_push( vm, &vm->param_stack, found != NULL );
+
+	return true;
+}
+
+// ( addr len -- hash ), the same hash words are looked up by, so
+// `"sq" count s-hash execute` runs `sq`
+bool minift_builtin_str_hash( minift_vm_t *vm ){
+	minift_cell_t len  = minift_pop( vm, &vm->param_stack );
+	minift_cell_t addr = minift_pop( vm, &vm->param_stack );
+
+	minift_push( vm, &vm->param_stack, minift_str_hash( (char *)addr, len ));
+
+	return true;
+}
+
+static bool have_persist( minift_vm_t *vm ){
+	if ( !vm->persist ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "no persistent region" );
+		return false;
+	}
+
+	return true;
+}
+
+// `pcreate foo` is `create foo` for the persistent region, finding the
+// entry for foo from an earlier run if there is one. The name is read
+// even without a region, so it isn't run as a word.
+static bool pcreate_named( minift_vm_t *vm, minift_read_ret_t word ){
+	if ( !have_persist( vm )){
+		return false;
+	}
+
+	minift_persist_t *persist = vm->persist;
+	minift_persist_entry_t *ent = minift_persist_lookup( vm, word.token );
+	bool fresh = ent == NULL;
+
+	if ( !ent && !(ent = minift_persist_alloc( vm, word.token ))){
+		return false;
+	}
+
+	minift_define_t *def = minift_make_variable( vm, word.token );
+
+	if ( !def ){
+		return false;
+	}
+
+	// a plain constant, the region isn't moved along with the data space
+	*minift_define_data( def ) = (minift_cell_t)minift_persist_data( ent );
+
+	persist->last     = ent;
+	persist->allotted = 0;
+	persist->fresh    = fresh;
+
+	return true;
+}
+
+bool minift_builtin_pcreate( minift_vm_t *vm ){
+	return minift_with_token( vm, pcreate_named );
+}
+
+bool minift_builtin_pallot( minift_vm_t *vm ){
+	minift_cell_t bytes = minift_pop( vm, &vm->param_stack );
+
+	if ( !have_persist( vm )){
+		return false;
+	}
+
+	return minift_persist_allot( vm, bytes );
+}
+
+// ( -- flag ), true if the last `pcreate` made a new entry that needs
+// filling in
+bool minift_builtin_pfresh( minift_vm_t *vm ){
+	bool fresh = vm->persist && vm->persist->fresh;
+
+	minift_push( vm, &vm->param_stack, fresh );
+
+	return true;
+}
+
+static bool have_blocks( minift_vm_t *vm ){
+	if ( !vm->blocks ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "no block buffers" );
+		return false;
+	}
+
+	return true;
+}
+
+static bool push_block( minift_vm_t *vm, bool read ){
+	minift_cell_t block = minift_pop( vm, &vm->param_stack );
+
+	if ( !have_blocks( vm )){
+		return false;
+	}
+
+	void *data = minift_block( vm, block, read );
+
+	if ( !data ){
+		return false;
+	}
+
+	minift_push( vm, &vm->param_stack, (minift_cell_t)data );
+
+	return true;
+}
+
+// ( n -- addr )
+bool minift_builtin_block( minift_vm_t *vm ){
+	return push_block( vm, true );
+}
+
+// ( n -- addr ), like `block` but without reading the old contents in
+bool minift_builtin_buffer( minift_vm_t *vm ){
+	return push_block( vm, false );
+}
+
+bool minift_builtin_update( minift_vm_t *vm ){
+	if ( !have_blocks( vm )){
+		return false;
+	}
+
+	minift_block_update( vm );
+
+	return true;
+}
+
+bool minift_builtin_save_buffers( minift_vm_t *vm ){
+	return have_blocks( vm ) && minift_blocks_save( vm );
+}
+
+bool minift_builtin_flush( minift_vm_t *vm ){
+	return have_blocks( vm ) && minift_blocks_flush( vm );
+}
+
+bool minift_builtin_include( minift_vm_t *vm ){
+	const char *name = (void *)minift_pop( vm, &vm->param_stack );
+
+	return minift_include( vm, name, false );
+}
+
+bool minift_builtin_require( minift_vm_t *vm ){
+	const char *name = (void *)minift_pop( vm, &vm->param_stack );
+
+	return minift_include( vm, name, true );
+}
+
+static void push_slice( minift_vm_t *vm, const char *addr, unsigned long len ){
+	minift_push( vm, &vm->param_stack, (uintptr_t)addr );
+	minift_push( vm, &vm->param_stack, len );
+}
+
+// ( -- addr len )
+bool minift_builtin_source( minift_vm_t *vm ){
+	unsigned long len;
+	const char *addr = minift_source( vm, &len );
+
+	push_slice( vm, addr, len );
+
+	return true;
+}
+
+// ( -- n )
+bool minift_builtin_input_offset( minift_vm_t *vm ){
+	minift_push( vm, &vm->param_stack, minift_input_offset( vm ));
+
+	return true;
+}
+
+// ( n -- )
+bool minift_builtin_set_input_offset( minift_vm_t *vm ){
+	minift_set_input_offset( vm, minift_pop( vm, &vm->param_stack ));
+
+	return true;
+}
+
+// ( char -- addr len )
+bool minift_builtin_parse( minift_vm_t *vm ){
+	char delim = minift_pop( vm, &vm->param_stack );
+	unsigned long len;
+	const char *addr = minift_parse( vm, delim, &len );
+
+	push_slice( vm, addr, len );
+
+	return true;
+}
+
+// ( -- addr len )
+bool minift_builtin_parse_name( minift_vm_t *vm ){
+	unsigned long len;
+	const char *addr = minift_parse_name( vm, &len );
+
+	push_slice( vm, addr, len );
+
+	return true;
+}
+
+// ( char -- )
+bool minift_builtin_skip( minift_vm_t *vm ){
+	minift_skip( vm, minift_pop( vm, &vm->param_stack ));
+
+	return true;
+}
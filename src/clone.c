@@ -0,0 +1,218 @@
+#include <miniforth/miniforth.h>
+#include <miniforth/code.h>
+#include <stdint.h>
+
+// Cloning vms
+//
+// Copies an initialized vm into new memory, relocating the pointers into
+// the data space that end up in compiled code, the dictionary and the
+// vm itself. This is a lot cheaper than initializing a new vm and running
+// all of the setup code again.
+//
+// Caveats:
+//  - only the main task is copied, cloning a vm with other tasks running
+//    fails
+//  - addresses stored as plain numbers (`here value foo`) or left on the
+//    parameter stack aren't relocated
+//  - archives added after minift_init_vm() are shared with the source vm,
+//    which has to outlive the clone
+//  - so are the string pool and persistent region, if there are any
+//  - the line space isn't, the clone interprets input a word at a time
+//    until it's given it's own with minift_lines_init()
+
+typedef struct reloc {
+	uint8_t  *start;
+	uint8_t  *end;
+	intptr_t  delta;
+} reloc_t;
+
+static inline minift_cell_t relocate( reloc_t *r, minift_cell_t addr ){
+	uint8_t *ptr = (uint8_t *)addr;
+
+	if ( ptr >= r->start && ptr < r->end ){
+		return addr + r->delta;
+	}
+
+	return addr;
+}
+
+static inline void *relocate_ptr( reloc_t *r, void *ptr ){
+	return (void *)relocate( r, (minift_cell_t)ptr );
+}
+
+static inline void copy_cells( minift_cell_t *to,
+                               minift_cell_t *from,
+                               minift_cell_t *end )
+{
+	while ( from < end ){
+		*to++ = *from++;
+	}
+}
+
+static inline bool copy_stack( minift_stack_t *to,
+                               minift_stack_t *from,
+                               minift_stack_t *region )
+{
+	minift_cell_t used = from->ptr - from->start;
+
+	if ( region->start + used > region->end ){
+		return false;
+	}
+
+	copy_cells( region->start, from->start, from->ptr );
+
+	to->start = region->start;
+	to->end   = region->end;
+	to->ptr   = region->start + used;
+
+#if MINIFT_MEMSTATS
+	to->peak  = region->start + (from->peak - from->start);
+#endif
+
+	return true;
+}
+
+static void relocate_definitions( minift_vm_t *vm, reloc_t *r ){
+	minift_define_t *def = vm->definitions;
+	uint8_t *start = (uint8_t *)vm->data_base;
+	uint8_t *end   = (uint8_t *)vm->data_stack.ptr;
+
+	// definitions from a shared segment are outside of the copied range,
+	// and are left alone along with everything before them
+	for ( ; (uint8_t *)def >= start && (uint8_t *)def < end; def = def->previous ){
+		minift_code_iter_t it;
+
+		def->previous = relocate_ptr( r, def->previous );
+		minift_code_begin( &it, vm, def );
+
+		while ( minift_code_next( &it )){
+			minift_cell_t *operand = it.operand;
+
+			// relative branches don't need relocating
+			if ( it.kind == MINIFT_OPERAND_ADDR
+			  || (MINIFT_BRANCH_ABSOLUTE && it.kind == MINIFT_OPERAND_BRANCH ))
+			{
+				*operand = relocate( r, *operand );
+			}
+		}
+	}
+}
+
+minift_vm_t *minift_vm_clone( minift_vm_t *dst,
+                              minift_vm_t *src,
+                              minift_stack_t *calls,
+                              minift_stack_t *data,
+                              minift_stack_t *params )
+{
+	minift_cell_t used = src->data_stack.ptr - src->data_base;
+
+	if ( src->task->next != src->task || src->task != &src->main_task ){
+		minift_error( src, MINIFT_ERR_RECOVERABLE, "can't clone with tasks running" );
+		return NULL;
+	}
+
+	// handlers return through code in the source vm struct
+	if ( src->in_interrupt ){
+		minift_error( src, MINIFT_ERR_RECOVERABLE, "can't clone while handling an interrupt" );
+		return NULL;
+	}
+
+	minift_lines_t *lines = src->lines;
+	uint8_t *ip = (uint8_t *)src->ip;
+
+	if ( lines && (lines->active || lines->has_pending
+	               || (ip >= lines->start && ip < lines->end)))
+	{
+		minift_error( src, MINIFT_ERR_RECOVERABLE, "can't clone while running a line" );
+		return NULL;
+	}
+
+	minift_cell_t words = src->words.ptr - src->words.start;
+	minift_cell_t table = src->words.end - src->words.start;
+
+	if ( data->start + used + table >= data->end ){
+		minift_error( src, MINIFT_ERR_RECOVERABLE, "clone data space too small" );
+		return NULL;
+	}
+
+	*dst = *src;
+
+	if ( !copy_stack( &dst->call_stack, &src->call_stack, calls )
+	  || !copy_stack( &dst->param_stack, &src->param_stack, params ))
+	{
+		minift_error( src, MINIFT_ERR_RECOVERABLE, "clone stacks too small" );
+		return NULL;
+	}
+
+	reloc_t r = {
+		.start = (uint8_t *)src->data_base,
+		.end   = (uint8_t *)src->data_stack.end,
+		.delta = (uint8_t *)data->start - (uint8_t *)src->data_base,
+	};
+
+	copy_cells( data->start, src->data_base, src->data_stack.ptr );
+
+	dst->data_base        = data->start;
+	dst->data_stack.start = relocate_ptr( &r, src->data_stack.start );
+	dst->data_stack.ptr   = relocate_ptr( &r, src->data_stack.ptr );
+	dst->data_stack.end   = data->end - table;
+
+#if MINIFT_MEMSTATS
+	dst->data_stack.peak  = relocate_ptr( &r, src->data_stack.peak );
+#endif
+
+	// the word table for compact code, at the end of the data space
+	dst->words.start = dst->data_stack.end;
+	dst->words.end   = data->end;
+	dst->words.ptr   = dst->words.start + words;
+	copy_cells( dst->words.start, src->words.start, src->words.ptr );
+
+	dst->definitions = relocate_ptr( &r, src->definitions );
+	relocate_definitions( dst, &r );
+
+	for ( minift_cell_t *p = dst->call_stack.start; p < dst->call_stack.ptr; p++ ){
+		*p = relocate( &r, *p );
+	}
+
+	dst->ip    = relocate_ptr( &r, src->ip );
+	dst->lines = NULL;
+
+	// interrupts were raised for the source, handlers carry over
+	dst->interrupts = 0;
+
+	// whatever the hook records is the source's
+	dst->trace = NULL;
+
+	// things that live inside of the vm struct itself
+	dst->task           = &dst->main_task;
+	dst->main_task.next = &dst->main_task;
+	dst->free_tasks     = NULL;
+
+	if ( src->token_task ){
+		dst->token_task = &dst->main_task;
+	}
+
+	if ( src->archives == &src->base_archive ){
+		dst->archives = &dst->base_archive;
+	}
+
+	// partially read input
+	dst->reader.str      = relocate_ptr( &r, src->reader.str );
+	dst->reader.str_ptr  = relocate_ptr( &r, src->reader.str_ptr );
+	dst->reader.str_size = relocate_ptr( &r, src->reader.str_size );
+
+	if ( src->reader.start == &src->reader.in_char ){
+		dst->reader.start = &dst->reader.in_char;
+		dst->reader.ptr   = dst->reader.start + (src->reader.ptr - src->reader.start);
+		dst->reader.end   = dst->reader.start + (src->reader.end - src->reader.start);
+	}
+
+	dst->compiler.code = relocate_ptr( &r, src->compiler.code );
+
+	for ( unsigned i = 0; i < MINIFT_MAX_NESTING; i++ ){
+		dst->compiler.forward[i]  = relocate_ptr( &r, src->compiler.forward[i] );
+		dst->compiler.backward[i] = relocate_ptr( &r, src->compiler.backward[i] );
+	}
+
+	return dst;
+}
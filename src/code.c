@@ -0,0 +1,140 @@
+#include <miniforth/miniforth.h>
+#include <miniforth/code.h>
+#include <stdint.h>
+#include "words_hash.h"
+
+// Walking compiled code
+//
+// Some words are followed by an operand in the word list rather than
+// taking their arguments from the stack. Anything that needs to look
+// through compiled code (relocating it, profiling it) has to know about
+// them, so that knowledge is kept here.
+
+enum {
+	OP_JUMP,
+	OP_JUMP_FALSE,
+	OP_PUSH_CONST,
+	OP_PUSH_SHORT,
+	OP_PUSH_VARINT,
+	OP_CALL_WORD,
+	OP_PUSH_ADDR,
+	OP_PUSH_STRING,
+	OP_SET_VALUE,
+	OP_SET_VALUE_WIDE,
+	OP_UNMARK,
+	OP_RETURN,
+	OP_LOCALS,
+	OP_UNLOCALS,
+	OP_LOCAL_FETCH,
+	OP_LOCAL_STORE,
+	OP_COUNT,
+};
+
+// hashed when the library is built, see src/words.hash
+static const minift_cell_t op_hashes[OP_COUNT] = {
+	[OP_JUMP]           = HASH_JUMP,
+	[OP_JUMP_FALSE]     = HASH_JUMP_FALSE,
+	[OP_PUSH_CONST]     = HASH_PUSH_CONST,
+	[OP_PUSH_SHORT]     = HASH_PUSH_SHORT,
+	[OP_PUSH_VARINT]    = HASH_PUSH_VARINT,
+	[OP_CALL_WORD]      = HASH_CALL_WORD,
+	[OP_PUSH_ADDR]      = HASH_PUSH_ADDR,
+	[OP_PUSH_STRING]    = HASH_PUSH_STRING,
+	[OP_SET_VALUE]      = HASH_TO,
+	[OP_SET_VALUE_WIDE] = HASH_SET_VALUE_WIDE,
+	[OP_UNMARK]         = HASH_UNMARK,
+	[OP_RETURN]         = HASH_RETURN,
+	[OP_LOCALS]         = HASH_LOCALS,
+	[OP_UNLOCALS]       = HASH_UNLOCALS,
+	[OP_LOCAL_FETCH]    = HASH_LOCAL_FETCH,
+	[OP_LOCAL_STORE]    = HASH_LOCAL_STORE,
+};
+
+static const unsigned op_kinds[OP_COUNT] = {
+	[OP_JUMP]           = MINIFT_OPERAND_BRANCH,
+	[OP_JUMP_FALSE]     = MINIFT_OPERAND_BRANCH,
+	[OP_PUSH_CONST]     = MINIFT_OPERAND_CONST,
+	[OP_PUSH_SHORT]     = MINIFT_OPERAND_SHORT,
+	[OP_PUSH_VARINT]    = MINIFT_OPERAND_VARINT,
+	[OP_CALL_WORD]      = MINIFT_OPERAND_CONST,
+	[OP_PUSH_ADDR]      = MINIFT_OPERAND_ADDR,
+	[OP_PUSH_STRING]    = MINIFT_OPERAND_STRING,
+	[OP_SET_VALUE]      = MINIFT_OPERAND_WORD,
+	[OP_SET_VALUE_WIDE] = MINIFT_OPERAND_CONST,
+	[OP_UNMARK]         = MINIFT_OPERAND_CONST,
+	[OP_RETURN]         = MINIFT_OPERAND_END,
+	[OP_LOCALS]         = MINIFT_OPERAND_SHORT,
+	[OP_UNLOCALS]       = MINIFT_OPERAND_SHORT,
+	[OP_LOCAL_FETCH]    = MINIFT_OPERAND_SHORT,
+	[OP_LOCAL_STORE]    = MINIFT_OPERAND_SHORT,
+};
+
+void minift_code_begin( minift_code_iter_t *it,
+                        minift_vm_t *vm,
+                        minift_define_t *def )
+{
+	it->vm   = vm;
+	it->next = minift_code_body( def );
+	it->kind = MINIFT_OPERAND_NONE;
+}
+
+// Advances to the next word in a definition, returns false once the
+// definition's `;` has been passed. `operand` points to a cell for
+// CONST and ADDR operands, and to a token for the others.
+bool minift_code_next( minift_code_iter_t *it ){
+	if ( it->kind == MINIFT_OPERAND_END ){
+		return false;
+	}
+
+	it->ip      = it->next;
+	it->word    = minift_code_word( it->vm, *it->ip );
+	it->kind    = MINIFT_OPERAND_NONE;
+	it->operand = NULL;
+	it->next    = it->ip + 1;
+
+	for ( unsigned i = 0; i < OP_COUNT; i++ ){
+		if ( it->word == op_hashes[i] ){
+			it->kind = op_kinds[i];
+			break;
+		}
+	}
+
+	switch ( it->kind ){
+		case MINIFT_OPERAND_CONST:
+		case MINIFT_OPERAND_ADDR:
+			it->operand = minift_code_cell( it->ip );
+			it->next    = minift_code_after_cell( it->ip );
+			break;
+
+		case MINIFT_OPERAND_SHORT:
+		case MINIFT_OPERAND_BRANCH:
+			it->operand = it->ip + 1;
+			it->next    = it->ip + 1 + MINIFT_SHORT_TOKENS;
+			break;
+
+		case MINIFT_OPERAND_WORD:
+			it->operand = it->ip + 1;
+			it->next    = it->ip + 2;
+			break;
+
+		case MINIFT_OPERAND_VARINT:
+			{
+				minift_cell_t temp;
+
+				it->operand = it->ip + 1;
+				it->next    = minift_varint_read( it->ip + 1, &temp );
+			}
+			break;
+
+		case MINIFT_OPERAND_STRING:
+			it->operand = it->ip + 1;
+			it->next    = it->ip + 1 + MINIFT_SHORT_TOKENS
+			            + minift_code_short( it->ip + 1 );
+			break;
+
+		default:
+			break;
+	}
+
+	return true;
+}
@@ -0,0 +1,57 @@
+#include <miniforth/miniforth.h>
+
+// Default stubs
+//
+// Only minift_get_char() and minift_put_char() are needed to run the
+// interpreter, the rest of include/miniforth/stubs.h is for features a
+// port might not have. These defaults stand in for any it doesn't
+// provide, and are weak so that its own versions replace them.
+
+#if MINIFT_DEFAULT_STUBS
+
+#define MINIFT_WEAK __attribute__((weak))
+
+// a clock that never moves, so deadlines passed to minift_run_for() never
+// pass and only the step budget ends a slice
+MINIFT_WEAK unsigned long minift_clock( void ){
+	return 0;
+}
+
+// no block storage, so `block` fails and buffers from `buffer` can't be
+// saved
+MINIFT_WEAK bool minift_block_read( unsigned long block, void *buf ){
+	return false;
+}
+
+MINIFT_WEAK bool minift_block_write( unsigned long block,
+                                     void *const *bufs,
+                                     unsigned count )
+{
+	return false;
+}
+
+// no source files, so `include` and `require` fail
+MINIFT_WEAK const char *minift_source_read( const char *name,
+                                            unsigned long *len )
+{
+	return NULL;
+}
+
+MINIFT_WEAK void minift_source_done( const char *text, unsigned long len ){ }
+
+// nowhere to cache modules, so they're compiled every time
+MINIFT_WEAK unsigned long minift_cache_read( unsigned long key,
+                                             void *buf,
+                                             unsigned long size )
+{
+	return 0;
+}
+
+MINIFT_WEAK bool minift_cache_write( unsigned long key,
+                                     const void *data,
+                                     unsigned long size )
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,244 @@
+#include <miniforth/miniforth.h>
+#include <miniforth/code.h>
+#include <stdint.h>
+
+// Reclaiming the dictionary
+//
+// minift_forget() drops a definition and everything defined after it, by
+// rolling the dictionary and data space back to where they were before it
+// was made. That's what `forget` and `marker` use, and it only takes a
+// couple of pointer writes.
+//
+// minift_compact() reclaims shadowed definitions instead. Compiled code
+// always calls the newest definition of a word, so once a word has been
+// redefined the old one is dead unless it's still running. The live ones
+// are slid down over the dead ones, fixing up the addresses stored in
+// them as they go.
+//
+// Caveats are the same as for minift_vm_clone(): addresses stored as
+// plain numbers (`buf value p`) or left on the parameter stack aren't
+// updated. Neither works with tasks running other than the main task, and
+// definitions in a shared segment can't be touched.
+
+static inline bool is_private( minift_vm_t *vm, void *ptr ){
+	return ptr >= (void *)vm->data_base && ptr < (void *)vm->data_stack.ptr;
+}
+
+static inline bool tasks_running( minift_vm_t *vm ){
+	return vm->task->next != vm->task || vm->task != &vm->main_task;
+}
+
+bool minift_forget( minift_vm_t *vm, minift_define_t *def ){
+	if ( !is_private( vm, def )){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "can't forget shared definitions" );
+		return false;
+	}
+
+	// tasks are carved out of the data space, and could be in the part
+	// being dropped
+	if ( tasks_running( vm )){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "can't forget with tasks running" );
+		return false;
+	}
+
+	minift_stack_mark( &vm->data_stack );
+
+	vm->definitions      = def->previous;
+	vm->data_stack.ptr   = (minift_cell_t *)def;
+	vm->data_stack.start = (minift_cell_t *)def;
+
+	// so are finished tasks kept for reuse
+	minift_task_t **link = &vm->free_tasks;
+
+	while ( *link ){
+		if ( (void *)*link >= (void *)def ){
+			*link = (*link)->next;
+
+		} else {
+			link = &(*link)->next;
+		}
+	}
+
+	return true;
+}
+
+// Dead definitions are flagged in the low bit of `previous` while
+// compacting, definitions are always cell aligned so it's otherwise unused.
+static inline bool is_dead( minift_define_t *def ){
+	return (uintptr_t)def->previous & 1;
+}
+
+static inline minift_define_t *previous( minift_define_t *def ){
+	return (void *)((uintptr_t)def->previous & ~(uintptr_t)1);
+}
+
+static inline bool in_range( void *ptr, void *start, void *end ){
+	return ptr >= start && ptr < end;
+}
+
+// the end of a definition's space is the start of the next newer one
+static inline void *define_end( minift_vm_t *vm, minift_define_t *def,
+                                minift_define_t *newer )
+{
+	return newer? (void *)newer : (void *)vm->data_stack.ptr;
+}
+
+static bool is_running( minift_vm_t *vm, void *start, void *end ){
+	if ( in_range( vm->ip, start, end )){
+		return true;
+	}
+
+	minift_cell_t *ptr = vm->call_stack.start;
+
+	for ( ; ptr < vm->call_stack.ptr; ptr++ ){
+		if ( in_range( (void *)*ptr, start, end )){
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static inline minift_cell_t move_addr( minift_cell_t addr, void *start,
+                                       void *end, intptr_t delta )
+{
+	if ( in_range( (void *)addr, start, end )){
+		return addr + delta;
+	}
+
+	return addr;
+}
+
+// fixes up anything pointing into a definition that's just been moved
+static void relocate( minift_vm_t *vm, minift_define_t *def,
+                      void *start, void *end, intptr_t delta )
+{
+	minift_code_iter_t it;
+
+	minift_code_begin( &it, vm, def );
+
+	while ( minift_code_next( &it )){
+		minift_cell_t *operand = it.operand;
+
+		if ( it.kind == MINIFT_OPERAND_ADDR
+		  || (MINIFT_BRANCH_ABSOLUTE && it.kind == MINIFT_OPERAND_BRANCH ))
+		{
+			*operand = move_addr( *operand, start, end, delta );
+		}
+	}
+
+	minift_cell_t *ptr = vm->call_stack.start;
+
+	for ( ; ptr < vm->call_stack.ptr; ptr++ ){
+		*ptr = move_addr( *ptr, start, end, delta );
+	}
+
+	vm->ip = (void *)move_addr( (minift_cell_t)vm->ip, start, end, delta );
+	vm->data_stack.start = (void *)move_addr( (minift_cell_t)vm->data_stack.start,
+	                                          start, end, delta );
+}
+
+// Returns the number of bytes reclaimed.
+unsigned long minift_compact( minift_vm_t *vm ){
+	minift_define_t *def = vm->definitions;
+	minift_define_t *newer = NULL;
+	minift_define_t *oldest = NULL;
+
+	if ( vm->compiling || tasks_running( vm )){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "can't compact while compiling or with tasks running" );
+		return 0;
+	}
+
+	// flag the dead definitions, newest first
+	for ( ; def && is_private( vm, def ); def = previous( def )){
+		void *end = define_end( vm, def, newer );
+		bool dead = false;
+
+		for ( minift_define_t *temp = vm->definitions; temp != def; temp = previous( temp )){
+			if ( temp->hash == def->hash && !is_dead( temp )){
+				dead = true;
+				break;
+			}
+		}
+
+		if ( dead && !is_running( vm, def, end )){
+			def->previous = (void *)((uintptr_t)def->previous | 1);
+		}
+
+		newer  = def;
+		oldest = def;
+	}
+
+	if ( !oldest ){
+		return 0;
+	}
+
+	// `def` is now the first definition that isn't being compacted, and
+	// the rest are reversed so they can be moved oldest first
+	minift_define_t *shared = def;
+	minift_define_t *next = NULL;
+
+	for ( def = vm->definitions; def != shared; ){
+		minift_define_t *temp = previous( def );
+		uintptr_t dead = (uintptr_t)def->previous & 1;
+
+		def->previous = (void *)((uintptr_t)next | dead);
+		next = def;
+		def  = temp;
+	}
+
+	uint8_t *cursor = (uint8_t *)oldest;
+	minift_define_t *last = shared;
+
+	minift_stack_mark( &vm->data_stack );
+
+	// finished tasks kept for reuse are moved along with whatever
+	// definition they were carved out after, so they're given up
+	vm->free_tasks = NULL;
+
+	for ( def = oldest; def; def = next ){
+		next = previous( def );
+
+		void *end = define_end( vm, def, next );
+		unsigned long size = (uint8_t *)end - (uint8_t *)def;
+
+		if ( is_dead( def )){
+			continue;
+		}
+
+		intptr_t delta = cursor - (uint8_t *)def;
+		minift_define_t *moved = (void *)cursor;
+
+		if ( delta ){
+			// moving down, so copying from the start is safe
+			uint8_t *from = (uint8_t *)def;
+
+			for ( unsigned long i = 0; i < size; i++ ){
+				cursor[i] = from[i];
+			}
+		}
+
+		moved->previous = last;
+		last = moved;
+
+		if ( delta ){
+			relocate( vm, moved, def, end, delta );
+		}
+
+		cursor += size;
+	}
+
+	unsigned long ret = (uint8_t *)vm->data_stack.ptr - cursor;
+
+	vm->definitions    = last;
+	vm->data_stack.ptr = (minift_cell_t *)cursor;
+
+	if ( vm->data_stack.start > vm->data_stack.ptr ){
+		vm->data_stack.start = vm->data_stack.ptr;
+	}
+
+	return ret;
+}
@@ -0,0 +1,127 @@
+#include <miniforth/miniforth.h>
+#include <stdint.h>
+
+// Parsing input
+//
+// `source`, `>in`, `parse`, `parse-name` and `skip` let code read the
+// input that follows it directly, for words that take arguments the
+// reader can't, like whole strings or names longer than
+// MINIFT_MAX_WORDSIZE:
+//
+//   : say  10 parse type cr ;
+//   say hello, world
+//
+// Nothing is copied, the strings they return point into the buffer given
+// to minift_feed(), so they only last as long as the caller keeps that
+// around. Input is treated as lines, the way the prompt and `include` see
+// it: `source` is the line the reader is in, `>in` is the reader's offset
+// into it, and nothing parses past the end of it. A word that ends a line
+// leaves the reader at the start of the next one, so that case is taken
+// to be the end of the line it ended instead.
+//
+// The words are marked as parsing in the base archive, so compiled lines
+// run them, and definitions that call them, in the place they're read.
+// Input from minift_run() is fed a character at a time, so there's only
+// ever the current character to parse there.
+
+// whether the reader has just passed the newline ending a line
+static inline bool at_line_end( minift_reader_t *rd ){
+	return rd->ptr > rd->start && rd->ptr[-1] == '\n';
+}
+
+// end of the current line, not counting the newline
+static inline const char *line_end( minift_reader_t *rd ){
+	if ( at_line_end( rd )){
+		return rd->ptr - 1;
+	}
+
+	return minift_str_scan( rd->ptr, rd->end - rd->ptr, '\n' );
+}
+
+static inline const char *line_start( minift_reader_t *rd ){
+	const char *ptr = at_line_end( rd )? rd->ptr - 1 : rd->ptr;
+
+	while ( ptr > rd->start && ptr[-1] != '\n' ){
+		ptr--;
+	}
+
+	return ptr;
+}
+
+// Returns the line the reader is in.
+const char *minift_source( minift_vm_t *vm, unsigned long *len ){
+	minift_reader_t *rd = &vm->reader;
+
+	if ( !rd->ptr ){
+		*len = 0;
+		return NULL;
+	}
+
+	const char *start = line_start( rd );
+
+	*len = line_end( rd ) - start;
+
+	return start;
+}
+
+unsigned long minift_input_offset( minift_vm_t *vm ){
+	minift_reader_t *rd = &vm->reader;
+
+	if ( !rd->ptr ){
+		return 0;
+	}
+
+	return (at_line_end( rd )? rd->ptr - 1 : rd->ptr) - line_start( rd );
+}
+
+// Moves the reader to `offset` in the current line, parsing the rest of
+// the line again if it's moved back.
+void minift_set_input_offset( minift_vm_t *vm, unsigned long offset ){
+	minift_reader_t *rd = &vm->reader;
+	unsigned long len;
+	const char *start = minift_source( vm, &len );
+
+	if ( !start || offset > len ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "offset past end of line" );
+		return;
+	}
+
+	rd->ptr = start + offset;
+}
+
+// Returns the input up to the next `delim`, and moves past it. With a
+// space as the delimiter, any space or control character ends it.
+const char *minift_parse( minift_vm_t *vm, char delim, unsigned long *len ){
+	minift_reader_t *rd = &vm->reader;
+	const char *start = rd->ptr;
+
+	if ( !start || at_line_end( rd )){
+		*len = 0;
+		return start;
+	}
+
+	const char *found = minift_str_scan( start, rd->end - start, delim );
+
+	*len = found - start;
+
+	// the newline is left for the reader, so the line still ends
+	rd->ptr = (found < rd->end && *found != '\n')? found + 1 : found;
+
+	return start;
+}
+
+// Skips leading blanks, then returns the input up to the next one.
+const char *minift_parse_name( minift_vm_t *vm, unsigned long *len ){
+	minift_skip( vm, ' ' );
+
+	return minift_parse( vm, ' ', len );
+}
+
+// Moves past any `delim`s at the start of the input.
+void minift_skip( minift_vm_t *vm, char delim ){
+	minift_reader_t *rd = &vm->reader;
+
+	if ( rd->ptr && !at_line_end( rd )){
+		rd->ptr = minift_str_skip( rd->ptr, rd->end - rd->ptr, delim );
+	}
+}
@@ -0,0 +1,99 @@
+#include <miniforth/miniforth.h>
+#include <miniforth/code.h>
+#include <stdatomic.h>
+#include "words_hash.h"
+
+// Interrupts
+//
+// minift_interrupt() raises one of MINIFT_INTERRUPTS interrupts by setting
+// it's bit in `vm->interrupts`, which is all it does, so it can be called
+// from signal handlers and other threads. The vm checks for pending bits
+// at a few safe points, which are `jump`, `;` and waiting for input, and
+// calls the word set for the interrupt with `on-interrupt` there as if it
+// had been called from the code that was running:
+//
+//   : tick  ticks @ 1 + ticks ! ;
+//   ' tick 2 on-interrupt
+//
+// Every loop has a `jump` back to it's start, so code can't run for long
+// without reaching one, and checking is a single test of `vm->interrupts`
+// the rest of the time.
+//
+// The handler runs on the stacks of whatever was interrupted, so it should
+// leave the parameter stack as it found it. Handlers don't nest, other
+// interrupts raised while one runs wait until it returns, and then run in
+// order from the lowest. An interrupt with no handler is dropped.
+
+void minift_interrupts_init( minift_vm_t *vm ){
+	atomic_init( &vm->interrupts, 0 );
+	vm->in_interrupt = false;
+
+	for ( unsigned i = 0; i < MINIFT_INTERRUPTS; i++ ){
+		vm->interrupt_words[i] = 0;
+	}
+
+	// Handlers are called from the first token of this, and so return into
+	// the second, and both hold `reti`. It's kept in the vm rather than
+	// shared, so vms can be started on different threads at once.
+	vm->interrupt_return[0] = minift_code_token( vm, HASH_INTERRUPT_RETURN );
+	vm->interrupt_return[1] = vm->interrupt_return[0];
+}
+
+void minift_interrupt( minift_vm_t *vm, unsigned n ){
+	if ( n < MINIFT_INTERRUPTS ){
+		atomic_fetch_or_explicit( &vm->interrupts, (uint32_t)1 << n,
+		                          memory_order_release );
+	}
+}
+
+// Sets the word run for interrupt `n`, or clears it if `word` is zero.
+bool minift_on_interrupt( minift_vm_t *vm, minift_cell_t n, minift_cell_t word ){
+	if ( n >= MINIFT_INTERRUPTS ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "no such interrupt" );
+		return false;
+	}
+
+	vm->interrupt_words[n] = word;
+
+	return true;
+}
+
+// Starts the handler for the lowest pending interrupt, which returns to
+// `vm->ip` as it is now. Callers leave ip where the interrupted code
+// should carry on from.
+void minift_interrupt_dispatch( minift_vm_t *vm ){
+	if ( vm->in_interrupt ){
+		return;
+	}
+
+	uint32_t pending = atomic_load_explicit( &vm->interrupts,
+	                                         memory_order_acquire );
+
+	for ( unsigned n = 0; pending; n++, pending >>= 1 ){
+		if ( !(pending & 1) ){
+			continue;
+		}
+
+		atomic_fetch_and_explicit( &vm->interrupts, ~((uint32_t)1 << n),
+		                           memory_order_acq_rel );
+
+		minift_cell_t word = vm->interrupt_words[n];
+
+		if ( !word ){
+			continue;
+		}
+
+		minift_push( vm, &vm->call_stack, (minift_cell_t)vm->ip );
+		vm->ip = vm->interrupt_return;
+		vm->in_interrupt = true;
+
+		minift_exec_word( vm, word );
+
+		// words from archives have already run
+		if ( vm->ip == vm->interrupt_return ){
+			vm->ip++;
+		}
+
+		return;
+	}
+}
@@ -0,0 +1,180 @@
+#include <miniforth/miniforth.h>
+#include <miniforth/code.h>
+#include <stdint.h>
+
+// Compiled lines
+//
+// Given memory with minift_lines_init(), complete lines typed at the
+// interpreter are compiled into code in that memory by the same compiler
+// used for definitions, and then run, rather than being interpreted a
+// word at a time. This makes control flow work outside of definitions:
+//
+//   0 while dup 5 < begin dup . 1 + repeat drop
+//
+// Compiling a line costs more than interpreting it once, so only lines
+// with control flow are compiled the first time they're seen. Others are
+// interpreted, and their hash noted, so they're compiled if they come
+// round again.
+//
+// Words that read a name from the input, such as `:` and `value`, are
+// marked with MINIFT_ENTRY_PARSES in their archive. The code before one
+// is run first, then the word itself is run by the interpreter as usual,
+// and compiling carries on after the name it reads. Definitions that
+// call one of those words, such as `parse`, are run the same way.
+//
+// The last few lines compiled in one piece are kept, and looked up by a
+// hash of their text, so entering the same line again runs the same code
+// without compiling it. Any change to the dictionary throws them all out,
+// since it might change what the words in them mean.
+//
+// The space is used from the start up, with cached lines kept in place
+// and a line that isn't cached overwritten by the next one. Once less
+// than half of it is left, the cache is emptied and it starts over.
+
+static inline void wipe( minift_vm_t *vm, minift_lines_t *lines ){
+	for ( unsigned i = 0; i < MINIFT_LINE_CACHE; i++ ){
+		lines->cache[i].code = NULL;
+	}
+
+	lines->next        = 0;
+	lines->ptr         = lines->start;
+	lines->definitions = vm->definitions;
+	lines->words       = vm->words.ptr;
+}
+
+// Cached code is only good for the dictionary it was compiled against.
+// The word table for compact code can only shrink when the dictionary
+// does, but check it anyway since cached code refers to it's entries.
+static inline bool cache_valid( minift_vm_t *vm, minift_lines_t *lines ){
+	return lines->definitions == vm->definitions
+	    && vm->words.ptr >= lines->words;
+}
+
+bool minift_lines_init( minift_vm_t *vm,
+                        minift_lines_t *lines,
+                        void *mem,
+                        unsigned long size )
+{
+	if ( ((uintptr_t)mem & (sizeof(minift_cell_t) - 1))
+	  || size < 64 * sizeof(minift_cell_t) )
+	{
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "line space too small or misaligned" );
+		return false;
+	}
+
+	lines->start       = mem;
+	lines->end         = lines->start + (size & ~(sizeof(minift_cell_t) - 1));
+	lines->active      = false;
+	lines->open        = false;
+	lines->has_pending = false;
+	lines->plain_until = NULL;
+
+	for ( unsigned i = 0; i < (1u << MINIFT_SEEN_BITS); i++ ){
+		lines->seen[i] = 0;
+	}
+
+	wipe( vm, lines );
+	minift_lines_forget_parses( vm, lines );
+
+	vm->lines = lines;
+
+	return true;
+}
+
+// Empties the cache of which words parse, which goes with the dictionary
+// like the line cache does.
+void minift_lines_forget_parses( minift_vm_t *vm, minift_lines_t *lines ){
+	for ( unsigned i = 0; i < (1u << MINIFT_PARSE_BITS); i++ ){
+		lines->parse_words[i] = 0;
+	}
+
+	lines->parse_definitions = vm->definitions;
+}
+
+// Returns the code for `text`, if it's been cached.
+minift_token_t *minift_lines_lookup( minift_vm_t *vm,
+                                     const char *text,
+                                     unsigned long len,
+                                     minift_cell_t hash )
+{
+	minift_lines_t *lines = vm->lines;
+
+	if ( !cache_valid( vm, lines )){
+		wipe( vm, lines );
+		return NULL;
+	}
+
+	for ( unsigned i = 0; i < MINIFT_LINE_CACHE; i++ ){
+		minift_line_t *line = lines->cache + i;
+
+		if ( line->code && line->hash == hash && line->length == len
+		  && minift_str_equal( line->text, text, len ))
+		{
+			return line->code;
+		}
+	}
+
+	return NULL;
+}
+
+// Notes that the line with `hash` has been seen, returning whether it had
+// been already.
+bool minift_lines_seen( minift_vm_t *vm, minift_cell_t hash ){
+	minift_lines_t *lines = vm->lines;
+	unsigned slot = minift_phash_slot( hash, 0x9e3779b9, MINIFT_SEEN_BITS );
+
+	if ( lines->seen[slot] == hash ){
+		return true;
+	}
+
+	lines->seen[slot] = hash;
+
+	return false;
+}
+
+// Returns where the next line should be compiled.
+minift_token_t *minift_lines_space( minift_vm_t *vm ){
+	minift_lines_t *lines = vm->lines;
+
+	if ( !cache_valid( vm, lines )
+	  || lines->end - lines->ptr < (lines->end - lines->start) / 2 )
+	{
+		wipe( vm, lines );
+	}
+
+	return (minift_token_t *)lines->ptr;
+}
+
+// Caches the line compiled from `code` to `end`, if there's room for the
+// text after it. The oldest entry is replaced, but it's space isn't
+// reused until the cache is emptied.
+void minift_lines_add( minift_vm_t *vm,
+                       const char *text,
+                       unsigned long len,
+                       minift_cell_t hash,
+                       minift_token_t *code,
+                       minift_token_t *end )
+{
+	minift_lines_t *lines = vm->lines;
+	char *copy = (char *)end;
+
+	if ( (uint8_t *)(copy + len) > lines->end ){
+		return;
+	}
+
+	for ( unsigned long i = 0; i < len; i++ ){
+		copy[i] = text[i];
+	}
+
+	minift_line_t *line = lines->cache + lines->next;
+
+	line->hash   = hash;
+	line->length = len;
+	line->code   = code;
+	line->text   = copy;
+
+	lines->next  = (lines->next + 1) % MINIFT_LINE_CACHE;
+	lines->ptr   = minift_code_align( copy + len );
+	lines->words = vm->words.ptr;
+}
@@ -0,0 +1,72 @@
+#include <miniforth/miniforth.h>
+#include <miniforth/code.h>
+#include <stdint.h>
+
+// Memory accounting
+//
+// Peak usage of the stacks is tracked as they're pushed to, which can be
+// compiled out with MINIFT_MEMSTATS. Definition sizes aren't stored
+// anywhere, they're worked out from the layout of the data space when
+// asked for, so they cost nothing until then.
+
+static inline void stack_info( minift_stack_info_t *info,
+                               minift_stack_t *stack,
+                               minift_cell_t *base )
+{
+	minift_stack_mark( stack );
+
+	info->used = stack->ptr - base;
+	info->size = stack->end - base;
+
+#if MINIFT_MEMSTATS
+	info->peak = stack->peak - base;
+#else
+	info->peak = info->used;
+#endif
+}
+
+// Fills in usage of the running task's stacks and the vm's data space.
+// Definitions move the start of the data stack, so data usage is counted
+// from the start of the vm's own data space.
+void minift_meminfo( minift_vm_t *vm, minift_meminfo_t *info ){
+	stack_info( &info->data,   &vm->data_stack,  vm->data_base );
+	stack_info( &info->params, &vm->param_stack, vm->param_stack.start );
+	stack_info( &info->calls,  &vm->call_stack,  vm->call_stack.start );
+}
+
+// Definitions are laid out in the data space in the order they're made,
+// so a definition's space runs up to the next one, or to the end of
+// whatever it's part of. The code is everything up to the `;`, and
+// anything after that is data from `allot`.
+void minift_define_size( minift_vm_t *vm,
+                         minift_define_t *def,
+                         minift_define_size_t *size )
+{
+	minift_segment_t *seg = minift_segment_owner( vm, def );
+	void *end = seg? (void *)seg->end : (void *)vm->data_stack.ptr;
+
+	for ( minift_define_t *temp = vm->definitions; temp; temp = temp->previous ){
+		if ( (void *)temp > (void *)def && (void *)temp < end ){
+			end = temp;
+		}
+	}
+
+	// the definition being compiled doesn't have it's `;` yet
+	minift_code_iter_t it;
+	minift_token_t *code_end = minift_code_body( def );
+
+	minift_code_begin( &it, vm, def );
+
+	while ( (void *)it.next < end && minift_code_next( &it )){
+		code_end = it.next;
+	}
+
+	if ( (void *)code_end > end ){
+		code_end = end;
+	}
+
+	uint8_t *data = minift_code_align( code_end );
+
+	size->code = (uint8_t *)code_end - (uint8_t *)minift_code_body( def );
+	size->data = ((uint8_t *)end > data)? (uint8_t *)end - data : 0;
+}
@@ -1,110 +1,118 @@
 #include <miniforth/miniforth.h>
+#include <miniforth/code.h>
 #include <miniforth/util.h>
 #include <stdint.h>
+#include "words_hash.h"
 
 /*
-static inline unsigned long make_hash( char *str ){
+static inline minift_cell_t make_hash( char *str ){
 	return minift_hash( str );
 }
 */
 
-char minift_skip_shitespace( void ){
-	char c = 0;
-	bool in_comment = false;
+unsigned minift_bytes_to_cells( unsigned bytes ){
+	unsigned cell_size = sizeof(minift_cell_t);
+	unsigned mod = (bytes % cell_size);
 
-	c = minift_get_char( );
-	in_comment = c == '(';
+	return (bytes - mod + (!!mod * cell_size)) / cell_size;
+}
 
-	while ( is_whitespace(c) || in_comment ){
-		c = minift_get_char( );
+void minift_feed( minift_vm_t *vm, const char *buf, unsigned long len ){
+	vm->reader.start = buf;
+	vm->reader.ptr   = buf;
+	vm->reader.end   = buf + len;
 
-		if ( c == '(' ){ in_comment = true; }
-		if ( c == ')' ){ in_comment = false; c = minift_get_char(); }
+	if ( vm->lines ){
+		vm->lines->plain_until = NULL;
 	}
-
-	return c;
 }
 
-void minift_read_buffer( char *buf, char first ){
-	unsigned i = 0;
-	char c = first;
+static inline void emit_const( minift_vm_t *vm, minift_cell_t value );
 
-	for ( i = 0;
-	      !is_whitespace(c) && i < MINIFT_MAX_WORDSIZE - 1;
-	      i++, c = minift_get_char( ))
-	{
-		buf[i] = minift_lowercase( c );
+static inline void begin_string( minift_vm_t *vm ){
+	// with a string pool, strings are read into scratch space at the end of
+	// the code or data space, and interned once they're finished
+	if ( vm->strings ){
+		char *scratch = vm->compiling? (char *)vm->compiler.code
+		                             : (char *)vm->data_stack.ptr;
+
+		vm->reader.str_size = NULL;
+		vm->reader.str = vm->reader.str_ptr = scratch;
+		return;
 	}
 
-	buf[i] = '\0';
-}
+	// when compiling, strings are stored inline in the code, after a
+	// `lits` word and the size of the string in tokens, which `lits` uses to
+	// push the string's address and skip over it
+	minift_reader_t *rd = &vm->reader;
 
-unsigned minift_bytes_to_cells( unsigned bytes ){
-	unsigned cell_size = sizeof(unsigned long);
-	unsigned mod = (bytes % cell_size);
+	rd->str_size = NULL;
 
-	return (bytes - mod + (!!mod * cell_size)) / cell_size;
+	if ( vm->compiling ){
+		minift_token_t *code = vm->compiler.code;
+
+		code[0] = minift_code_token( vm, HASH_PUSH_STRING );
+		rd->str_size = code + 1;
+		rd->str = rd->str_ptr = (char *)(code + 1 + MINIFT_SHORT_TOKENS);
+
+	} else {
+		rd->str = rd->str_ptr = (char *)vm->data_stack.ptr;
+	}
 }
 
-minift_read_ret_t minift_read_string( minift_vm_t *vm ){
-	// XXX: when in compilation mode, both the word list and the string
-	//      will be allocated on top of the same stack, which results
-	//      in erroneous compiled word lists, so a 'jump' word is inserted
-	//      before the string which jumps to the word after the newly-allocated
-	//      string to prevent this.
-	//
-	// TODO: think of a better way to handle this
-	unsigned long *forward_jump = NULL;
+static inline minift_read_ret_t end_string( minift_vm_t *vm ){
+	minift_reader_t *rd = &vm->reader;
 	minift_read_ret_t ret;
 
-	if ( vm->compiling ){
-		minift_push( vm, &vm->data_stack, minift_hash( "jump" ));
-		forward_jump = vm->data_stack.ptr;
-		minift_push( vm, &vm->data_stack, 0 );
-	}
+	*rd->str_ptr = '\0';
+
+	unsigned bytes = rd->str_ptr - rd->str + 1;
 
-	char *ptr = (char *)vm->data_stack.ptr;
-	char *str = ptr;
-	char *end = (char *)vm->data_stack.end;
-	unsigned size = 1;
-	char c;
+	if ( vm->strings ){
+		const char *text = minift_intern( vm, rd->str, bytes - 1 );
 
-	// TODO: handle escaped doublequotes in strings
-	while (( c = minift_get_char( )) != '"' ){
-		size++;
-		*ptr++ = c;
+		if ( !text ){
+			minift_error( vm, MINIFT_ERR_RECOVERABLE, "string pool full" );
 
-		if ( ptr >= end ){
-			minift_error( vm, MINIFT_ERR_FATAL, "out of data stack" );
+		} else if ( vm->compiling ){
+			emit_const( vm, (uintptr_t)text );
 		}
+
+		ret.token = (uintptr_t)text;
+		ret.type  = MINIFT_TYPE_ADDR;
+
+		return ret;
 	}
 
-	*ptr = '\0';
+	if ( rd->str_size ){
+		unsigned tokens = minift_bytes_to_tokens( bytes );
 
-	// add size of string to data stack, while keeping it aligned
-	vm->data_stack.ptr += minift_bytes_to_cells( size );
+		if ( tokens > 0xffff ){
+			minift_error( vm, MINIFT_ERR_RECOVERABLE, "string too long" );
+			tokens = 0;
+		}
 
-	if ( vm->compiling ){
-		*forward_jump = (unsigned long)vm->data_stack.ptr;
+		minift_code_set_short( rd->str_size, tokens );
+		vm->compiler.code  = rd->str_size + MINIFT_SHORT_TOKENS + tokens;
+		vm->data_stack.ptr = minift_code_align( vm->compiler.code );
+
+	} else {
+		// add size of string to data stack, while keeping it aligned
+		vm->data_stack.ptr += minift_bytes_to_cells( bytes );
 	}
 
-	ret.token = (uintptr_t)str;
+	ret.token = (uintptr_t)rd->str;
 	ret.type  = MINIFT_TYPE_ADDR;
 
 	return ret;
 }
 
-minift_read_ret_t minift_read_token( minift_vm_t *vm ){
+static inline minift_read_ret_t end_word( minift_vm_t *vm ){
+	minift_reader_t *rd = &vm->reader;
 	minift_read_ret_t ret;
+	char *buf = rd->buf;
 
-	char buf[MINIFT_MAX_WORDSIZE];
-	char c = minift_skip_shitespace( );
-
-	if ( c == '"' ){
-		return minift_read_string( vm );
-	}
-
-	minift_read_buffer( buf, c );
+	buf[rd->len] = '\0';
 
 	if ( is_number( buf[0] )){
 		// convert to number
@@ -120,11 +128,100 @@ minift_read_ret_t minift_read_token( minift_vm_t *vm ){
 	return ret;
 }
 
+// Reads the next token from whatever input has been fed to the vm. Partial
+// tokens are kept in the reader state, so if the input runs out before a
+// token is complete this returns MINIFT_TYPE_NONE, and the token will be
+// finished once more input is fed with minift_feed().
+minift_read_ret_t minift_read_token( minift_vm_t *vm ){
+	minift_reader_t *rd = &vm->reader;
+	minift_read_ret_t ret = { .type = MINIFT_TYPE_NONE, .token = 0 };
+
+	while ( rd->ptr < rd->end ){
+		char c = *rd->ptr++;
+
+		switch ( rd->state ){
+			case MINIFT_READ_SKIP:
+				if ( c == '(' ){
+					rd->state = MINIFT_READ_COMMENT;
+
+				} else if ( c == '"' ){
+					rd->state = MINIFT_READ_STRING;
+					begin_string( vm );
+
+				} else if ( !is_whitespace( c )){
+					rd->state  = MINIFT_READ_WORD;
+					rd->buf[0] = minift_lowercase( c );
+					rd->len    = 1;
+				}
+
+				break;
+
+			case MINIFT_READ_COMMENT:
+				if ( c == ')' ){
+					rd->state = MINIFT_READ_SKIP;
+				}
+
+				break;
+
+			case MINIFT_READ_WORD:
+				if ( is_whitespace( c )){
+					rd->state = MINIFT_READ_SKIP;
+					return end_word( vm );
+				}
+
+				// words longer than the max size are truncated
+				if ( rd->len < MINIFT_MAX_WORDSIZE - 1 ){
+					rd->buf[rd->len++] = minift_lowercase( c );
+				}
+
+				break;
+
+			case MINIFT_READ_STRING:
+				// TODO: handle escaped doublequotes in strings
+				if ( c == '"' ){
+					rd->state = MINIFT_READ_SKIP;
+					return end_string( vm );
+				}
+
+				*rd->str_ptr++ = c;
+
+				if ( rd->str_ptr + 1 >= (char *)vm->data_stack.end ){
+					rd->state = MINIFT_READ_SKIP;
+					minift_error( vm, MINIFT_ERR_FATAL, "out of data stack" );
+					return ret;
+				}
+
+				break;
+
+			default:
+				rd->state = MINIFT_READ_SKIP;
+				break;
+		}
+	}
+
+	return ret;
+}
+
+// Calls `handler` with the next token, or if there isn't one yet, saves it
+// so minift_step() can call it once the token arrives. The return value is
+// used the same way as for archive functions.
+bool minift_with_token( minift_vm_t *vm, minift_token_handler_t handler ){
+	minift_read_ret_t token = minift_read_token( vm );
+
+	if ( token.type == MINIFT_TYPE_NONE ){
+		vm->token_handler = handler;
+		vm->token_task    = vm->task;
+		return false;
+	}
+
+	return handler( vm, token );
+}
+
 minift_vm_t *minift_init_vm( minift_vm_t *vm,
                              minift_stack_t *calls,
                              minift_stack_t *data,
                              minift_stack_t *params,
-                             unsigned long  *ip )
+                             minift_token_t *ip )
 {
 	vm->ip = ip;
 	vm->call_stack  = *calls;
@@ -132,21 +229,73 @@ minift_vm_t *minift_init_vm( minift_vm_t *vm,
 	vm->param_stack = *params;
 	vm->running     = false;
 	vm->compiling   = false;
+	vm->error       = false;
 	vm->definitions = NULL;
 	vm->archives    = NULL;
+	vm->segment     = NULL;
+	vm->data_base   = data->start;
+	vm->strings     = NULL;
+	vm->persist     = NULL;
+	vm->blocks      = NULL;
+	vm->lines       = NULL;
+
+#if MINIFT_MEMSTATS
+	vm->call_stack.peak  = calls->ptr;
+	vm->data_stack.peak  = data->ptr;
+	vm->param_stack.peak = params->ptr;
+#endif
+
+#if MINIFT_CODE_FORMAT != MINIFT_CODE_CELLS
+	// the word table is taken from the end of the data space
+	vm->words.end   = vm->data_stack.end;
+	vm->words.start = vm->words.ptr = vm->words.end - MINIFT_WORD_TABLE_SIZE;
+	vm->data_stack.end = vm->words.start;
+#else
+	vm->words.start = vm->words.ptr = vm->words.end = NULL;
+#endif
+
+	vm->task             = &vm->main_task;
+	vm->main_task.next   = &vm->main_task;
+	vm->free_tasks       = NULL;
+	vm->task_budget      = 0;
+	vm->task_steps       = 0;
+	vm->task_yield       = false;
+
+	vm->reader.start     = NULL;
+	vm->reader.ptr       = NULL;
+	vm->reader.end       = NULL;
+	vm->reader.state     = MINIFT_READ_SKIP;
+	vm->token_handler    = NULL;
+	vm->token_task       = NULL;
+	vm->waiting          = false;
 
 	minift_archive_init_base( vm );
 	minift_archive_add( vm, &vm->base_archive );
 
+#if MINIFT_CODE_FORMAT != MINIFT_CODE_CELLS
+	// builtins always get the same tokens, in archive order
+	for ( unsigned i = 0; i < vm->base_archive.size; i++ ){
+		minift_code_token( vm, vm->base_archive.entries[i].hash );
+	}
+#endif
+
+	minift_interrupts_init( vm );
+	vm->loads = 0;
+	vm->trace = NULL;
+
 	return vm;
 }
 
-bool minift_exec_word( minift_vm_t *vm, unsigned long word ){
+bool minift_exec_word( minift_vm_t *vm, minift_cell_t word ){
 	minift_define_t *def = minift_define_lookup( vm, word );
 
+	if ( def && vm->segment ){
+		def = minift_define_resolve( vm, def );
+	}
+
 	if ( def ){
-		unsigned long *ip = (void *)((uint8_t *)def + sizeof(minift_define_t));
-		minift_push( vm, &vm->call_stack, (unsigned long)vm->ip );
+		minift_token_t *ip = minift_code_body( def );
+		minift_push( vm, &vm->call_stack, (minift_cell_t)vm->ip );
 		vm->ip = ip;
 		return false;
 	}
@@ -154,30 +303,117 @@ bool minift_exec_word( minift_vm_t *vm, unsigned long word ){
 	minift_arc_ent_t *ent = minift_archive_lookup( vm, word );
 
 	if ( ent ){
-		return ent->func( vm );
+		return ent->native? minift_native_exec( vm, ent ) : ent->func( vm );
 	}
 
 	minift_error( vm, MINIFT_ERR_RECOVERABLE, "undefined word" );
 	return false;
 }
 
-void minift_step( minift_vm_t *vm ){
-	if ( vm->ip ){
-		bool ret = minift_exec_word( vm, *vm->ip );
+static inline bool wants_input( minift_vm_t *vm ){
+	if ( vm->token_handler ){
+		return vm->token_task == vm->task;
+	}
+
+	return vm->task == &vm->main_task && (vm->compiling || !vm->ip);
+}
+
+static inline bool step_line( minift_vm_t *vm, minift_read_ret_t *token );
+
+// between one piece of input and the next, so interrupts can run
+static inline bool at_prompt( minift_vm_t *vm ){
+	return !vm->compiling && !vm->token_handler
+	    && vm->reader.state == MINIFT_READ_SKIP
+	    && (!vm->lines || (!vm->lines->active && !vm->lines->has_pending));
+}
+
+static inline void step_input( minift_vm_t *vm ){
+	minift_read_ret_t token;
+
+	if ( vm->interrupts && at_prompt( vm )){
+		minift_interrupt_dispatch( vm );
+		return;
+	}
+
+	if ( vm->lines ){
+		// complete lines are compiled and run, only what can't be compiled
+		// with them is left for the interpreter
+		if ( step_line( vm, &token )){
+			return;
+		}
+
+	} else {
+		token = minift_read_token( vm );
+	}
+
+	if ( token.type == MINIFT_TYPE_NONE ){
+		vm->waiting = true;
+
+	} else if ( vm->token_handler ){
+		minift_token_handler_t handler = vm->token_handler;
+		vm->token_handler = NULL;
+
+		bool ret = handler( vm, token );
 
 		if ( vm->ip ){
 			vm->ip += ret;
 		}
 
+	} else if ( vm->compiling ){
+		minift_compile_token( vm, token );
+
+	} else if ( token.type == MINIFT_TYPE_WORD ){
+		minift_exec_word( vm, token.token );
+
 	} else {
-		minift_read_ret_t token = minift_read_token( vm );
+		minift_push( vm, &vm->param_stack, token.token );
+	}
+}
 
-		if ( token.type == MINIFT_TYPE_WORD ){
-			minift_exec_word( vm, token.token );
+void minift_step( minift_vm_t *vm ){
+	vm->waiting = false;
 
-		} else {
-			minift_push( vm, &vm->param_stack, token.token );
+	if ( wants_input( vm )){
+#if MINIFT_TRACE
+		if ( vm->trace ){
+			vm->trace( vm, 0 );
 		}
+#endif
+
+		step_input( vm );
+
+	} else {
+		minift_cell_t word = minift_code_word( vm, *vm->ip );
+
+#if MINIFT_TRACE
+		if ( vm->trace ){
+			vm->trace( vm, word );
+		}
+#endif
+
+		bool ret = minift_exec_word( vm, word );
+
+		if ( vm->ip ){
+			vm->ip += ret;
+		}
+	}
+}
+
+static inline void schedule( minift_vm_t *vm ){
+	minift_task_t *task = vm->task;
+
+	if ( task->next == task ){
+		return;
+	}
+
+	// a task other than the main one returning to a null ip has finished,
+	// and there's no point in staying on a task that's waiting for input
+	if ( vm->task_yield
+	  || vm->waiting
+	  || (task != &vm->main_task && !vm->ip)
+	  || (vm->task_budget && ++vm->task_steps >= vm->task_budget ))
+	{
+		minift_task_switch( vm );
 	}
 }
 
@@ -186,14 +422,83 @@ void minift_run( minift_vm_t *vm ){
 
 	while ( vm->running ){
 		minift_step( vm );
+
+		// nothing else to run, so block until there's more input
+		if ( vm->waiting && vm->task->next == vm->task ){
+			vm->reader.in_char = minift_get_char( );
+			minift_feed( vm, &vm->reader.in_char, 1 );
+		}
+
+		schedule( vm );
 	}
 }
 
+static inline bool past_deadline( unsigned long deadline ){
+	return (long)(minift_clock( ) - deadline) >= 0;
+}
+
+// Runs at most `max_steps` steps, or until `deadline` as given by
+// minift_clock(), whichever comes first. Either can be zero to ignore it.
+// Returns early with MINIFT_RUN_WAITING if all there is left to do is
+// wait for more input. All state is kept in the vm, so calling this again
+// picks up where the last call left off.
+//
+// With other tasks running, they carry on while the input is waited on,
+// so this only returns MINIFT_RUN_WAITING once the slice is used up. A
+// caller with tasks to keep going needs to give it a limit, and only feed
+// it input that's there rather than blocking for more.
+int minift_run_for( minift_vm_t *vm,
+                    unsigned long max_steps,
+                    unsigned long deadline )
+{
+	bool input_wait = false;
+
+	vm->running = true;
+	vm->error   = false;
+
+	for ( unsigned long i = 0; !max_steps || i < max_steps; i++ ){
+		// checking the clock can be expensive, so only check it every so often
+		if ( deadline && i % MINIFT_CLOCK_STEPS == 0 && past_deadline( deadline )){
+			break;
+		}
+
+		minift_step( vm );
+
+		if ( !vm->running ){
+			return MINIFT_RUN_HALTED;
+		}
+
+		// a task that hit an error is finished, so it's unlinked here
+		// rather than resumed at a null ip by the next call
+		if ( vm->error ){
+			schedule( vm );
+			return MINIFT_RUN_ERROR;
+		}
+
+		if ( vm->waiting ){
+			if ( vm->task->next == vm->task ){
+				return MINIFT_RUN_WAITING;
+			}
+
+			input_wait = true;
+		}
+
+		schedule( vm );
+	}
+
+	// the task reading input is still waiting if nothing's been fed since
+	return input_wait? MINIFT_RUN_WAITING : MINIFT_RUN_YIELDED;
+}
+
 void minift_error( minift_vm_t *vm, bool recoverable, char *msg ){
+	vm->error = true;
+
 	if ( recoverable ){
 		minift_puts( "error: " );
 		vm->ip = 0;
 		vm->param_stack.ptr = vm->param_stack.start;
+		vm->token_handler   = NULL;
+		vm->in_interrupt    = false;
 
 	} else {
 		minift_puts( "fatal error: " );
@@ -205,8 +510,9 @@ void minift_error( minift_vm_t *vm, bool recoverable, char *msg ){
 }
 
 void minift_archive_add( minift_vm_t *vm, minift_archive_t *archive ){
-	// generate hashes for each entry in the archive
-	for ( unsigned i = 0; i < archive->size; i++ ){
+	// generate hashes for each entry in the archive, generated archives
+	// already have them
+	for ( unsigned i = 0; !archive->phash && i < archive->size; i++ ){
 		archive->entries[i].hash = minift_hash( archive->entries[i].name );
 	}
 
@@ -214,10 +520,33 @@ void minift_archive_add( minift_vm_t *vm, minift_archive_t *archive ){
 	vm->archives  = archive;;
 }
 
-minift_arc_ent_t *minift_archive_lookup( minift_vm_t *vm, unsigned long hash ){
+static inline minift_arc_ent_t *phash_lookup( minift_archive_t *arc,
+                                              minift_cell_t hash )
+{
+	const minift_phash_t *ph = arc->phash;
+	unsigned index = ph->slots[minift_phash_slot( hash, ph->mult, ph->bits )];
+
+	if ( index && arc->entries[index - 1].hash == hash ){
+		return arc->entries + index - 1;
+	}
+
+	return NULL;
+}
+
+minift_arc_ent_t *minift_archive_lookup( minift_vm_t *vm, minift_cell_t hash ){
 	minift_archive_t *arc = vm->archives;
 
 	for ( ; arc; arc = arc->next ){
+		if ( arc->phash ){
+			minift_arc_ent_t *ent = phash_lookup( arc, hash );
+
+			if ( ent ){
+				return ent;
+			}
+
+			continue;
+		}
+
 		for ( unsigned i = 0; i < arc->size; i++ ){
 			minift_arc_ent_t *ent = arc->entries + i;
 
@@ -230,8 +559,8 @@ minift_arc_ent_t *minift_archive_lookup( minift_vm_t *vm, unsigned long hash ){
 	return NULL;
 }
 
-unsigned long minift_hash( const char *str ){
-	unsigned long hash = 757;
+minift_cell_t minift_hash( const char *str ){
+	minift_cell_t hash = 757;
 	int c;
 
 	while (( c = *str++ )){
@@ -241,7 +570,7 @@ unsigned long minift_hash( const char *str ){
 	return hash;
 }
 
-unsigned long minift_pop( minift_vm_t *vm, minift_stack_t *stack ){
+minift_cell_t minift_pop( minift_vm_t *vm, minift_stack_t *stack ){
 	if ( stack->ptr > stack->start ){
 		return *(--stack->ptr);
 
@@ -253,16 +582,17 @@ unsigned long minift_pop( minift_vm_t *vm, minift_stack_t *stack ){
 	return 0;
 }
 
-void minift_push( minift_vm_t *vm, minift_stack_t *stack, unsigned long data ){
+void minift_push( minift_vm_t *vm, minift_stack_t *stack, minift_cell_t data ){
 	if ( stack->ptr < stack->end ){
 		*(stack->ptr++) = data;
+		minift_stack_mark( stack );
 
 	} else {
 		minift_error( vm, MINIFT_ERR_RECOVERABLE, "reached end of stack" );
 	}
 }
 
-unsigned long minift_peek( minift_vm_t *vm, minift_stack_t *stack ){
+minift_cell_t minift_peek( minift_vm_t *vm, minift_stack_t *stack ){
 	if ( stack->ptr > stack->start ){
 		return *(stack->ptr - 1);
 
@@ -290,107 +620,874 @@ static inline minift_define_t *alloc_definition( minift_vm_t *vm ){
 	return ret;
 }
 
-static inline bool is_word( minift_read_ret_t tok, char *word ){
+// words the compiler handles itself
+enum {
+	CTL_SEMI,
+	CTL_IF,
+	CTL_THEN,
+	CTL_BEGIN,
+	CTL_ELSE,
+	CTL_END,
+	CTL_WHILE,
+	CTL_REPEAT,
+	CTL_TO,
+	CTL_TICK,
+	CTL_LOCALS,
+	CTL_LOCALS_OUT,
+	CTL_LOCALS_END,
+	CTL_COUNT,
+};
+
+// hashed when the library is built, see src/words.hash, so they aren't
+// hashed for every token compiled, and starting a vm doesn't write to
+// anything vms on other threads share
+static const minift_cell_t control_words[CTL_COUNT] = {
+	[CTL_SEMI]        = HASH_RETURN,
+	[CTL_IF]          = HASH_IF,
+	[CTL_THEN]        = HASH_THEN,
+	[CTL_BEGIN]       = HASH_BEGIN,
+	[CTL_ELSE]        = HASH_ELSE,
+	[CTL_END]         = HASH_END,
+	[CTL_WHILE]       = HASH_WHILE,
+	[CTL_REPEAT]      = HASH_REPEAT,
+	[CTL_TO]          = HASH_TO,
+	[CTL_TICK]        = HASH_TICK,
+	[CTL_LOCALS]      = HASH_LOCALS_BEGIN,
+	[CTL_LOCALS_OUT]  = HASH_LOCALS_OUTPUTS,
+	[CTL_LOCALS_END]  = HASH_LOCALS_END,
+};
+
+static inline bool is_word( minift_read_ret_t tok, unsigned word ){
 	return tok.type  == MINIFT_TYPE_WORD
-	    && tok.token == minift_hash( word );
+	    && tok.token == control_words[word];
 }
 
-void minift_compile( minift_vm_t *vm ){
-	unsigned long jump_word   = minift_hash( "jump" );
-	unsigned long jump_f_word = minift_hash( "jumpf" );
-	unsigned long to_word     = minift_hash( "to" );
+// where the compiler is in a `{ ... }` declaration
+enum {
+	LOCALS_NONE,
+	LOCALS_NAMES,
+	LOCALS_OUTPUTS,
+};
 
-	vm->compiling = true;
+static inline minift_cell_t *find_token( minift_vm_t *vm, minift_cell_t word ){
+	minift_cell_t *ptr = vm->words.start;
 
-	minift_define_t *def = alloc_definition( vm );
-	minift_read_ret_t token;
+	for ( ; ptr < vm->words.ptr; ptr++ ){
+		if ( *ptr == word ){
+			return ptr;
+		}
+	}
 
-	if ( !def ){
+	return NULL;
+}
+
+// keeps the data stack pointer past whatever's been compiled so far, so
+// nothing else allocates over it
+static inline void sync_code( minift_vm_t *vm ){
+	vm->data_stack.ptr = minift_code_align( vm->compiler.code );
+}
+
+static inline minift_token_t *emit( minift_vm_t *vm, minift_token_t token ){
+	minift_token_t *ret = vm->compiler.code;
+
+	if ( (void *)(ret + 1) > (void *)vm->data_stack.end ){
+		minift_error( vm, MINIFT_ERR_FATAL, "out of data space" );
+		return ret;
+	}
+
+	*vm->compiler.code++ = token;
+	sync_code( vm );
+
+	return ret;
+}
+
+static inline void emit_cell( minift_vm_t *vm, minift_cell_t value );
+
+// whether `word` has, or can be given, a token in the word table
+static inline bool has_token( minift_vm_t *vm, minift_cell_t word ){
+#if MINIFT_CODE_FORMAT != MINIFT_CODE_CELLS
+	return vm->words.ptr < vm->words.end || find_token( vm, word );
+#else
+	return true;
+#endif
+}
+
+static inline void emit_word( minift_vm_t *vm, minift_cell_t word ){
+	// once the word table is full, words that aren't in it are called
+	// through `callw` with their hash, builtins are always in it
+	if ( !has_token( vm, word )){
+		emit( vm, minift_code_token( vm, HASH_CALL_WORD ));
+		emit_cell( vm, word );
+		return;
+	}
+
+	emit( vm, minift_code_token( vm, word ));
+}
+
+static inline void emit_cell( minift_vm_t *vm, minift_cell_t value ){
+	minift_cell_t *ptr = minift_code_align( vm->compiler.code );
+
+	if ( ptr + 1 > vm->data_stack.end ){
+		minift_error( vm, MINIFT_ERR_FATAL, "out of data space" );
+		return;
+	}
+
+	*ptr = value;
+	vm->compiler.code = (minift_token_t *)(ptr + 1);
+	sync_code( vm );
+}
+
+static inline minift_token_t *emit_short( minift_vm_t *vm, minift_cell_t value ){
+	minift_token_t *ret = vm->compiler.code;
+
+	for ( unsigned i = 0; i < MINIFT_SHORT_TOKENS; i++ ){
+		emit( vm, 0 );
+	}
+
+	minift_code_set_short( ret, value );
+
+	return ret;
+}
+
+static inline void emit_const( minift_vm_t *vm, minift_cell_t value ){
+#if MINIFT_CODE_FORMAT == MINIFT_CODE_BYTES
+	// the longest encoding is a byte for every 7 bits
+	unsigned max = (sizeof(minift_cell_t) * 8 + 6) / 7;
+
+	if ( vm->compiler.code + 1 + max > (minift_token_t *)vm->data_stack.end ){
 		minift_error( vm, MINIFT_ERR_FATAL, "out of data space" );
 		return;
 	}
 
-	token = minift_read_token( vm );
+	emit_word( vm, HASH_PUSH_VARINT );
+	vm->compiler.code = minift_varint_write( vm->compiler.code, value );
+	sync_code( vm );
+	return;
+
+#elif MINIFT_CODE_FORMAT == MINIFT_CODE_COMPACT
+	// most constants are small, so try to fit them in a single token
+	if ( value <= INT16_MAX || value >= (minift_cell_t)INT16_MIN ){
+		emit_word( vm, HASH_PUSH_SHORT );
+		emit_short( vm, (uint16_t)value );
+		return;
+	}
+#endif
+
+	emit_word( vm, HASH_PUSH_CONST );
+	emit_cell( vm, value );
+}
+
+static inline void patch_branch( minift_vm_t *vm,
+                                 minift_token_t *ref,
+                                 minift_token_t *target )
+{
+	if ( !minift_code_set_target( ref, target )){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "branch out of range" );
+	}
+}
+
+// emits a branch, returning a reference to it's operand for patching
+static inline minift_token_t *emit_branch( minift_vm_t *vm,
+                                           minift_cell_t word,
+                                           minift_token_t *target )
+{
+	emit_word( vm, word );
+	minift_token_t *ref = emit_short( vm, 0 );
+
+	if ( target ){
+		patch_branch( vm, ref, target );
+	}
+
+	return ref;
+}
+
+static inline bool push_ref( minift_vm_t *vm, minift_token_t **refs,
+                             unsigned *count, minift_token_t *ref )
+{
+	if ( *count >= MINIFT_MAX_NESTING ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "control flow nested too deep" );
+		return false;
+	}
+
+	refs[(*count)++] = ref;
+	return true;
+}
+
+static inline minift_token_t *pop_ref( minift_vm_t *vm, minift_token_t **refs,
+                                       unsigned *count )
+{
+	if ( *count == 0 ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "unbalanced control flow" );
+		return NULL;
+	}
+
+	return refs[--(*count)];
+}
+
+// compiles a constant, keeping track of runs of them for folding
+static inline void compile_const( minift_vm_t *vm, minift_cell_t value ){
+	minift_compiler_t *cs = &vm->compiler;
+	minift_token_t *start = cs->code;
+
+	if ( start != cs->fold_end ){
+		cs->fold_count = 0;
+	}
+
+	// only the last few are ever needed
+	if ( cs->fold_count == MINIFT_NATIVE_ARGS ){
+		for ( unsigned i = 1; i < MINIFT_NATIVE_ARGS; i++ ){
+			cs->fold_at[i - 1]     = cs->fold_at[i];
+			cs->fold_values[i - 1] = cs->fold_values[i];
+		}
+
+		cs->fold_count--;
+	}
+
+	emit_const( vm, value );
+
+	cs->fold_at[cs->fold_count]     = start;
+	cs->fold_values[cs->fold_count] = value;
+	cs->fold_count++;
+	cs->fold_end = cs->code;
+}
+
+// Calls to pure natives right after enough constants are run now, and the
+// constants replaced with the result. Folded calls can't see a later
+// definition with the same name the way other calls do, so pure words
+// can't be redefined, see pure_word().
+static inline bool fold_call( minift_vm_t *vm, minift_cell_t word ){
+	minift_compiler_t *cs = &vm->compiler;
+
+	if ( cs->code != cs->fold_end || minift_define_lookup( vm, word )){
+		return false;
+	}
+
+	minift_arc_ent_t *ent = minift_archive_lookup( vm, word );
+
+	if ( !ent || !ent->native || !(ent->flags & MINIFT_NATIVE_PURE)
+	  || ent->args > cs->fold_count )
+	{
+		return false;
+	}
+
+	unsigned first = cs->fold_count - ent->args;
+	minift_cell_t result;
+
+	if ( !minift_native_call( vm, ent, cs->fold_values + first, &result )){
+		return false;
+	}
+
+	// drop the arguments from the code
+	if ( ent->args ){
+		cs->code = cs->fold_at[first];
+		cs->fold_count = first;
+		cs->fold_end = cs->code;
+		sync_code( vm );
+	}
+
+	if ( ent->results ){
+		compile_const( vm, result );
+	}
+
+	return true;
+}
+
+// returns true and raises an error if `word` names a pure native, which
+// calls might already have been folded into
+static bool pure_word( minift_vm_t *vm, minift_cell_t word ){
+	minift_arc_ent_t *ent = minift_archive_lookup( vm, word );
+
+	if ( ent && ent->native && (ent->flags & MINIFT_NATIVE_PURE) ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "can't redefine a pure word" );
+		return true;
+	}
+
+	return false;
+}
+
+static bool compile_name( minift_vm_t *vm, minift_read_ret_t token ){
+	minift_compiler_t *cs = &vm->compiler;
+
+	if ( pure_word( vm, token.token )){
+		return false;
+	}
+
+	minift_define_t *def = alloc_definition( vm );
+
+	if ( !def ){
+		minift_error( vm, MINIFT_ERR_FATAL, "out of data space" );
+		return false;
+	}
 
 	def->hash       = token.token;
 	def->previous   = vm->definitions;
 	vm->definitions = def;
 
-	token = minift_read_token( vm );
+	cs->code           = minift_code_body( def );
+	cs->forward_count  = 0;
+	cs->backward_count = 0;
+	cs->fold_count     = 0;
+	cs->fold_end       = NULL;
+	cs->local_count    = 0;
+	cs->local_state    = LOCALS_NONE;
+	vm->compiling      = true;
 
-	unsigned long *forward[8];
-	unsigned long *backward[8];
-	unsigned forward_count  = 0;
-	unsigned backward_count = 0;
+	return true;
+}
 
-	while ( !is_word( token, ";" ) && vm->running ){
-		if ( token.type == MINIFT_TYPE_WORD ){
-			if ( is_word( token, "if" )){
-				// `if` is just ignored
+// returns the distance of a local from the top of it's frame, or 0 if
+// `word` isn't one, later declarations shadowing earlier ones
+static inline unsigned local_offset( minift_compiler_t *cs, minift_cell_t word ){
+	for ( unsigned i = cs->local_count; i > 0; i-- ){
+		if ( cs->locals[i - 1] == word ){
+			return cs->local_count - (i - 1);
+		}
+	}
 
-			} else if ( is_word( token, "then" )){
-				minift_push( vm, &vm->data_stack, jump_f_word );
-				forward[forward_count++] = vm->data_stack.ptr;
-				minift_push( vm, &vm->data_stack, 0 );
+	return 0;
+}
 
-			} else if ( is_word( token, "else" )){
-				unsigned long *ref = forward[--forward_count];
+static inline void emit_local( minift_vm_t *vm, minift_cell_t word, unsigned operand ){
+	emit_word( vm, word );
+	emit_short( vm, operand );
+}
 
-				minift_push( vm, &vm->data_stack, jump_word );
-				forward[forward_count++] = vm->data_stack.ptr;
-				minift_push( vm, &vm->data_stack, 0 );
+// `to` sets a local if there's one by that name
+static bool compile_set( minift_vm_t *vm, minift_read_ret_t token ){
+	unsigned offset = local_offset( &vm->compiler, token.token );
 
-				*ref = (unsigned long)vm->data_stack.ptr;
+	if ( offset ){
+		emit_local( vm, HASH_LOCAL_STORE, offset );
+		return true;
+	}
 
-			} else if ( is_word( token, "end" )){
-				unsigned long *ref = forward[--forward_count];
-				*ref = (unsigned long)vm->data_stack.ptr;
+	// and uses `tow` with the hash in a cell for words that don't fit in
+	// the word table, like `callw`
+	if ( !has_token( vm, token.token )){
+		emit_word( vm, HASH_SET_VALUE_WIDE );
+		emit_cell( vm, token.token );
+		return true;
+	}
 
-			} else if ( is_word( token, "while" )){
-				backward[backward_count++] = vm->data_stack.ptr;
+	emit_word( vm, control_words[CTL_TO] );
+	emit( vm, minift_code_token( vm, token.token ));
 
-			} else if ( is_word( token, "begin" )){
-				minift_push( vm, &vm->data_stack, jump_f_word );
-				forward[forward_count++] = vm->data_stack.ptr;
-				minift_push( vm, &vm->data_stack, 0 );
+	return true;
+}
 
-			} else if ( is_word( token, "repeat" )){
-				unsigned long *back_ref = backward[--backward_count];
-				unsigned long *for_ref  = forward[--forward_count];
+// Reads a `{ a b c -- outputs }` declaration. Names after `--` are just
+// comments, as in a stack comment. The frame is made where the
+// declaration ends, so that has to be outside of any control flow.
+static inline void declare_local( minift_vm_t *vm, minift_read_ret_t token ){
+	minift_compiler_t *cs = &vm->compiler;
 
-				minift_push( vm, &vm->data_stack, jump_word );
-				minift_push( vm, &vm->data_stack, (unsigned long)back_ref );
+	if ( token.type != MINIFT_TYPE_WORD ){
+		cs->local_state = LOCALS_NONE;
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "bad local name" );
 
-				*for_ref = (unsigned long)vm->data_stack.ptr;
+	} else if ( is_word( token, CTL_LOCALS_END )){
+		cs->local_state = LOCALS_NONE;
+		emit_local( vm, HASH_LOCALS, cs->local_count );
 
-			} else if ( is_word( token, "to" )){
-				token = minift_read_token( vm );
+	} else if ( is_word( token, CTL_LOCALS_OUT )){
+		cs->local_state = LOCALS_OUTPUTS;
 
-				minift_push( vm, &vm->data_stack, to_word );
-				minift_push( vm, &vm->data_stack, token.token );
+	} else if ( cs->local_state == LOCALS_OUTPUTS ){
+		// ignored
 
-			} else {
-				minift_push( vm, &vm->data_stack, token.token );
-			}
+	} else if ( cs->local_count >= MINIFT_MAX_LOCALS ){
+		cs->local_state = LOCALS_NONE;
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "too many locals" );
+
+	} else {
+		cs->locals[cs->local_count++] = token.token;
+	}
+}
+
+// `;`, dropping the frame for any locals first
+static inline void emit_return( minift_vm_t *vm ){
+	if ( vm->compiler.local_count ){
+		emit_local( vm, HASH_UNLOCALS, vm->compiler.local_count );
+	}
+
+	emit_word( vm, control_words[CTL_SEMI] );
+}
+
+static bool compile_tick( minift_vm_t *vm, minift_read_ret_t token ){
+	emit_const( vm, token.token );
+
+	return true;
+}
+
+// Starts compiling a new definition, named by the next token. The body is
+// compiled a token at a time by minift_compile_token() as input arrives,
+// with all of the compiler state kept in the vm, until `;` is reached.
+void minift_compile( minift_vm_t *vm ){
+	minift_with_token( vm, compile_name );
+}
+
+void minift_compile_token( minift_vm_t *vm, minift_read_ret_t token ){
+	minift_compiler_t *cs = &vm->compiler;
+	minift_token_t **forward  = cs->forward;
+	minift_token_t **backward = cs->backward;
+
+	if ( cs->local_state ){
+		declare_local( vm, token );
+
+	} else if ( token.type == MINIFT_TYPE_ADDR ){
+		// strings are already compiled inline by the reader
+
+	} else if ( token.type != MINIFT_TYPE_WORD ){
+		compile_const( vm, token.token );
+
+	} else if ( is_word( token, CTL_SEMI )){
+		emit_return( vm );
+		vm->compiling = false;
+
+	} else if ( is_word( token, CTL_LOCALS )){
+		if ( cs->local_count ){
+			minift_error( vm, MINIFT_ERR_RECOVERABLE, "locals already declared" );
+
+		} else if ( cs->forward_count || cs->backward_count ){
+			minift_error( vm, MINIFT_ERR_RECOVERABLE,
+			              "locals declared inside control flow" );
 
 		} else {
-			minift_push( vm, &vm->data_stack, minift_hash( "pushc" ));
-			minift_push( vm, &vm->data_stack, token.token );
+			cs->local_state = LOCALS_NAMES;
 		}
 
-		token = minift_read_token( vm );
+	} else if ( is_word( token, CTL_IF )){
+		// `if` is just ignored
+
+	} else if ( is_word( token, CTL_THEN ) || is_word( token, CTL_BEGIN )){
+		minift_token_t *ref = emit_branch( vm, HASH_JUMP_FALSE, NULL );
+		push_ref( vm, forward, &cs->forward_count, ref );
+
+	} else if ( is_word( token, CTL_ELSE )){
+		minift_token_t *ref = pop_ref( vm, forward, &cs->forward_count );
+
+		if ( !ref ){
+			return;
+		}
+
+		minift_token_t *else_ref = emit_branch( vm, HASH_JUMP, NULL );
+		push_ref( vm, forward, &cs->forward_count, else_ref );
+		patch_branch( vm, ref, cs->code );
+		cs->fold_count = 0;
+
+	} else if ( is_word( token, CTL_END )){
+		minift_token_t *ref = pop_ref( vm, forward, &cs->forward_count );
+
+		if ( ref ){
+			patch_branch( vm, ref, cs->code );
+		}
+
+		// constants before a branch target can't be folded with ones after
+		cs->fold_count = 0;
+
+	} else if ( is_word( token, CTL_WHILE )){
+		push_ref( vm, backward, &cs->backward_count, cs->code );
+		cs->fold_count = 0;
+
+	} else if ( is_word( token, CTL_REPEAT )){
+		minift_token_t *back_ref = pop_ref( vm, backward, &cs->backward_count );
+		minift_token_t *for_ref  = pop_ref( vm, forward, &cs->forward_count );
+
+		if ( !back_ref || !for_ref ){
+			return;
+		}
+
+		emit_branch( vm, HASH_JUMP, back_ref );
+		patch_branch( vm, for_ref, cs->code );
+
+	} else if ( is_word( token, CTL_TO )){
+		minift_with_token( vm, compile_set );
+
+	} else if ( is_word( token, CTL_TICK )){
+		minift_with_token( vm, compile_tick );
+
+	} else if ( local_offset( cs, token.token )){
+		emit_local( vm, HASH_LOCAL_FETCH, local_offset( cs, token.token ));
+
+	} else if ( !fold_call( vm, token.token )){
+		emit_word( vm, token.token );
+	}
+}
+
+// Compiled lines, see src/lines.c
+
+// whether the reader will be between tokens at `end`, so that the text up
+// to there can be compiled by itself
+static inline bool line_complete( const char *text, const char *end ){
+	unsigned state = MINIFT_READ_SKIP;
+
+	for ( ; text < end; text++ ){
+		char c = *text;
+
+		if ( state == MINIFT_READ_SKIP ){
+			state = (c == '(')?         MINIFT_READ_COMMENT
+			      : (c == '"')?         MINIFT_READ_STRING
+			      : !is_whitespace( c )? MINIFT_READ_WORD
+			      :                     MINIFT_READ_SKIP;
+
+		} else if ( (state == MINIFT_READ_COMMENT && c == ')')
+		         || (state == MINIFT_READ_STRING && c == '"')
+		         || (state == MINIFT_READ_WORD && is_whitespace( c )))
+		{
+			state = MINIFT_READ_SKIP;
+		}
+	}
+
+	return state == MINIFT_READ_SKIP;
+}
+
+// Words that only do anything compiled, so a line using them is compiled
+// the first time it's seen. They're matched by name rather than hashed,
+// since every word of every new line is checked.
+static const struct {
+	const char   *name;
+	unsigned long len;
+} flow_words[] = {
+	{ "if", 2 }, { "then", 4 }, { "else", 4 }, { "end", 3 },
+	{ "begin", 5 }, { "while", 5 }, { "repeat", 6 }, { "{", 1 },
+};
+
+static inline bool is_flow_word( const char *word, unsigned long len ){
+	for ( unsigned i = 0; i < sizeof(flow_words) / sizeof(flow_words[0]); i++ ){
+		if ( flow_words[i].len == len && flow_words[i].name[0] == *word
+		  && minift_str_equal( flow_words[i].name, word, len ))
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// whether any word in the line is a flow word, which the words inside
+// strings and comments are taken to be as well
+static inline bool line_has_flow( const char *text, const char *end ){
+	while ( text < end ){
+		while ( text < end && is_whitespace( *text )){
+			text++;
+		}
+
+		const char *word = text;
+
+		while ( text < end && !is_whitespace( *text )){
+			text++;
+		}
+
+		if ( text > word && is_flow_word( word, text - word )){
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Definitions parse if they call a word that does, which is looked for
+// a few calls deep and through a limited number of definitions, past
+// which they're taken not to.
+static bool word_parses( minift_vm_t *vm, minift_cell_t word,
+                         unsigned depth, unsigned *budget )
+{
+	minift_define_t *def = minift_define_lookup( vm, word );
+
+	if ( def ){
+		if ( !depth || !*budget ){
+			return false;
+		}
+
+		minift_code_iter_t it;
+
+		minift_code_begin( &it, vm, def );
+		(*budget)--;
+
+		while ( minift_code_next( &it )){
+			if ( it.kind == MINIFT_OPERAND_NONE
+			  && word_parses( vm, it.word, depth - 1, budget ))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	minift_arc_ent_t *ent = minift_archive_lookup( vm, word );
+
+	return ent && (ent->flags & MINIFT_ENTRY_PARSES);
+}
+
+// Checked for every word in a line, so the answers are kept until the
+// dictionary changes, rather than looking through definitions each time.
+static inline bool line_parses( minift_vm_t *vm, minift_cell_t word ){
+	minift_lines_t *lines = vm->lines;
+	unsigned slot = minift_phash_slot( word, 0x9e3779b9, MINIFT_PARSE_BITS );
+	unsigned budget = 16;
+
+	if ( lines->parse_definitions != vm->definitions ){
+		minift_lines_forget_parses( vm, lines );
+	}
+
+	if ( lines->parse_words[slot] != word ){
+		lines->parse_words[slot]   = word;
+		lines->parse_results[slot] = word_parses( vm, word, 3, &budget );
+	}
+
+	return lines->parse_results[slot];
+}
+
+static inline void run_line( minift_vm_t *vm, minift_token_t *code ){
+	minift_push( vm, &vm->call_stack, (minift_cell_t)vm->ip );
+	vm->ip = code;
+}
+
+// the compiler only knows about the data space, so the line space is
+// swapped in for it while compiling a line
+static inline void swap_line_space( minift_vm_t *vm ){
+	minift_lines_t *lines = vm->lines;
+	minift_cell_t *ptr = vm->data_stack.ptr;
+	minift_cell_t *end = vm->data_stack.end;
+
+	vm->data_stack.ptr = lines->swap_ptr;
+	vm->data_stack.end = lines->swap_end;
+	lines->swap_ptr    = ptr;
+	lines->swap_end    = end;
+}
+
+// Finds the end of the line at the reader, and either runs the cached
+// code for it, limits the reader to it so it can be compiled, or leaves
+// it to the interpreter the first time it's seen without control flow.
+static inline bool start_line( minift_vm_t *vm ){
+	minift_lines_t *lines = vm->lines;
+	minift_reader_t *rd = &vm->reader;
+	const char *nl = rd->ptr;
+	bool quoted = false;
+
+	if ( rd->ptr < lines->plain_until ){
+		return false;
+	}
+
+	while ( nl < rd->end && *nl != '\n' ){
+		quoted |= *nl == '(' || *nl == '"';
+		nl++;
+	}
+
+	// partial lines, and strings or comments that carry on past the end
+	// of the line, are left to the interpreter
+	if ( nl == rd->end || (quoted && !line_complete( rd->ptr, nl + 1 ))){
+		lines->plain_until = (nl == rd->end)? nl : nl + 1;
+		return false;
+	}
+
+	unsigned long len  = nl - rd->ptr;
+	minift_cell_t hash = minift_str_hash( rd->ptr, len );
+	minift_token_t *code = minift_lines_lookup( vm, rd->ptr, len, hash );
+
+	if ( code ){
+		rd->ptr = nl + 1;
+		run_line( vm, code );
+		return true;
+	}
+
+	if ( !minift_lines_seen( vm, hash ) && !line_has_flow( rd->ptr, nl )){
+		lines->plain_until = nl + 1;
+		return false;
+	}
+
+	lines->text      = rd->ptr;
+	lines->length    = len;
+	lines->hash      = hash;
+	lines->input_end = rd->end;
+	lines->active    = true;
+	lines->open      = false;
+	lines->cacheable = true;
+	rd->end = nl + 1;
+
+	return true;
+}
+
+static inline void open_line_code( minift_vm_t *vm ){
+	minift_lines_t *lines = vm->lines;
+	minift_compiler_t *cs = &vm->compiler;
+
+	lines->code = cs->code = minift_lines_space( vm );
+	lines->swap_ptr = minift_code_align( cs->code );
+	lines->swap_end = (minift_cell_t *)lines->end;
+	lines->open     = true;
+
+	cs->forward_count  = 0;
+	cs->backward_count = 0;
+	cs->fold_count     = 0;
+	cs->fold_end       = NULL;
+	cs->local_count    = 0;
+	cs->local_state    = LOCALS_NONE;
+}
+
+// ends the code compiled so far with a `;` and runs it
+static inline bool close_line_code( minift_vm_t *vm, bool cache ){
+	minift_lines_t *lines = vm->lines;
+	minift_compiler_t *cs = &vm->compiler;
+
+	lines->open = false;
+
+	if ( cs->forward_count || cs->backward_count || cs->local_state
+	  || vm->token_handler )
+	{
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "unfinished line" );
+		return false;
+	}
+
+	swap_line_space( vm );
+	emit_return( vm );
+	swap_line_space( vm );
+
+	if ( cache ){
+		minift_lines_add( vm, lines->text, lines->length, lines->hash,
+		                  lines->code, cs->code );
+	}
+
+	run_line( vm, lines->code );
+
+	return true;
+}
+
+static inline void finish_line( minift_vm_t *vm ){
+	minift_lines_t *lines = vm->lines;
+
+	vm->reader.end = lines->input_end;
+	lines->active  = false;
+
+	if ( lines->open ){
+		close_line_code( vm, lines->cacheable );
+	}
+}
+
+// skips the rest of the line after an error compiling it
+static inline void drop_line( minift_vm_t *vm ){
+	minift_lines_t *lines = vm->lines;
+
+	vm->reader.ptr   = vm->reader.end;
+	vm->reader.end   = lines->input_end;
+	vm->reader.state = MINIFT_READ_SKIP;
+	lines->active    = false;
+	lines->open      = false;
+}
+
+static inline void compile_line_token( minift_vm_t *vm, minift_read_ret_t token ){
+	minift_lines_t *lines = vm->lines;
+
+	if ( !lines->open ){
+		open_line_code( vm );
+	}
+
+	// the most any one token compiles to, plus the final `unlocals` and `;`
+	if ( lines->end - (uint8_t *)vm->compiler.code < 6 * sizeof(minift_cell_t) ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "line too long to compile" );
+		drop_line( vm );
+		return;
+	}
+
+	// errors stick until minift_run_for() clears them, so only new ones
+	// mean this token failed
+	bool error = vm->error;
+	vm->error  = false;
+
+	swap_line_space( vm );
+
+	if ( vm->token_handler ){
+		// operands for `to` and `'`
+		minift_token_handler_t handler = vm->token_handler;
+		vm->token_handler = NULL;
+		handler( vm, token );
+
+	} else if ( token.type == MINIFT_TYPE_ADDR ){
+		// strings were stored as they would be when interpreting
+		compile_const( vm, token.token );
+
+	} else {
+		minift_compile_token( vm, token );
+	}
+
+	swap_line_space( vm );
+
+	if ( vm->error ){
+		drop_line( vm );
+	}
+
+	vm->error |= error;
+}
+
+// Takes one step of reading a line, returning false with the next token in
+// `token` if it should be interpreted as usual instead.
+static inline bool step_line( minift_vm_t *vm, minift_read_ret_t *token ){
+	minift_lines_t *lines = vm->lines;
+
+	// the code before a parsing word has finished, so run the word
+	if ( lines->has_pending ){
+		lines->has_pending = false;
+		minift_exec_word( vm, lines->pending );
+		return true;
+	}
+
+	if ( !lines->active ){
+		if ( vm->compiling || vm->token_handler
+		  || vm->reader.state != MINIFT_READ_SKIP || !start_line( vm ))
+		{
+			*token = minift_read_token( vm );
+			return false;
+		}
+
+		return true;
 	}
 
-	// push remaining ";" word
-	minift_push( vm, &vm->data_stack, token.token );
+	// the whole line is there, so compile as much of it as possible in
+	// one step
+	while ( lines->active ){
+		*token = minift_read_token( vm );
+
+		if ( token->type == MINIFT_TYPE_NONE ){
+			finish_line( vm );
+			break;
+		}
+
+		// definitions within the line, and names read by parsing words
+		if ( vm->compiling || (vm->token_handler && !lines->open) ){
+			return false;
+		}
+
+		if ( token->type == MINIFT_TYPE_WORD && !vm->token_handler
+		  && line_parses( vm, token->token ))
+		{
+			// control flow can't be split around it
+			if ( lines->open && !close_line_code( vm, false )){
+				drop_line( vm );
+				break;
+			}
+
+			lines->cacheable   = false;
+			lines->pending     = token->token;
+			lines->has_pending = true;
+			break;
+		}
 
-	vm->compiling = false;
+		compile_line_token( vm, *token );
+	}
+
+	return true;
 }
 
-minift_define_t *minift_make_variable( minift_vm_t *vm, unsigned long word ){
+minift_define_t *minift_make_variable( minift_vm_t *vm, minift_cell_t word ){
+	if ( pure_word( vm, word )){
+		return NULL;
+	}
+
 	minift_define_t *def   = alloc_definition( vm );
+	minift_cell_t   *data  = def? minift_define_data( def ) : NULL;
 
-	if ( !def ){
+	if ( !def || data + 2 > vm->data_stack.end ){
 		minift_error( vm, MINIFT_ERR_FATAL, "out of data space" );
 		return NULL;
 	}
@@ -400,19 +1497,23 @@ minift_define_t *minift_make_variable( minift_vm_t *vm, unsigned long word ){
 
 	vm->definitions = def;
 
-	minift_push( vm, &vm->data_stack, minift_hash( "pushc" ));
-	minift_push( vm, &vm->data_stack, 0 );
-	minift_push( vm, &vm->data_stack, minift_hash( ";" ));
+	// compiles to `pushc <data> ;`
+	minift_token_t *end = (minift_token_t *)(data + 1);
+
+	*minift_code_body( def ) = minift_code_token( vm, HASH_PUSH_CONST );
+	*data = 0;
+	*end  = minift_code_token( vm, HASH_RETURN );
+
+	vm->data_stack.ptr = minift_code_align( end + 1 );
 
 	return def;
 }
 
-unsigned long *minift_define_data( minift_define_t *define ){
-	return (void *)
-		((uint8_t *)define + sizeof(minift_define_t) + sizeof(unsigned long));
+minift_cell_t *minift_define_data( minift_define_t *define ){
+	return minift_code_cell( minift_code_body( define ));
 }
 
-minift_define_t *minift_define_lookup( minift_vm_t *vm, unsigned long hash ){
+minift_define_t *minift_define_lookup( minift_vm_t *vm, minift_cell_t hash ){
 	minift_define_t *def = vm->definitions;
 
 	for ( ; def; def = def->previous ){
@@ -423,3 +1524,104 @@ minift_define_t *minift_define_lookup( minift_vm_t *vm, unsigned long hash ){
 	
 	return NULL;
 }
+
+// Returns the token used for `word` in compiled code. For compact and byte
+// code this is the word's index in the word table, which is added to if
+// needed.
+minift_token_t minift_code_token( minift_vm_t *vm, minift_cell_t word ){
+#if MINIFT_CODE_FORMAT != MINIFT_CODE_CELLS
+	minift_stack_t *words = &vm->words;
+	minift_cell_t *ptr = find_token( vm, word );
+
+	if ( ptr ){
+		return ptr - words->start;
+	}
+
+	if ( words->ptr >= words->end ){
+		minift_error( vm, MINIFT_ERR_FATAL, "word table full" );
+		return 0;
+	}
+
+	ptr = words->ptr++;
+	*ptr = word;
+
+	return ptr - words->start;
+#else
+	return word;
+#endif
+}
+
+minift_task_t *minift_task_spawn( minift_vm_t *vm,
+                                  minift_task_t *task,
+                                  minift_stack_t *calls,
+                                  minift_stack_t *params,
+                                  minift_cell_t word )
+{
+	minift_define_t *def = minift_define_lookup( vm, word );
+
+	if ( !def ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "can't spawn undefined word" );
+		return NULL;
+	}
+
+	task->call_stack  = *calls;
+	task->param_stack = *params;
+	task->ip = minift_code_body( def );
+	task->spawned = false;
+
+	// returning to a null ip ends the task
+	if ( task->call_stack.ptr >= task->call_stack.end ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "task call stack too small" );
+		return NULL;
+	}
+
+	*task->call_stack.ptr++ = 0;
+
+#if MINIFT_MEMSTATS
+	task->call_stack.peak  = task->call_stack.ptr;
+	task->param_stack.peak = task->param_stack.ptr;
+#endif
+
+	task->next     = vm->task->next;
+	vm->task->next = task;
+
+	return task;
+}
+
+void minift_task_switch( minift_vm_t *vm ){
+	minift_task_t *cur  = vm->task;
+	minift_task_t *next = cur->next;
+
+	if ( cur != &vm->main_task && !vm->ip ){
+		// finished, unlink it from the ring
+		minift_task_t *prev = next;
+
+		while ( prev->next != cur ){
+			prev = prev->next;
+		}
+
+		prev->next = next;
+
+		// it's stacks are still where `spawn` put them
+		if ( cur->spawned ){
+			cur->next = vm->free_tasks;
+			vm->free_tasks = cur;
+		}
+
+	} else {
+		cur->call_stack  = vm->call_stack;
+		cur->param_stack = vm->param_stack;
+		cur->ip          = vm->ip;
+	}
+
+	vm->call_stack  = next->call_stack;
+	vm->param_stack = next->param_stack;
+	vm->ip          = next->ip;
+	vm->task        = next;
+	vm->task_steps  = 0;
+	vm->task_yield  = false;
+}
+
+void minift_pause( minift_vm_t *vm ){
+	vm->task_yield = true;
+}
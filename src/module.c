@@ -0,0 +1,492 @@
+#include <miniforth/miniforth.h>
+#include <miniforth/code.h>
+#include <stdint.h>
+#include "words_hash.h"
+
+// Modules
+//
+// `include ( name -- )` runs a source file, read with minift_source_read(),
+// as if it had been typed in at that point. `require` does the same unless
+// the file has already been loaded. Each load defines a hidden word for
+// the file's name first, so forgetting past it with a marker unloads it.
+//
+// The dictionary left by a module is cached with minift_cache_write(),
+// and the next time it's loaded it's read back with minift_cache_read()
+// and relocated into place instead of being compiled again. Modules refer
+// to earlier definitions by address, and to words by their place in the
+// word table, and can have run earlier words while they were compiled,
+// so the key hashes the contents of every definition before the module
+// along with it's source and the build configuration. Addresses in the
+// data space are hashed as offsets from it's start. Loading the same
+// files in the same order hits the cache every time, and changing what
+// one defines recompiles everything loaded after it.
+//
+// Caveats:
+//  - only the dictionary is cached, anything else the module's code does
+//    while it's loaded (printing, storing into earlier definitions,
+//    leaving things on the stack) is only done when it's compiled
+//  - like cloning, addresses stored as plain numbers aren't relocated
+//  - string literals are kept in the module rather than the string pool,
+//    and modules that refer to a persistent region or a shared segment
+//    aren't cached
+//  - a module that loads others isn't cached itself, since they could
+//    change without it changing, but the ones it loads are. A top level
+//    file that only requires others is cheap to compile anyway.
+//  - code in a definition that loads a module can't be sure the line
+//    space is free, so the source is interpreted a word at a time
+
+#if defined(UINTPTR_MAX) && UINTPTR_MAX > 0xffffffff
+#define HASH_BASIS ((minift_cell_t)14695981039346656037ull)
+#define HASH_PRIME ((minift_cell_t)1099511628211ull)
+#else
+#define HASH_BASIS ((minift_cell_t)2166136261u)
+#define HASH_PRIME ((minift_cell_t)16777619u)
+#endif
+
+static inline minift_cell_t hash_bytes( minift_cell_t hash,
+                                        const void *data,
+                                        unsigned long len )
+{
+	const uint8_t *ptr = data;
+
+	for ( unsigned long i = 0; i < len; i++ ){
+		hash = (hash ^ ptr[i]) * HASH_PRIME;
+	}
+
+	return hash;
+}
+
+static inline minift_cell_t hash_cell( minift_cell_t hash, minift_cell_t value ){
+	return hash_bytes( hash, &value, sizeof(value) );
+}
+
+static inline minift_cell_t data_offset( minift_vm_t *vm, void *ptr ){
+	return (uint8_t *)ptr - (uint8_t *)vm->data_base;
+}
+
+static inline bool in_range( void *ptr, void *start, void *end ){
+	return (uint8_t *)ptr >= (uint8_t *)start && (uint8_t *)ptr < (uint8_t *)end;
+}
+
+// a cell that might be an address into the data space, which is hashed
+// as an offset so the key doesn't change if the data space moves
+static inline minift_cell_t hash_data_cell( minift_vm_t *vm,
+                                            minift_cell_t hash,
+                                            minift_cell_t value )
+{
+	void *ptr = (void *)value;
+
+	if ( in_range( ptr, vm->data_base, vm->data_stack.end )){
+		return hash_cell( hash, data_offset( vm, ptr ));
+	}
+
+	return hash_cell( hash, value );
+}
+
+// Hashes what a definition compiled to, the words in it's code with their
+// operands and then anything allotted after it, up to `end`. Padding
+// before cell operands isn't hashed, since it's left as it was.
+static minift_cell_t hash_define( minift_vm_t *vm,
+                                  minift_cell_t hash,
+                                  minift_define_t *def,
+                                  void *end )
+{
+	minift_code_iter_t it;
+	minift_token_t *code_end = minift_code_body( def );
+
+	minift_code_begin( &it, vm, def );
+
+	while ( (void *)it.next < end && minift_code_next( &it )){
+		minift_cell_t value = 0;
+
+		hash = hash_cell( hash, it.word );
+		code_end = it.next;
+
+		switch ( it.kind ){
+			case MINIFT_OPERAND_CONST:
+				value = *(minift_cell_t *)it.operand;
+				break;
+
+			case MINIFT_OPERAND_ADDR:
+				value = data_offset( vm, (void *)*(minift_cell_t *)it.operand );
+				break;
+
+			case MINIFT_OPERAND_BRANCH:
+#if MINIFT_BRANCH_ABSOLUTE
+				value = data_offset( vm, (void *)*(minift_token_t *)it.operand );
+#else
+				value = minift_code_short( it.operand );
+#endif
+				break;
+
+			case MINIFT_OPERAND_SHORT:
+				value = minift_code_short( it.operand );
+				break;
+
+			case MINIFT_OPERAND_WORD:
+				value = *(minift_token_t *)it.operand;
+				break;
+
+			case MINIFT_OPERAND_VARINT:
+				minift_varint_read( it.operand, &value );
+				break;
+
+			case MINIFT_OPERAND_STRING:
+				{
+					char *str = (char *)((minift_token_t *)it.operand + MINIFT_SHORT_TOKENS);
+					unsigned long len = 0;
+
+					// the string's padded out to a whole token
+					while ( str + len < (char *)it.next && str[len] ){
+						len++;
+					}
+
+					value = minift_code_short( it.operand );
+					hash  = hash_bytes( hash, str, len );
+				}
+				break;
+
+			default:
+				break;
+		}
+
+		hash = hash_cell( hash, value );
+	}
+
+	minift_cell_t *data = minift_code_align( code_end );
+
+	for ( ; (void *)(data + 1) <= end; data++ ){
+		hash = hash_data_cell( vm, hash, *data );
+	}
+
+	return hash;
+}
+
+// name of the word marking a module as loaded
+static inline minift_cell_t module_word( const char *name ){
+	minift_cell_t hash = hash_cell( HASH_BASIS, HASH_REQUIRE );
+
+	return hash_bytes( hash, name, minift_str_length( name ));
+}
+
+static minift_cell_t module_key( minift_vm_t *vm,
+                                 minift_cell_t word,
+                                 const char *text,
+                                 unsigned long len )
+{
+	minift_cell_t key = hash_bytes( HASH_BASIS, text, len );
+	minift_archive_t *base = &vm->base_archive;
+
+	key = hash_cell( key, word );
+	key = hash_cell( key, MINIFT_MODULE_VERSION );
+	key = hash_cell( key, MINIFT_CODE_FORMAT );
+	key = hash_cell( key, sizeof(minift_cell_t) );
+	key = hash_cell( key, data_offset( vm, vm->data_stack.end ));
+	key = hash_cell( key, data_offset( vm, vm->data_stack.ptr ));
+	key = hash_cell( key, data_offset( vm, vm->data_stack.start ));
+
+	// builtins get their tokens in archive order
+	for ( unsigned i = 0; i < base->size; i++ ){
+		key = hash_cell( key, base->entries[i].hash );
+	}
+
+	for ( minift_cell_t *ptr = vm->words.start; ptr < vm->words.ptr; ptr++ ){
+		key = hash_cell( key, *ptr );
+	}
+
+	// definitions are laid out in order, so each one ends where the one
+	// after it starts
+	minift_define_t *def = vm->definitions;
+	void *end = vm->data_stack.ptr;
+
+	for ( ; def && in_range( def, vm->data_base, vm->data_stack.ptr ); def = def->previous ){
+		key = hash_cell( key, def->hash );
+		key = hash_cell( key, data_offset( vm, def ));
+		key = hash_define( vm, key, def, end );
+		end = def;
+	}
+
+	return key;
+}
+
+// things that have to be put back after running source from inside a
+// line, the cache is left as the nested source leaves it
+static void restore_line( minift_lines_t *lines, minift_lines_t *saved ){
+	lines->plain_until = saved->plain_until;
+	lines->text        = saved->text;
+	lines->length      = saved->length;
+	lines->hash        = saved->hash;
+	lines->input_end   = saved->input_end;
+	lines->active      = saved->active;
+	lines->cacheable   = saved->cacheable;
+	lines->code        = saved->code;
+	lines->swap_ptr    = saved->swap_ptr;
+	lines->swap_end    = saved->swap_end;
+	lines->open        = saved->open;
+	lines->pending     = saved->pending;
+	lines->has_pending = saved->has_pending;
+}
+
+static inline int run_source( minift_vm_t *vm ){
+	int status;
+
+	while (( status = minift_run_for( vm, 0, 0 )) == MINIFT_RUN_YIELDED );
+
+	return status;
+}
+
+// Runs `text` to completion, then carries on with the input that was
+// being read before. Returns false if there was an error, which abandons
+// whatever called this as well.
+bool minift_evaluate( minift_vm_t *vm, const char *text, unsigned long len ){
+	if ( vm->task->next != vm->task ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "can't load source with tasks running" );
+		return false;
+	}
+
+	minift_reader_t reader = vm->reader;
+	minift_token_t *ip     = vm->ip;
+	minift_lines_t *lines  = vm->lines;
+	minift_lines_t saved = lines? *lines : (minift_lines_t){ 0 };
+
+	// the code that called this might be in the line space
+	if ( ip ){
+		vm->lines = NULL;
+
+	} else if ( lines ){
+		lines->active      = false;
+		lines->open        = false;
+		lines->has_pending = false;
+	}
+
+	vm->ip           = NULL;
+	vm->reader.state = MINIFT_READ_SKIP;
+	minift_feed( vm, text, len );
+
+	int status = run_source( vm );
+
+	// finish off the last line, if it doesn't end with a newline
+	if ( status == MINIFT_RUN_WAITING ){
+		minift_feed( vm, "\n", 1 );
+		status = run_source( vm );
+	}
+
+	vm->reader = reader;
+	vm->lines  = lines;
+
+	if ( lines && !ip ){
+		restore_line( lines, &saved );
+	}
+
+	// running out of input above doesn't mean the caller has
+	vm->waiting = false;
+
+	if ( status == MINIFT_RUN_ERROR ){
+		vm->error = true;
+		return false;
+	}
+
+	vm->ip = ip;
+
+	return true;
+}
+
+// Checks that the module compiled from `start` can be cached: it has to
+// have added to the dictionary without changing what was there before it,
+// and all the addresses in it's code have to be in the data space.
+static bool cacheable( minift_vm_t *vm,
+                       uint8_t *start,
+                       minift_define_t *prior,
+                       minift_cell_t *words )
+{
+	minift_define_t *def = vm->definitions;
+	uint8_t *end = (uint8_t *)vm->data_stack.ptr;
+
+	if ( vm->segment || vm->compiling || !vm->running
+	  || end < start || vm->words.ptr < words )
+	{
+		return false;
+	}
+
+	for ( ; def != prior; def = def->previous ){
+		minift_code_iter_t it;
+
+		if ( !in_range( def, start, end )){
+			return false;
+		}
+
+		minift_code_begin( &it, vm, def );
+
+		while ( minift_code_next( &it )){
+			minift_cell_t *operand = it.operand;
+
+			if ( it.kind == MINIFT_OPERAND_ADDR
+			  && !in_range( (void *)*operand, vm->data_base, vm->data_stack.end ))
+			{
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+// Writes the module from `start` to the cache, putting it together in the
+// free data space after it.
+static void cache_module( minift_vm_t *vm,
+                          minift_cell_t key,
+                          uint8_t *start,
+                          minift_cell_t *words )
+{
+	minift_cell_t *ptr = vm->data_stack.ptr;
+	minift_cell_t count = vm->words.ptr - words;
+	minift_module_header_t *header = (void *)(ptr + count);
+
+	if ( (uint8_t *)(header + 1) > (uint8_t *)vm->data_stack.end ){
+		return;
+	}
+
+	for ( minift_cell_t i = 0; i < count; i++ ){
+		ptr[i] = words[i];
+	}
+
+	header->magic       = MINIFT_MODULE_MAGIC;
+	header->version     = MINIFT_MODULE_VERSION;
+	header->cell_size   = sizeof(minift_cell_t);
+	header->code_format = MINIFT_CODE_FORMAT;
+	header->key         = key;
+	header->data_base   = (minift_cell_t)vm->data_base;
+	header->data_end    = (minift_cell_t)vm->data_stack.end;
+	header->start       = (minift_cell_t)start;
+	header->definitions = (minift_cell_t)vm->definitions;
+	header->data_start  = (minift_cell_t)vm->data_stack.start;
+	header->size        = (uint8_t *)ptr - start;
+	header->words       = count;
+
+	minift_cache_write( key, start, (uint8_t *)(header + 1) - start );
+}
+
+// Reads the module for `key` into the end of the data space, if it's
+// cached, and links it into the dictionary.
+static bool load_module( minift_vm_t *vm, minift_cell_t key ){
+	uint8_t *start = (uint8_t *)vm->data_stack.ptr;
+	uint8_t *end   = (uint8_t *)vm->data_stack.end;
+	unsigned long size = minift_cache_read( key, start, end - start );
+
+	if ( size < sizeof(minift_module_header_t) || size % sizeof(minift_cell_t) ){
+		return false;
+	}
+
+	minift_module_header_t *header = (void *)(start + size - sizeof(*header));
+	minift_cell_t *words = (minift_cell_t *)(start + header->size);
+	intptr_t delta = (uint8_t *)vm->data_base - (uint8_t *)header->data_base;
+
+	if ( header->magic       != MINIFT_MODULE_MAGIC
+	  || header->version     != MINIFT_MODULE_VERSION
+	  || header->cell_size   != sizeof(minift_cell_t)
+	  || header->code_format != MINIFT_CODE_FORMAT
+	  || header->key         != key
+	  || header->start + delta != (minift_cell_t)start
+	  || header->data_end + delta != (minift_cell_t)end
+	  || (uint8_t *)(words + header->words) != (uint8_t *)header
+	  || vm->words.ptr + header->words > vm->words.end )
+	{
+		return false;
+	}
+
+	// the word table goes first, the code can't be walked without it
+	for ( minift_cell_t i = 0; i < header->words; i++ ){
+		vm->words.ptr[i] = words[i];
+	}
+
+	vm->words.ptr += header->words;
+
+	uint8_t *old_start = (uint8_t *)header->data_base;
+	uint8_t *old_end   = (uint8_t *)header->data_end;
+	minift_define_t *def = (void *)(header->definitions + delta);
+	minift_define_t *newest = def;
+
+	vm->data_stack.start = (void *)(header->data_start + delta);
+	vm->data_stack.ptr   = (void *)(start + header->size);
+	minift_stack_mark( &vm->data_stack );
+
+	for ( ; in_range( def, start, vm->data_stack.ptr ); def = def->previous ){
+		minift_code_iter_t it;
+
+		if ( in_range( def->previous, old_start, old_end )){
+			def->previous = (void *)((uint8_t *)def->previous + delta);
+		}
+
+		minift_code_begin( &it, vm, def );
+
+		while ( minift_code_next( &it )){
+			minift_cell_t *operand = it.operand;
+
+			if ( (it.kind == MINIFT_OPERAND_ADDR
+			      || (MINIFT_BRANCH_ABSOLUTE && it.kind == MINIFT_OPERAND_BRANCH ))
+			  && in_range( (void *)*operand, old_start, old_end ))
+			{
+				*operand += delta;
+			}
+		}
+	}
+
+	vm->definitions = newest;
+
+	return true;
+}
+
+bool minift_include( minift_vm_t *vm, const char *name, bool once ){
+	if ( !name ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "no file name given" );
+		return false;
+	}
+
+	minift_cell_t word = module_word( name );
+	unsigned long len;
+
+	if ( once && minift_define_lookup( vm, word )){
+		return true;
+	}
+
+	const char *text = minift_source_read( name, &len );
+
+	if ( !text ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "couldn't read source file" );
+		return false;
+	}
+
+	minift_cell_t key = module_key( vm, word, text, len );
+	bool ret = true;
+
+	if ( load_module( vm, key )){
+		vm->loads++;
+
+	} else {
+		uint8_t *start = (uint8_t *)vm->data_stack.ptr;
+		minift_define_t *prior = vm->definitions;
+		minift_cell_t *words = vm->words.ptr;
+		minift_strpool_t *strings = vm->strings;
+
+		if ( !minift_make_variable( vm, word )){
+			minift_source_done( text, len );
+			return false;
+		}
+
+		unsigned long loads = ++vm->loads;
+
+		vm->strings = NULL;
+		ret = minift_evaluate( vm, text, len );
+		vm->strings = strings;
+
+		// the modules it loaded could change without it changing, so only
+		// they're cached
+		if ( ret && vm->loads == loads && cacheable( vm, start, prior, words )){
+			cache_module( vm, key, start, words );
+		}
+	}
+
+	minift_source_done( text, len );
+
+	return ret;
+}
@@ -0,0 +1,127 @@
+#include <miniforth/miniforth.h>
+
+// Typed native entries
+//
+// Archive entries made with MINIFT_NATIVE() bind a plain C function,
+// taking up to MINIFT_NATIVE_ARGS cells and returning either nothing or
+// one cell:
+//
+//   minift_cell_t clamp( minift_cell_t x, minift_cell_t lo, minift_cell_t hi );
+//   MINIFT_NATIVE( "clamp", clamp, 3, 1, MINIFT_NATIVE_PURE ),
+//
+// Arguments are passed in stack order, so `x lo hi clamp` calls
+// clamp( x, lo, hi ). The stack depth is checked once for the whole call
+// rather than on every pop and push, and the function doesn't need to
+// know about the vm at all. Words that need more than that, such as ones
+// that touch the ip, still use the `func` form.
+//
+// Pure entries have no side effects, so the compiler folds calls to them
+// with constant arguments into a constant. That gives up late binding for
+// them, a folded call would keep running the old word if the name was
+// defined again, so pure words can't be redefined, by `:` or anything
+// else that makes a definition.
+
+typedef minift_cell_t cell;
+
+typedef cell (*native0_t)( void );
+typedef cell (*native1_t)( cell );
+typedef cell (*native2_t)( cell, cell );
+typedef cell (*native3_t)( cell, cell, cell );
+typedef cell (*native4_t)( cell, cell, cell, cell );
+typedef cell (*native5_t)( cell, cell, cell, cell, cell );
+typedef cell (*native6_t)( cell, cell, cell, cell, cell, cell );
+
+typedef void (*void0_t)( void );
+typedef void (*void1_t)( cell );
+typedef void (*void2_t)( cell, cell );
+typedef void (*void3_t)( cell, cell, cell );
+typedef void (*void4_t)( cell, cell, cell, cell );
+typedef void (*void5_t)( cell, cell, cell, cell, cell );
+typedef void (*void6_t)( cell, cell, cell, cell, cell, cell );
+
+static inline cell call_cell( minift_native_t fn, unsigned args, cell *a ){
+	switch ( args ){
+		case 0: return ((native0_t)fn)( );
+		case 1: return ((native1_t)fn)( a[0] );
+		case 2: return ((native2_t)fn)( a[0], a[1] );
+		case 3: return ((native3_t)fn)( a[0], a[1], a[2] );
+		case 4: return ((native4_t)fn)( a[0], a[1], a[2], a[3] );
+		case 5: return ((native5_t)fn)( a[0], a[1], a[2], a[3], a[4] );
+		default: return ((native6_t)fn)( a[0], a[1], a[2], a[3], a[4], a[5] );
+	}
+}
+
+static inline void call_void( minift_native_t fn, unsigned args, cell *a ){
+	switch ( args ){
+		case 0: ((void0_t)fn)( ); break;
+		case 1: ((void1_t)fn)( a[0] ); break;
+		case 2: ((void2_t)fn)( a[0], a[1] ); break;
+		case 3: ((void3_t)fn)( a[0], a[1], a[2] ); break;
+		case 4: ((void4_t)fn)( a[0], a[1], a[2], a[3] ); break;
+		case 5: ((void5_t)fn)( a[0], a[1], a[2], a[3], a[4] ); break;
+		default: ((void6_t)fn)( a[0], a[1], a[2], a[3], a[4], a[5] ); break;
+	}
+}
+
+static inline bool native_call( minift_vm_t *vm,
+                                minift_arc_ent_t *ent,
+                                minift_cell_t *args,
+                                minift_cell_t *result )
+{
+	if ( ent->args > MINIFT_NATIVE_ARGS || ent->results > 1 ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "bad native entry" );
+		return false;
+	}
+
+	// the usual binary operator shape, skipping the switch
+	if ( ent->args == 2 && ent->results == 1 ){
+		*result = ((native2_t)ent->native)( args[0], args[1] );
+
+	} else if ( ent->results ){
+		*result = call_cell( ent->native, ent->args, args );
+
+	} else {
+		call_void( ent->native, ent->args, args );
+	}
+
+	return true;
+}
+
+// Calls a native entry with arguments from `args`, storing the result (if
+// it has one) in `result`.
+bool minift_native_call( minift_vm_t *vm,
+                         minift_arc_ent_t *ent,
+                         minift_cell_t *args,
+                         minift_cell_t *result )
+{
+	return native_call( vm, ent, args, result );
+}
+
+// Runs a native entry on the parameter stack, following the same protocol
+// as `func`.
+bool minift_native_exec( minift_vm_t *vm, minift_arc_ent_t *ent ){
+	minift_stack_t *stack = &vm->param_stack;
+	minift_cell_t *args = stack->ptr - ent->args;
+
+	if ( args < stack->start ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "reached beginning of stack" );
+		return false;
+	}
+
+	// results overwrite the arguments, so this only matters for natives
+	// that don't take any
+	if ( args + ent->results > stack->end ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "reached end of stack" );
+		return false;
+	}
+
+	if ( !native_call( vm, ent, args, args )){
+		return false;
+	}
+
+	stack->ptr = args + ent->results;
+	minift_stack_mark( stack );
+
+	return true;
+}
@@ -0,0 +1,172 @@
+#include <miniforth/miniforth.h>
+#include <stdint.h>
+
+// Persistent regions
+//
+// A persistent region is memory given to minift_persist_init() that
+// outlives the vm, usually a file mapped by the stub. `pcreate` allocates
+// named entries in it, so a table built once can be found again by name
+// the next time the region is mapped instead of being recomputed:
+//
+//   pcreate squares 1000 cells pallot
+//   : setup pfresh if then ... fill in squares ... end ; setup
+//
+// The region starts with a header giving the layout version and cell
+// size, followed by the entries, each linked to the one before it. Links
+// are offsets from the start of the region rather than pointers. Entries
+// can only grow while they're the newest one in the region.
+
+static inline minift_cell_t align_size( minift_cell_t bytes ){
+	minift_cell_t size = sizeof(minift_cell_t);
+
+	return (bytes + size - 1) & ~(size - 1);
+}
+
+static inline uint8_t *region_base( minift_persist_t *persist ){
+	return (uint8_t *)persist->header;
+}
+
+static inline minift_persist_entry_t *entry_at( minift_persist_t *persist,
+                                                minift_cell_t offset )
+{
+	return offset? (void *)(region_base( persist ) + offset) : NULL;
+}
+
+static inline minift_cell_t offset_of( minift_persist_t *persist, void *ptr ){
+	return (uint8_t *)ptr - region_base( persist );
+}
+
+// Uses an existing region in `mem`, or formats a new one if it's all
+// zeros, as a newly created file would be.
+bool minift_persist_init( minift_vm_t *vm,
+                          minift_persist_t *persist,
+                          void *mem,
+                          unsigned long size )
+{
+	minift_persist_header_t *header = mem;
+
+	if ( ((uintptr_t)mem & (sizeof(minift_cell_t) - 1))
+	  || size < sizeof(minift_persist_header_t) )
+	{
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "persistent region too small or misaligned" );
+		return false;
+	}
+
+	if ( header->magic == 0 ){
+		header->magic     = MINIFT_PERSIST_MAGIC;
+		header->version   = MINIFT_PERSIST_VERSION;
+		header->cell_size = sizeof(minift_cell_t);
+		header->size      = size;
+		header->used      = align_size( sizeof(minift_persist_header_t) );
+		header->newest    = 0;
+
+	} else if ( header->magic != MINIFT_PERSIST_MAGIC
+	         || header->version != MINIFT_PERSIST_VERSION
+	         || header->cell_size != sizeof(minift_cell_t) )
+	{
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "persistent region has an unknown layout" );
+		return false;
+
+	} else if ( header->used > size ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "persistent region is truncated" );
+		return false;
+	}
+
+	// the region can be mapped bigger than it was made
+	header->size = size;
+
+	persist->header   = header;
+	persist->last     = NULL;
+	persist->allotted = 0;
+	persist->fresh    = false;
+
+	vm->persist = persist;
+
+	return true;
+}
+
+minift_persist_entry_t *minift_persist_lookup( minift_vm_t *vm,
+                                               minift_cell_t hash )
+{
+	minift_persist_t *persist = vm->persist;
+	minift_persist_entry_t *ent = entry_at( persist, persist->header->newest );
+
+	for ( ; ent; ent = entry_at( persist, ent->previous )){
+		if ( ent->hash == hash ){
+			return ent;
+		}
+	}
+
+	return NULL;
+}
+
+// Adds an empty entry at the end of the region.
+minift_persist_entry_t *minift_persist_alloc( minift_vm_t *vm,
+                                              minift_cell_t hash )
+{
+	minift_persist_header_t *header = vm->persist->header;
+
+	if ( header->used + sizeof(minift_persist_entry_t) > header->size ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "out of persistent space" );
+		return NULL;
+	}
+
+	minift_persist_entry_t *ent = entry_at( vm->persist, header->used );
+
+	ent->hash     = hash;
+	ent->previous = header->newest;
+	ent->size     = 0;
+
+	header->newest = header->used;
+	header->used  += sizeof(minift_persist_entry_t);
+
+	return ent;
+}
+
+// Allots space to the entry from the last `pcreate`. An entry found from
+// a previous run already has its space, so this only grows it if more is
+// asked for than it had.
+bool minift_persist_allot( minift_vm_t *vm, minift_cell_t bytes ){
+	minift_persist_t *persist = vm->persist;
+	minift_persist_header_t *header = persist->header;
+	minift_persist_entry_t *ent = persist->last;
+
+	if ( !ent ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "pallot without pcreate" );
+		return false;
+	}
+
+	minift_cell_t want = align_size( persist->allotted + bytes );
+
+	if ( want > ent->size ){
+		minift_cell_t end = offset_of( persist, minift_persist_data( ent ));
+
+		if ( header->newest != offset_of( persist, ent )){
+			minift_error( vm, MINIFT_ERR_RECOVERABLE,
+			              "only the newest persistent entry can grow" );
+			return false;
+		}
+
+		if ( end + want > header->size ){
+			minift_error( vm, MINIFT_ERR_RECOVERABLE,
+			              "out of persistent space" );
+			return false;
+		}
+
+		ent->size    = want;
+		header->used = end + want;
+	}
+
+	persist->allotted = want;
+
+	return true;
+}
+
+void *minift_persist_data( minift_persist_entry_t *ent ){
+	return ent + 1;
+}
@@ -0,0 +1,160 @@
+#include <miniforth/miniforth.h>
+#include <miniforth/code.h>
+#include <stdint.h>
+#include "words_hash.h"
+
+// Shared dictionary segments
+//
+// A segment is the dictionary and data space built up by one vm, frozen so
+// that other vms can use it as the base of their own dictionary without
+// compiling it again. Nothing in a segment is written to after it's frozen:
+// since compiled code refers to words by hash, a vm can shadow a shared
+// definition with a private one just by defining it again, and that's
+// how writes to shared variables are kept per-vm.
+//
+// Compact and byte code refer to words by their index in the word table,
+// so the segment keeps the table as it was when frozen, and vms linking
+// to it start with a copy.
+
+void minift_segment_freeze( minift_vm_t *vm, minift_segment_t *seg ){
+	seg->definitions = vm->definitions;
+	seg->start       = vm->data_base;
+	seg->end         = vm->data_stack.ptr;
+	seg->parent      = vm->segment;
+	seg->words       = vm->words.start;
+	seg->word_count  = vm->words.ptr - vm->words.start;
+
+	// the vm that built the segment becomes just another user of it, and
+	// finished tasks can't be reused from inside it
+	vm->segment    = seg;
+	vm->data_base  = vm->data_stack.ptr;
+	vm->free_tasks = NULL;
+}
+
+bool minift_segment_link( minift_vm_t *vm, minift_segment_t *seg ){
+	if ( vm->definitions ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE,
+		              "can only link a segment into an empty dictionary" );
+		return false;
+	}
+
+	if ( vm->words.start + seg->word_count > vm->words.end ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "word table too small" );
+		return false;
+	}
+
+	// the table only has the builtins in it so far, which the segment's
+	// table starts with too
+	vm->words.ptr = vm->words.start;
+
+	for ( unsigned i = 0; i < seg->word_count; i++ ){
+		*vm->words.ptr++ = seg->words[i];
+	}
+
+	vm->definitions = seg->definitions;
+	vm->segment     = seg;
+
+	return true;
+}
+
+static inline minift_segment_t *find_owner( minift_vm_t *vm, void *ptr ){
+	minift_segment_t *seg = vm->segment;
+
+	for ( ; seg; seg = seg->parent ){
+		if ( ptr >= (void *)seg->start && ptr < (void *)seg->end ){
+			return seg;
+		}
+	}
+
+	return NULL;
+}
+
+bool minift_is_shared( minift_vm_t *vm, void *ptr ){
+	return find_owner( vm, ptr ) != NULL;
+}
+
+minift_segment_t *minift_segment_owner( minift_vm_t *vm, void *ptr ){
+	return find_owner( vm, ptr );
+}
+
+// `create`d words compile to `pusha <addr> ;`
+static inline bool is_created( minift_vm_t *vm, minift_define_t *def ){
+	minift_token_t *code = minift_code_body( def );
+
+	return minift_code_word( vm, code[0] ) == HASH_PUSH_ADDR;
+}
+
+// size of the data space following a definition, which runs up to the
+// next definition in the segment, or the end of the segment
+static inline minift_cell_t *data_end( minift_segment_t *seg,
+                                       minift_define_t *def )
+{
+	minift_cell_t *end = seg->end;
+	minift_define_t *temp = seg->definitions;
+
+	for ( ; temp && temp != def; temp = temp->previous ){
+		end = (void *)temp;
+	}
+
+	return end;
+}
+
+// Returns a private copy of a definition from a shared segment, so that
+// it can be written to. Definitions that aren't shared are returned as-is.
+minift_define_t *minift_define_private( minift_vm_t *vm,
+                                        minift_define_t *def )
+{
+	minift_segment_t *seg = find_owner( vm, def );
+
+	if ( !seg ){
+		return def;
+	}
+
+	minift_cell_t *src = minift_define_data( def );
+	minift_define_t *copy = minift_make_variable( vm, def->hash );
+
+	if ( !copy ){
+		return NULL;
+	}
+
+	minift_cell_t *data = minift_define_data( copy );
+
+	if ( !is_created( vm, def )){
+		*data = *src;
+		return copy;
+	}
+
+	*minift_code_body( copy ) = minift_code_token( vm, HASH_PUSH_ADDR );
+
+	minift_cell_t *from = (minift_cell_t *)*src;
+	minift_cell_t *end  = data_end( seg, def );
+	minift_cell_t *to   = vm->data_stack.ptr;
+
+	if ( to + (end - from) >= vm->data_stack.end ){
+		minift_error( vm, MINIFT_ERR_FATAL, "out of data space" );
+		return NULL;
+	}
+
+	*data = (minift_cell_t)to;
+
+	while ( from < end ){
+		*to++ = *from++;
+	}
+
+	vm->data_stack.ptr = to;
+
+	return copy;
+}
+
+// Used when executing a definition, arrays in a shared segment get copied
+// the first time they're used so each vm gets it's own. Everything else is
+// only copied when written to.
+minift_define_t *minift_define_resolve( minift_vm_t *vm,
+                                        minift_define_t *def )
+{
+	if ( find_owner( vm, def ) && is_created( vm, def )){
+		return minift_define_private( vm, def );
+	}
+
+	return def;
+}
@@ -0,0 +1,332 @@
+#include <miniforth/miniforth.h>
+#include <stdint.h>
+
+// Strings
+//
+// String literals can be interned in a pool in memory given to
+// minift_strpool_init(), so that each distinct literal is only stored
+// once no matter how many times it's compiled or typed in. Without a pool
+// they're copied into the data space as before.
+//
+// The string words work on an address and a length. The kernels here
+// handle a word at a time where the alignment allows it, using the usual
+// tricks for finding a zero byte in a word.
+
+#ifdef __GNUC__
+typedef uintptr_t __attribute__(( __may_alias__ )) word_t;
+#define always_inline inline __attribute__(( __always_inline__ ))
+#else
+typedef uintptr_t word_t;
+#define always_inline inline
+#endif
+
+#define WORD_SIZE  sizeof(word_t)
+#define WORD_ONES  ((word_t)-1 / 0xff)
+#define WORD_HIGHS (WORD_ONES * 0x80)
+
+static always_inline word_t has_zero( word_t x ){
+	return (x - WORD_ONES) & ~x & WORD_HIGHS;
+}
+
+static inline bool is_aligned( const void *ptr ){
+	return ((uintptr_t)ptr & (WORD_SIZE - 1)) == 0;
+}
+
+static inline bool same_alignment( const void *a, const void *b ){
+	return (((uintptr_t)a ^ (uintptr_t)b) & (WORD_SIZE - 1)) == 0;
+}
+
+// Reading a whole aligned word never crosses into another page, so it's
+// fine to read past the end of the string within the last word.
+unsigned long minift_str_length( const char *str ){
+	const char *ptr = str;
+
+	for ( ; !is_aligned( ptr ); ptr++ ){
+		if ( !*ptr ){
+			return ptr - str;
+		}
+	}
+
+	while ( !has_zero( *(const word_t *)ptr )){
+		ptr += WORD_SIZE;
+	}
+
+	while ( *ptr ){
+		ptr++;
+	}
+
+	return ptr - str;
+}
+
+// length of the common prefix of `a` and `b`, up to `len`
+static unsigned long common_prefix( const char *a, const char *b,
+                                    unsigned long len )
+{
+	unsigned long i = 0;
+
+	if ( same_alignment( a, b )){
+		for ( ; i < len && !is_aligned( a + i ); i++ ){
+			if ( a[i] != b[i] ){
+				return i;
+			}
+		}
+
+		for ( ; i + WORD_SIZE <= len; i += WORD_SIZE ){
+			if ( *(const word_t *)(a + i) != *(const word_t *)(b + i) ){
+				break;
+			}
+		}
+	}
+
+	for ( ; i < len && a[i] == b[i]; i++ );
+
+	return i;
+}
+
+bool minift_str_equal( const char *a, const char *b, unsigned long len ){
+	return common_prefix( a, b, len ) == len;
+}
+
+int minift_str_compare( const char *a, unsigned long alen,
+                        const char *b, unsigned long blen )
+{
+	unsigned long len = (alen < blen)? alen : blen;
+	unsigned long i = common_prefix( a, b, len );
+
+	if ( i < len ){
+		return ((unsigned char)a[i] < (unsigned char)b[i])? -1 : 1;
+	}
+
+	return (alen < blen)? -1 : (alen > blen);
+}
+
+// Looks for the first byte of `pat` a word at a time, and only compares
+// the rest where it turns up.
+const char *minift_str_search( const char *str, unsigned long len,
+                               const char *pat, unsigned long patlen )
+{
+	if ( patlen == 0 ){
+		return str;
+	}
+
+	if ( patlen > len ){
+		return NULL;
+	}
+
+	unsigned long last = len - patlen;
+	word_t first = WORD_ONES * (unsigned char)pat[0];
+
+	for ( unsigned long i = 0; i <= last; ){
+		if ( is_aligned( str + i ) && i + WORD_SIZE <= last + 1
+		  && !has_zero( *(const word_t *)(str + i) ^ first ))
+		{
+			i += WORD_SIZE;
+			continue;
+		}
+
+		if ( str[i] == pat[0] && minift_str_equal( str + i, pat, patlen )){
+			return str + i;
+		}
+
+		i++;
+	}
+
+	return NULL;
+}
+
+// What minift_str_scan() and minift_str_skip() stop at. Input is parsed
+// a line at a time, so both stop at a newline whatever they're looking
+// for, and a space delimiter stands for any space or control character.
+enum {
+	STOP_AT_DELIM,
+	STOP_AT_BLANK,
+	STOP_PAST_DELIM,
+	STOP_PAST_BLANK,
+};
+
+static always_inline bool byte_stops( unsigned char c, unsigned mode, unsigned char delim ){
+	switch ( mode ){
+		case STOP_AT_DELIM:   return c == delim || c == '\n';
+		case STOP_AT_BLANK:   return c <= ' ';
+		case STOP_PAST_DELIM: return c != delim || c == '\n';
+		default:              return c > ' ' || c == '\n';
+	}
+}
+
+// Whether any byte in `x` stops the scan, with `delim` in every byte.
+// Blanks are found the same way as zero bytes, by checking for bytes
+// less than 0x21, and anything else by adding 0x5f to each byte so that
+// bytes over 0x20 carry into the high bit.
+static always_inline word_t word_stops( word_t x, unsigned mode, word_t delim ){
+	word_t newline = has_zero( x ^ (WORD_ONES * '\n') );
+
+	switch ( mode ){
+		case STOP_AT_DELIM:   return has_zero( x ^ delim ) | newline;
+		case STOP_AT_BLANK:   return (x - WORD_ONES * 0x21) & ~x & WORD_HIGHS;
+		case STOP_PAST_DELIM: return (x ^ delim) | newline;
+		default:              return (((x + WORD_ONES * 0x5f) | x) & WORD_HIGHS) | newline;
+	}
+}
+
+// inlined so that each caller gets a copy with the mode's checks only
+static always_inline const char *scan( const char *str, unsigned long len,
+                                       unsigned mode, char delim )
+{
+	word_t delims = WORD_ONES * (unsigned char)delim;
+	unsigned long i = 0;
+
+	for ( ; i < len && !is_aligned( str + i ); i++ ){
+		if ( byte_stops( str[i], mode, delim )){
+			return str + i;
+		}
+	}
+
+	// two words at a time, so there's only one branch for both
+	for ( ; i + 2 * WORD_SIZE <= len; i += 2 * WORD_SIZE ){
+		const word_t *words = (const word_t *)(str + i);
+
+		if ( word_stops( words[0], mode, delims )
+		   | word_stops( words[1], mode, delims ))
+		{
+			break;
+		}
+	}
+
+	for ( ; i < len; i++ ){
+		if ( byte_stops( str[i], mode, delim )){
+			break;
+		}
+	}
+
+	return str + i;
+}
+
+// Returns the first `delim` or newline in the string, or the end of it.
+const char *minift_str_scan( const char *str, unsigned long len, char delim ){
+	return scan( str, len, (delim == ' ')? STOP_AT_BLANK : STOP_AT_DELIM, delim );
+}
+
+// Returns the first character that isn't `delim`, or is a newline, or the
+// end of the string.
+const char *minift_str_skip( const char *str, unsigned long len, char delim ){
+	return scan( str, len, (delim == ' ')? STOP_PAST_BLANK : STOP_PAST_DELIM, delim );
+}
+
+// Same hash as minift_hash(), so a string can be used to look up a word.
+// Each step depends on the last so there's no doing this a word at a time.
+minift_cell_t minift_str_hash( const char *str, unsigned long len ){
+	minift_cell_t hash = 757;
+
+	for ( unsigned long i = 0; i < len; i++ ){
+		hash = (hash << 7) + hash + str[i];
+	}
+
+	return hash;
+}
+
+static inline void *align_cell( void *ptr ){
+	uintptr_t temp = (uintptr_t)ptr;
+	uintptr_t size = sizeof(minift_cell_t);
+
+	return (void *)((temp + size - 1) & ~(size - 1));
+}
+
+// Sets up a pool in `mem`, and makes the vm intern string literals in it.
+// A small hash table at the start of the pool is sized to fit.
+bool minift_strpool_init( minift_vm_t *vm,
+                          minift_strpool_t *pool,
+                          void *mem,
+                          unsigned long size )
+{
+	uint8_t *start = align_cell( mem );
+	uint8_t *end   = (uint8_t *)mem + size;
+	unsigned bits  = 4;
+
+	while ( bits < 12 && (512ul << bits) <= size ){
+		bits++;
+	}
+
+	unsigned long table = sizeof(minift_string_t *) << bits;
+
+	if ( end < start || (unsigned long)(end - start) < table ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "string pool too small" );
+		return false;
+	}
+
+	pool->buckets     = (void *)start;
+	pool->bucket_bits = bits;
+	pool->ptr         = start + table;
+	pool->end         = end;
+
+	for ( unsigned i = 0; i < (1u << bits); i++ ){
+		pool->buckets[i] = NULL;
+	}
+
+	vm->strings = pool;
+
+	return true;
+}
+
+// Returns the interned copy of a string, or NULL if the pool is full.
+const char *minift_intern( minift_vm_t *vm, const char *str, unsigned long len ){
+	minift_strpool_t *pool = vm->strings;
+	minift_cell_t hash = minift_str_hash( str, len );
+	unsigned slot = minift_phash_slot( hash, 2654435761u, pool->bucket_bits );
+	minift_string_t *ent = pool->buckets[slot];
+
+	for ( ; ent; ent = ent->next ){
+		if ( ent->hash == hash && ent->length == len
+		  && minift_str_equal( ent->text, str, len ))
+		{
+			return ent->text;
+		}
+	}
+
+	unsigned long size = sizeof(minift_string_t) + len + 1;
+
+	if ( pool->ptr + size > pool->end ){
+		return NULL;
+	}
+
+	ent = (void *)pool->ptr;
+	pool->ptr = align_cell( pool->ptr + size );
+
+	ent->hash   = hash;
+	ent->length = len;
+
+	for ( unsigned long i = 0; i < len; i++ ){
+		ent->text[i] = str[i];
+	}
+
+	ent->text[len] = '\0';
+	ent->next = pool->buckets[slot];
+	pool->buckets[slot] = ent;
+
+	return ent->text;
+}
+
+// Returns the pool entry for `str` if it's the text of an interned string,
+// or NULL if it's anywhere else.
+minift_string_t *minift_strpool_entry( minift_vm_t *vm, const char *str ){
+	minift_strpool_t *pool = vm->strings;
+	uint8_t *ptr = (uint8_t *)str;
+
+	if ( !pool || ptr < (uint8_t *)(pool->buckets + (1u << pool->bucket_bits))
+	  || ptr >= pool->ptr )
+	{
+		return NULL;
+	}
+
+	// what would be the header is still inside the pool, so it can be
+	// read, but it's only trusted if it's in the bucket it says it is
+	minift_string_t *ent = (void *)(ptr - sizeof(minift_string_t));
+	unsigned slot = minift_phash_slot( ent->hash, 2654435761u, pool->bucket_bits );
+
+	for ( minift_string_t *temp = pool->buckets[slot]; temp; temp = temp->next ){
+		if ( temp == ent ){
+			return ent;
+		}
+	}
+
+	return NULL;
+}
@@ -1,5 +1,4 @@
-#include <stdbool.h>
-#include <miniforth/stubs.h>
+#include <miniforth/miniforth.h>
 
 const char *hex_table = "0123456789abcdef";
 
@@ -69,8 +68,9 @@ char minift_lowercase( char c ){
 	return c;
 }
 
-void minift_print_int( unsigned long n ){
-	char buf[32];
+void minift_print_int( minift_cell_t n ){
+	// enough for the digits of any cell
+	char buf[sizeof(minift_cell_t) * 3];
 	unsigned i = 0;
 
 	if ( n == 0 ){
@@ -87,8 +87,8 @@ void minift_print_int( unsigned long n ){
 	}
 }
 
-void minift_print_hex( unsigned long n ){
-	char buf[32];
+void minift_print_hex( minift_cell_t n ){
+	char buf[sizeof(minift_cell_t) * 2];
 	unsigned i = 0;
 
 	if ( n == 0 ){
@@ -0,0 +1,6 @@
+# the evaluation server runs requests on worker threads
+CFLAGS  += -pthread
+LDFLAGS += -pthread
+
+# `--perf` with `--profile` counts each word through the vm's trace hook
+CFLAGS  += -DMINIFT_TRACE=1
@@ -0,0 +1,441 @@
+#define _POSIX_C_SOURCE 200809L
+#include <miniforth/miniforth.h>
+#include "par.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+// Parallel array words
+//
+// `par-map` and `par-reduce` run a word over every cell of an array on a
+// pool of worker threads started with par_start():
+//
+//   : sq dup * ;          buf 1000 ' sq par-map
+//   : add + ;             buf 1000 0 ' add par-reduce .
+//
+// `par-map ( addr len xt -- )` replaces each cell x with `x xt`, and
+// `par-reduce ( addr len init xt -- x )` folds the array with `acc x xt`,
+// starting from `init`. The array is split into chunks, each chunk is
+// folded separately starting from `init`, and then the results for the
+// chunks are folded in order, so `xt` has to be associative with `init`
+// as it's identity for the result to be what a plain loop would give.
+// How the array is chunked only depends on it's length, so the result is
+// the same no matter how many workers there are or which runs what.
+//
+// Each worker runs the word in it's own vm, with private stacks and data
+// space, that looks words up in the calling vm's dictionary. The calling
+// vm is blocked until every chunk is done, so nothing in the dictionary
+// changes underneath them, but the word shouldn't define anything or
+// write anywhere but its own element. It can't use `par-map` or
+// `par-reduce` itself either, since the pool is already busy with the
+// outer job, so doing that fails the job with a recoverable error.
+//
+// Each worker starts with an even share of the chunks, taking them from
+// the front of it's share, and once that runs out steals from the back
+// of the others' shares.
+
+enum {
+	PAR_MAX_CHUNKS  = 256,
+	PAR_DATA_CELLS  = 1024,
+	PAR_STACK_CELLS = 256,
+};
+
+typedef struct par_job {
+	minift_vm_t      *vm;
+	minift_cell_t    *data;
+	minift_cell_t     len;
+	minift_cell_t     word;
+	minift_cell_t     init;
+	bool              reduce;
+	unsigned          chunks;
+	atomic_bool       failed;
+	minift_cell_t     partial[PAR_MAX_CHUNKS];
+} par_job_t;
+
+typedef struct par_worker {
+	pthread_t         thread;
+
+	// chunks left in this worker's share, the first in the low half and
+	// one past the last in the high half, so both ends can be taken from
+	// with a single compare and swap
+	_Atomic uint64_t  range;
+
+	minift_cell_t     data[PAR_DATA_CELLS];
+	minift_cell_t     calls[PAR_STACK_CELLS];
+	minift_cell_t     params[PAR_STACK_CELLS];
+	minift_vm_t       vm;
+} par_worker_t;
+
+static struct {
+	// held by whichever vm is running a job, for the whole job
+	pthread_mutex_t   submit;
+
+	pthread_mutex_t   lock;
+	pthread_cond_t    start;
+	pthread_cond_t    done;
+	par_job_t        *job;
+	unsigned long     generation;
+	unsigned          busy;
+
+	par_worker_t     *workers;
+	unsigned          count;
+} pool = {
+	.submit = PTHREAD_MUTEX_INITIALIZER,
+	.lock   = PTHREAD_MUTEX_INITIALIZER,
+	.start  = PTHREAD_COND_INITIALIZER,
+	.done   = PTHREAD_COND_INITIALIZER,
+};
+
+// set on threads running part of a job, workers always and the calling
+// thread while it folds the chunks
+static _Thread_local bool in_job;
+
+static inline uint64_t make_range( uint32_t first, uint32_t last ){
+	return first | ((uint64_t)last << 32);
+}
+
+static bool take_front( par_worker_t *w, unsigned *chunk ){
+	uint64_t range = atomic_load( &w->range );
+
+	for (;;){
+		uint32_t first = range, last = range >> 32;
+
+		if ( first >= last ){
+			return false;
+		}
+
+		if ( atomic_compare_exchange_weak( &w->range, &range,
+		                                   make_range( first + 1, last ))){
+			*chunk = first;
+			return true;
+		}
+	}
+}
+
+static bool take_back( par_worker_t *w, unsigned *chunk ){
+	uint64_t range = atomic_load( &w->range );
+
+	for (;;){
+		uint32_t first = range, last = range >> 32;
+
+		if ( first >= last ){
+			return false;
+		}
+
+		if ( atomic_compare_exchange_weak( &w->range, &range,
+		                                   make_range( first, last - 1 ))){
+			*chunk = last - 1;
+			return true;
+		}
+	}
+}
+
+// Points the worker's vm at the calling vm's dictionary, with everything
+// it could write to being it's own.
+static void setup_vm( par_worker_t *w, minift_vm_t *src ){
+	minift_vm_t *vm = &w->vm;
+
+	*vm = *src;
+
+	vm->data_stack  = (minift_stack_t){ w->data, w->data + PAR_DATA_CELLS, w->data };
+	vm->call_stack  = (minift_stack_t){ w->calls, w->calls + PAR_STACK_CELLS, w->calls };
+	vm->param_stack = (minift_stack_t){ w->params, w->params + PAR_STACK_CELLS, w->params };
+	vm->data_base   = w->data;
+
+#if MINIFT_MEMSTATS
+	vm->data_stack.peak  = vm->data_stack.ptr;
+	vm->call_stack.peak  = vm->call_stack.ptr;
+	vm->param_stack.peak = vm->param_stack.ptr;
+#endif
+
+	vm->ip             = NULL;
+	vm->running        = true;
+	vm->compiling      = false;
+	vm->error          = false;
+	vm->task           = &vm->main_task;
+	vm->main_task.next = &vm->main_task;
+	vm->free_tasks     = NULL;
+	vm->task_budget    = 0;
+	vm->token_handler  = NULL;
+	vm->token_task     = NULL;
+	vm->waiting        = false;
+	vm->reader.ptr     = NULL;
+	vm->reader.end     = NULL;
+	vm->reader.state   = MINIFT_READ_SKIP;
+
+	// none of these are safe to share between threads
+	vm->strings = NULL;
+	vm->persist = NULL;
+	vm->blocks  = NULL;
+	vm->lines   = NULL;
+	vm->trace   = NULL;
+
+	if ( src->archives == &src->base_archive ){
+		vm->archives = &vm->base_archive;
+	}
+}
+
+// Runs `word` to completion, with whatever arguments are on the stack.
+static bool call_word( minift_vm_t *vm, minift_cell_t word ){
+	minift_exec_word( vm, word );
+
+	while ( vm->ip && vm->running && !vm->error && !vm->waiting ){
+		minift_step( vm );
+	}
+
+	if ( vm->waiting ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "can't read input in parallel" );
+	}
+
+	return vm->running && !vm->error;
+}
+
+static bool run_chunk( minift_vm_t *vm, par_job_t *job, unsigned chunk ){
+	minift_cell_t start = job->len * chunk / job->chunks;
+	minift_cell_t end   = job->len * (chunk + 1) / job->chunks;
+	minift_cell_t acc   = job->init;
+
+	for ( minift_cell_t i = start; i < end; i++ ){
+		vm->param_stack.ptr = vm->param_stack.start;
+
+		if ( job->reduce ){
+			minift_push( vm, &vm->param_stack, acc );
+		}
+
+		minift_push( vm, &vm->param_stack, job->data[i] );
+
+		if ( !call_word( vm, job->word )){
+			return false;
+		}
+
+		minift_cell_t result = minift_pop( vm, &vm->param_stack );
+
+		if ( vm->error ){
+			return false;
+		}
+
+		if ( job->reduce ){
+			acc = result;
+
+		} else {
+			job->data[i] = result;
+		}
+	}
+
+	job->partial[chunk] = acc;
+
+	return true;
+}
+
+static void run_share( par_worker_t *w, par_job_t *job ){
+	unsigned index = w - pool.workers;
+	unsigned chunk;
+
+	setup_vm( w, job->vm );
+
+	for (;;){
+		bool found = take_front( w, &chunk );
+
+		for ( unsigned i = 1; !found && i < pool.count; i++ ){
+			found = take_back( pool.workers + (index + i) % pool.count, &chunk );
+		}
+
+		if ( !found ){
+			break;
+		}
+
+		// the rest of the chunks still get taken, so everyone finishes
+		if ( !atomic_load( &job->failed ) && !run_chunk( &w->vm, job, chunk )){
+			atomic_store( &job->failed, true );
+		}
+	}
+}
+
+static void *worker_main( void *arg ){
+	par_worker_t *w = arg;
+	unsigned long seen = 0;
+
+	in_job = true;
+
+	for (;;){
+		pthread_mutex_lock( &pool.lock );
+
+		while ( pool.generation == seen ){
+			pthread_cond_wait( &pool.start, &pool.lock );
+		}
+
+		seen = pool.generation;
+		par_job_t *job = pool.job;
+		pthread_mutex_unlock( &pool.lock );
+
+		run_share( w, job );
+
+		pthread_mutex_lock( &pool.lock );
+
+		if ( --pool.busy == 0 ){
+			pthread_cond_signal( &pool.done );
+		}
+
+		pthread_mutex_unlock( &pool.lock );
+	}
+
+	return NULL;
+}
+
+static bool run_job( minift_vm_t *vm, par_job_t *job ){
+	job->vm     = vm;
+	job->chunks = (job->len < PAR_MAX_CHUNKS)? job->len : PAR_MAX_CHUNKS;
+	atomic_init( &job->failed, false );
+
+	if ( in_job ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "can't nest parallel words" );
+		return false;
+	}
+
+	if ( job->len == 0 ){
+		job->partial[0] = job->init;
+		return true;
+	}
+
+	pthread_mutex_lock( &pool.submit );
+
+	for ( unsigned i = 0; i < pool.count; i++ ){
+		uint32_t first = job->chunks * i / pool.count;
+		uint32_t last  = job->chunks * (i + 1) / pool.count;
+
+		atomic_store( &pool.workers[i].range, make_range( first, last ));
+	}
+
+	pthread_mutex_lock( &pool.lock );
+	pool.job  = job;
+	pool.busy = pool.count;
+	pool.generation++;
+	pthread_cond_broadcast( &pool.start );
+
+	while ( pool.busy ){
+		pthread_cond_wait( &pool.done, &pool.lock );
+	}
+
+	pthread_mutex_unlock( &pool.lock );
+
+	bool ok = !atomic_load( &job->failed );
+
+	// fold the chunks together in order, in the first worker's vm since
+	// they're all idle now
+	if ( ok && job->reduce ){
+		minift_vm_t *wvm = &pool.workers[0].vm;
+		minift_cell_t acc = job->init;
+
+		in_job = true;
+
+		for ( unsigned i = 0; ok && i < job->chunks; i++ ){
+			wvm->param_stack.ptr = wvm->param_stack.start;
+			minift_push( wvm, &wvm->param_stack, acc );
+			minift_push( wvm, &wvm->param_stack, job->partial[i] );
+
+			ok = call_word( wvm, job->word );
+			acc = minift_pop( wvm, &wvm->param_stack );
+			ok = ok && !wvm->error;
+		}
+
+		job->partial[0] = acc;
+		in_job = false;
+	}
+
+	pthread_mutex_unlock( &pool.submit );
+
+	if ( !ok ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "parallel word failed" );
+	}
+
+	return ok;
+}
+
+static inline bool have_args( minift_vm_t *vm, unsigned count ){
+	if ( vm->param_stack.ptr - vm->param_stack.start < count ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "reached beginning of stack" );
+		return false;
+	}
+
+	return true;
+}
+
+static inline bool pop_array( minift_vm_t *vm, par_job_t *job ){
+	job->len  = minift_pop( vm, &vm->param_stack );
+	job->data = (minift_cell_t *)minift_pop( vm, &vm->param_stack );
+
+	if ( (uintptr_t)job->data & (sizeof(minift_cell_t) - 1) ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "misaligned array" );
+		return false;
+	}
+
+	return true;
+}
+
+static bool par_map( minift_vm_t *vm ){
+	par_job_t job;
+
+	if ( !have_args( vm, 3 )){
+		return false;
+	}
+
+	job.word   = minift_pop( vm, &vm->param_stack );
+	job.init   = 0;
+	job.reduce = false;
+
+	return pop_array( vm, &job ) && run_job( vm, &job );
+}
+
+static bool par_reduce( minift_vm_t *vm ){
+	par_job_t job;
+
+	if ( !have_args( vm, 4 )){
+		return false;
+	}
+
+	job.word   = minift_pop( vm, &vm->param_stack );
+	job.init   = minift_pop( vm, &vm->param_stack );
+	job.reduce = true;
+
+	if ( !pop_array( vm, &job ) || !run_job( vm, &job )){
+		return false;
+	}
+
+	minift_push( vm, &vm->param_stack, job.partial[0] );
+
+	return true;
+}
+
+static minift_arc_ent_t par_entries[] = {
+	{ "par-map",    par_map,    0 },
+	{ "par-reduce", par_reduce, 0 },
+};
+
+static minift_archive_t par_archive = {
+	.name    = "par",
+	.entries = par_entries,
+	.size    = sizeof(par_entries) / sizeof(minift_arc_ent_t),
+};
+
+// Starts `workers` threads, and adds `par-map` and `par-reduce` to the vm.
+bool par_start( minift_vm_t *vm, unsigned workers ){
+	pool.workers = calloc( workers, sizeof(par_worker_t) );
+	pool.count   = workers;
+
+	if ( !pool.workers ){
+		return false;
+	}
+
+	for ( unsigned i = 0; i < workers; i++ ){
+		par_worker_t *w = pool.workers + i;
+
+		if ( pthread_create( &w->thread, NULL, worker_main, w )){
+			return false;
+		}
+	}
+
+	minift_archive_add( vm, &par_archive );
+
+	return true;
+}
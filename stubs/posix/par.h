@@ -0,0 +1,7 @@
+#ifndef _MINIFORTH_POSIX_PAR_H
+#define _MINIFORTH_POSIX_PAR_H 1
+#include <miniforth/miniforth.h>
+
+bool par_start( minift_vm_t *vm, unsigned workers );
+
+#endif
@@ -0,0 +1,413 @@
+#define _DEFAULT_SOURCE
+#include <miniforth/miniforth.h>
+#include "perf.h"
+#include "profile.h"
+#include <linux/perf_event.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Performance counters
+//
+// With --perf, a group of perf_event_open() counters is opened for the
+// main thread and enabled only while the vm runs, around each call to
+// minift_run_for(). The totals are printed when the stub exits, along
+// with instructions per cycle and how often branches and cache
+// references missed. Only user space is counted, and work done on other
+// threads, like --par workers, isn't.
+//
+// With --profile as well, the counters are read before every step
+// through the vm's trace hook, and what was counted since the last step
+// is added to the word that step ran. That gives the cost of dispatching
+// and running each word, with steps that read input counted as
+// "[interpreter]". Each read is a system call, so this runs much slower,
+// and the user space part of a read, measured when the counters are
+// opened, is taken off every step.
+//
+// Counters that can't be opened, because there's no PMU (as in most
+// VMs) or perf_event_paranoid doesn't allow it, are left out and shown
+// as "-". If none can be, --perf says so and the stub carries on as usual.
+
+enum {
+	EV_CYCLES,
+	EV_INSTRUCTIONS,
+	EV_BRANCHES,
+	EV_BRANCH_MISSES,
+	EV_CACHE_REFS,
+	EV_CACHE_MISSES,
+	EV_TASK_CLOCK,
+	EV_COUNT,
+};
+
+enum {
+	PERF_WORDS     = 1024,
+	PERF_CALIBRATE = 32,
+};
+
+static const struct {
+	const char *name;
+	uint32_t    type;
+	uint64_t    config;
+} events[EV_COUNT] = {
+	[EV_CYCLES]        = { "cycles",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[EV_INSTRUCTIONS]  = { "instructions",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[EV_BRANCHES]      = { "branches",         PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+	[EV_BRANCH_MISSES] = { "branch-misses",    PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	[EV_CACHE_REFS]    = { "cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES },
+	[EV_CACHE_MISSES]  = { "cache-misses",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	[EV_TASK_CLOCK]    = { "task-clock",       PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+};
+
+// layout of a read() from the group leader
+typedef struct group_read {
+	uint64_t nr;
+	uint64_t time_enabled;
+	uint64_t time_running;
+	uint64_t values[EV_COUNT];
+} group_read_t;
+
+typedef struct perf_word {
+	minift_cell_t word;
+	bool          used;
+	unsigned long dispatches;
+	uint64_t      counts[EV_COUNT];
+} perf_word_t;
+
+static int leader = -1;
+
+// where each event is in the group's values, or -1 if it isn't open
+static int slots[EV_COUNT];
+
+static uint64_t overhead[EV_COUNT];
+static uint64_t last[EV_COUNT];
+
+static perf_word_t *words;
+static perf_word_t  other_words;
+static perf_word_t *current;
+
+static int open_event( unsigned ev, int group ){
+	struct perf_event_attr attr;
+
+	memset( &attr, 0, sizeof(attr) );
+	attr.size           = sizeof(attr);
+	attr.type           = events[ev].type;
+	attr.config         = events[ev].config;
+	attr.disabled       = group < 0;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv     = 1;
+	attr.read_format    = PERF_FORMAT_GROUP
+	                    | PERF_FORMAT_TOTAL_TIME_ENABLED
+	                    | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	return syscall( SYS_perf_event_open, &attr, 0, -1, group, 0 );
+}
+
+static bool read_group( group_read_t *group ){
+	return read( leader, group, sizeof(*group) ) >= (ssize_t)(3 * sizeof(uint64_t));
+}
+
+static bool read_counters( uint64_t *counts ){
+	group_read_t group;
+
+	if ( !read_group( &group )){
+		return false;
+	}
+
+	for ( unsigned ev = 0; ev < EV_COUNT; ev++ ){
+		counts[ev] = (slots[ev] >= 0)? group.values[slots[ev]] : 0;
+	}
+
+	return true;
+}
+
+static perf_word_t *find_word( minift_cell_t word ){
+	unsigned long start = (unsigned long)word * 2654435761ul;
+
+	for ( unsigned i = 0; i < PERF_WORDS; i++ ){
+		perf_word_t *ent = words + (start + i) % PERF_WORDS;
+
+		if ( !ent->used ){
+			ent->used = true;
+			ent->word = word;
+			return ent;
+		}
+
+		if ( ent->word == word ){
+			return ent;
+		}
+	}
+
+	return &other_words;
+}
+
+// charges what was counted since the last step to the word it ran
+static void perf_trace( minift_vm_t *vm, minift_cell_t word ){
+	uint64_t now[EV_COUNT];
+
+	if ( !read_counters( now )){
+		return;
+	}
+
+	for ( unsigned ev = 0; current && ev < EV_COUNT; ev++ ){
+		uint64_t delta = now[ev] - last[ev];
+
+		current->counts[ev] += (delta > overhead[ev])? delta - overhead[ev] : 0;
+	}
+
+	current = find_word( word );
+	current->dispatches++;
+	memcpy( last, now, sizeof(last) );
+}
+
+// the least that's counted between two reads, with nothing in between
+static void calibrate( void ){
+	uint64_t a[EV_COUNT], b[EV_COUNT];
+
+	for ( unsigned ev = 0; ev < EV_COUNT; ev++ ){
+		overhead[ev] = UINT64_MAX;
+	}
+
+	ioctl( leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+
+	for ( unsigned i = 0; i < PERF_CALIBRATE; i++ ){
+		if ( !read_counters( a ) || !read_counters( b )){
+			break;
+		}
+
+		for ( unsigned ev = 0; ev < EV_COUNT; ev++ ){
+			uint64_t delta = b[ev] - a[ev];
+			overhead[ev] = (delta < overhead[ev])? delta : overhead[ev];
+		}
+	}
+
+	ioctl( leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP );
+	ioctl( leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP );
+
+	for ( unsigned ev = 0; ev < EV_COUNT; ev++ ){
+		overhead[ev] = (overhead[ev] == UINT64_MAX)? 0 : overhead[ev];
+	}
+}
+
+// Opens what counters it can, and with `per_word`, sets the vm's trace
+// hook to count each word. Returns false if there aren't any.
+bool perf_start( minift_vm_t *vm, bool per_word ){
+	int first_error = 0;
+	int count = 0;
+
+	for ( unsigned ev = 0; ev < EV_COUNT; ev++ ){
+		int fd = open_event( ev, leader );
+
+		slots[ev] = -1;
+
+		if ( fd < 0 ){
+			first_error = first_error? first_error : errno;
+			continue;
+		}
+
+		leader = (leader < 0)? fd : leader;
+		slots[ev] = count++;
+	}
+
+	if ( leader < 0 ){
+		fprintf( stderr, "perf: no counters available (%s), carrying on without\n",
+		         strerror( first_error ));
+		return false;
+	}
+
+	calibrate( );
+
+#if !MINIFT_TRACE
+	if ( per_word ){
+		fprintf( stderr, "perf: built without MINIFT_TRACE, not counting each word\n" );
+		per_word = false;
+	}
+#endif
+
+	if ( per_word ){
+		// with a row spare for the overflow, when they're sorted
+		words = calloc( PERF_WORDS + 1, sizeof(perf_word_t) );
+		vm->trace = words? perf_trace : NULL;
+	}
+
+	return true;
+}
+
+void perf_resume( void ){
+	if ( leader >= 0 ){
+		ioctl( leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP );
+	}
+}
+
+void perf_pause( void ){
+	if ( leader >= 0 ){
+		ioctl( leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP );
+	}
+}
+
+static bool have( unsigned ev ){
+	return slots[ev] >= 0;
+}
+
+// prints `num / den` scaled by `scale` in a column, or "-" if either
+// counter is missing
+static void print_ratio( FILE *fp, int width, const char *format,
+                         uint64_t num, uint64_t den, bool ok, double scale )
+{
+	if ( !ok || den == 0 ){
+		fprintf( fp, " %*s", width, "-" );
+		return;
+	}
+
+	fprintf( fp, format, width, scale * (double)num / (double)den );
+}
+
+static void print_totals( FILE *fp, group_read_t *group ){
+	uint64_t counts[EV_COUNT];
+	double scale = 1.0;
+
+	for ( unsigned ev = 0; ev < EV_COUNT; ev++ ){
+		counts[ev] = have( ev )? group->values[slots[ev]] : 0;
+	}
+
+	// counters that had to share the PMU with others only ran part of
+	// the time, so they're scaled up to estimate the whole run
+	if ( group->time_running && group->time_running < group->time_enabled ){
+		scale = (double)group->time_enabled / (double)group->time_running;
+
+		for ( unsigned ev = 0; ev < EV_COUNT; ev++ ){
+			counts[ev] *= scale;
+		}
+	}
+
+	fprintf( fp, "perf: counted while the vm ran%s\n",
+	         (scale > 1.0)? ", scaled for multiplexing" : "" );
+
+	for ( unsigned ev = 0; ev < EV_COUNT; ev++ ){
+		if ( !have( ev )){
+			fprintf( fp, "%16s  %s\n", "-", events[ev].name );
+
+		} else if ( ev == EV_TASK_CLOCK ){
+			fprintf( fp, "%16.2f  %s (ms)\n", counts[ev] / 1e6, events[ev].name );
+
+		} else {
+			fprintf( fp, "%16llu  %s", (unsigned long long)counts[ev],
+			         events[ev].name );
+
+			if ( ev == EV_INSTRUCTIONS && have( EV_CYCLES ) && counts[EV_CYCLES] ){
+				fprintf( fp, ", %.2f per cycle",
+				         (double)counts[ev] / counts[EV_CYCLES] );
+
+			} else if ( ev == EV_BRANCH_MISSES && have( EV_BRANCHES ) && counts[EV_BRANCHES] ){
+				fprintf( fp, ", %.2f%% of branches",
+				         100.0 * counts[ev] / counts[EV_BRANCHES] );
+
+			} else if ( ev == EV_CACHE_MISSES && have( EV_CACHE_REFS ) && counts[EV_CACHE_REFS] ){
+				fprintf( fp, ", %.2f%% of references",
+				         100.0 * counts[ev] / counts[EV_CACHE_REFS] );
+			}
+
+			fputc( '\n', fp );
+		}
+	}
+}
+
+static const char *word_name( minift_vm_t *vm, minift_cell_t word, char *buf,
+                              size_t size )
+{
+	if ( !word ){
+		return "[interpreter]";
+	}
+
+	if ( !minift_define_lookup( vm, word )){
+		minift_arc_ent_t *ent = minift_archive_lookup( vm, word );
+
+		if ( ent ){
+			return ent->name;
+		}
+
+	} else if ( profile_name( word )){
+		return profile_name( word );
+	}
+
+	snprintf( buf, size, "0x%llx", (unsigned long long)word );
+	return buf;
+}
+
+// busiest first, by cycles if there are any or else time
+static int compare_words( const void *a, const void *b ){
+	unsigned ev = have( EV_CYCLES )? EV_CYCLES : EV_TASK_CLOCK;
+	uint64_t x = ((const perf_word_t *)a)->counts[ev];
+	uint64_t y = ((const perf_word_t *)b)->counts[ev];
+
+	return (x < y) - (x > y);
+}
+
+static void print_words( minift_vm_t *vm, FILE *fp ){
+	unsigned count = 0;
+
+	for ( unsigned i = 0; i < PERF_WORDS; i++ ){
+		if ( words[i].used ){
+			words[count++] = words[i];
+		}
+	}
+
+	if ( other_words.dispatches ){
+		words[count++] = other_words;
+	}
+
+	qsort( words, count, sizeof(perf_word_t), compare_words );
+
+	fprintf( fp, "\nperf: per dispatch, less what reading the counters costs\n" );
+	fprintf( fp, "%-16s %12s %10s %10s %6s %9s %10s %9s\n",
+	         "word", "dispatches", "cycles", "insns", "IPC",
+	         "br-miss%", "cache-miss", "ns" );
+
+	for ( unsigned i = 0; i < count; i++ ){
+		perf_word_t *w = words + i;
+		uint64_t *c = w->counts;
+		char buf[32];
+
+		// only the overflow row isn't marked as used
+		fprintf( fp, "%-16s %12lu",
+		         w->used? word_name( vm, w->word, buf, sizeof(buf) ) : "[other]",
+		         w->dispatches );
+
+		print_ratio( fp, 10, " %*.1f", c[EV_CYCLES], w->dispatches, have( EV_CYCLES ), 1 );
+		print_ratio( fp, 10, " %*.1f", c[EV_INSTRUCTIONS], w->dispatches,
+		             have( EV_INSTRUCTIONS ), 1 );
+		print_ratio( fp, 6, " %*.2f", c[EV_INSTRUCTIONS], c[EV_CYCLES],
+		             have( EV_INSTRUCTIONS ) && have( EV_CYCLES ), 1 );
+		print_ratio( fp, 9, " %*.2f", c[EV_BRANCH_MISSES], c[EV_BRANCHES],
+		             have( EV_BRANCH_MISSES ) && have( EV_BRANCHES ), 100 );
+		print_ratio( fp, 10, " %*.3f", c[EV_CACHE_MISSES], w->dispatches,
+		             have( EV_CACHE_MISSES ), 1 );
+		print_ratio( fp, 9, " %*.1f", c[EV_TASK_CLOCK], w->dispatches,
+		             have( EV_TASK_CLOCK ), 1 );
+		fputc( '\n', fp );
+	}
+}
+
+// Prints the totals, and the counts for each word if they were kept.
+void perf_report( minift_vm_t *vm, FILE *fp ){
+	group_read_t group;
+
+	if ( leader < 0 || !read_group( &group )){
+		return;
+	}
+
+	// the last step ran up to here
+	if ( words ){
+		perf_trace( vm, 0 );
+		vm->trace = NULL;
+	}
+
+	print_totals( fp, &group );
+
+	if ( words ){
+		print_words( vm, fp );
+	}
+}
@@ -0,0 +1,11 @@
+#ifndef _MINIFORTH_POSIX_PERF_H
+#define _MINIFORTH_POSIX_PERF_H 1
+#include <miniforth/miniforth.h>
+#include <stdio.h>
+
+bool perf_start( minift_vm_t *vm, bool per_word );
+void perf_resume( void );
+void perf_pause( void );
+void perf_report( minift_vm_t *vm, FILE *fp );
+
+#endif
@@ -0,0 +1,327 @@
+#define _POSIX_C_SOURCE 200809L
+#include <miniforth/miniforth.h>
+#include <miniforth/code.h>
+#include "profile.h"
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+// Sampling profiler
+//
+// A SIGPROF timer samples the running task's ip and call stack. Samples
+// are only counted in the signal handler, keyed by the raw addresses, and
+// turned into definitions once profiling is done, so the handler doesn't
+// have to look at anything that might be halfway through changing.
+//
+// Definitions only have hashes, so names are picked up from the input as
+// it's read, and anything not found that way is written as a hash.
+
+enum {
+	PROF_DEPTH   = 16,
+	PROF_ENTRIES = 4096,
+	PROF_NAMES   = 1024,
+};
+
+typedef struct prof_entry {
+	unsigned long count;
+	unsigned      depth;
+
+	// return addresses from the call stack, innermost last, then the ip
+	minift_cell_t frames[PROF_DEPTH + 1];
+
+	// the word at ip, for builtins
+	minift_cell_t word;
+} prof_entry_t;
+
+typedef struct prof_name {
+	minift_cell_t hash;
+	char          name[MINIFT_MAX_WORDSIZE];
+} prof_name_t;
+
+static prof_entry_t entries[PROF_ENTRIES];
+static prof_name_t  names[PROF_NAMES];
+static unsigned     name_count;
+
+static minift_vm_t * volatile prof_vm;
+static volatile unsigned long prof_dropped;
+
+static inline unsigned long hash_sample( minift_cell_t *frames,
+                                         unsigned depth,
+                                         minift_cell_t word )
+{
+	unsigned long hash = 2166136261ul;
+
+	for ( unsigned i = 0; i < depth; i++ ){
+		hash = (hash ^ frames[i]) * 16777619ul;
+	}
+
+	return (hash ^ word) * 16777619ul;
+}
+
+static void on_sigprof( int sig ){
+	minift_vm_t *vm = prof_vm;
+	minift_cell_t frames[PROF_DEPTH + 1];
+	minift_cell_t word = 0;
+	unsigned depth = 0;
+
+	if ( !vm ){
+		return;
+	}
+
+	// the stack pointers can be caught in the middle of a task switch,
+	// so don't trust them too far
+	minift_cell_t *start = vm->call_stack.start;
+	minift_cell_t *ptr   = vm->call_stack.ptr;
+	minift_token_t *ip   = vm->ip;
+
+	if ( ptr > start ){
+		depth = ptr - start;
+		depth = (depth > PROF_DEPTH)? PROF_DEPTH : depth;
+	}
+
+	for ( unsigned i = 0; i < depth; i++ ){
+		frames[i] = ptr[(int)i - (int)depth];
+	}
+
+	frames[depth++] = (minift_cell_t)ip;
+
+	if ( ip ){
+		word = minift_code_word( vm, *ip );
+	}
+
+	unsigned long hash = hash_sample( frames, depth, word );
+
+	for ( unsigned i = 0; i < PROF_ENTRIES; i++ ){
+		prof_entry_t *ent = entries + (hash + i) % PROF_ENTRIES;
+
+		if ( ent->count == 0 ){
+			memcpy( ent->frames, frames, depth * sizeof(minift_cell_t));
+			ent->depth = depth;
+			ent->word  = word;
+			ent->count = 1;
+			return;
+		}
+
+		if ( ent->depth == depth && ent->word == word
+		  && memcmp( ent->frames, frames, depth * sizeof(minift_cell_t)) == 0 )
+		{
+			ent->count++;
+			return;
+		}
+	}
+
+	prof_dropped++;
+}
+
+void profile_start( minift_vm_t *vm, unsigned usecs ){
+	struct sigaction sa;
+	struct itimerval timer = {
+		.it_interval = { .tv_sec = 0, .tv_usec = usecs },
+		.it_value    = { .tv_sec = 0, .tv_usec = usecs },
+	};
+
+	memset( &sa, 0, sizeof(sa) );
+	sa.sa_handler = on_sigprof;
+	sa.sa_flags   = SA_RESTART;
+	sigemptyset( &sa.sa_mask );
+
+	prof_vm = vm;
+	sigaction( SIGPROF, &sa, NULL );
+	setitimer( ITIMER_PROF, &timer, NULL );
+}
+
+void profile_stop( void ){
+	struct itimerval timer;
+
+	memset( &timer, 0, sizeof(timer) );
+	setitimer( ITIMER_PROF, &timer, NULL );
+	prof_vm = NULL;
+}
+
+static void add_name( const char *name, unsigned len ){
+	char buf[MINIFT_MAX_WORDSIZE];
+	unsigned i = 0;
+
+	// same truncation and case folding as the reader
+	for ( ; i < len && i < MINIFT_MAX_WORDSIZE - 1; i++ ){
+		char c = name[i];
+		buf[i] = (c >= 'A' && c <= 'Z')? c - 'A' + 'a' : c;
+	}
+
+	buf[i] = '\0';
+
+	minift_cell_t hash = minift_hash( buf );
+
+	for ( unsigned k = 0; k < name_count; k++ ){
+		if ( names[k].hash == hash ){
+			return;
+		}
+	}
+
+	if ( name_count < PROF_NAMES ){
+		names[name_count].hash = hash;
+		memcpy( names[name_count].name, buf, i + 1 );
+		name_count++;
+	}
+}
+
+// looks for words that make definitions, and remembers the names
+void profile_note_line( const char *line ){
+	const char *delim = " \t\n\v";
+	bool defining = false;
+
+	while ( *line ){
+		line += strspn( line, delim );
+		unsigned len = strcspn( line, delim );
+
+		if ( !len ){
+			break;
+		}
+
+		if ( defining ){
+			add_name( line, len );
+		}
+
+		defining = (len == 1 && line[0] == ':')
+		        || (len == 5 && strncmp( line, "value", 5 ) == 0)
+		        || (len == 6 && strncmp( line, "create", 6 ) == 0);
+
+		line += len;
+	}
+}
+
+// the definition with the highest address at or below `addr`
+static minift_define_t *find_define( minift_vm_t *vm, minift_cell_t addr ){
+	minift_define_t *def = vm->definitions;
+	minift_define_t *ret = NULL;
+
+	for ( ; def; def = def->previous ){
+		if ( (minift_cell_t)def < addr && (!ret || def > ret) ){
+			ret = def;
+		}
+	}
+
+	// past the end of the dictionary
+	if ( ret && !minift_is_shared( vm, (void *)addr )
+	  && addr >= (minift_cell_t)vm->data_stack.ptr )
+	{
+		return NULL;
+	}
+
+	return ret;
+}
+
+enum {
+	PROF_LINE = PROF_DEPTH * 24 + 64,
+};
+
+typedef struct prof_line {
+	unsigned long count;
+	char          text[PROF_LINE];
+} prof_line_t;
+
+static void append( char *buf, const char *str ){
+	unsigned len = strlen( buf );
+
+	snprintf( buf + len, PROF_LINE - len, "%s", str );
+}
+
+// Returns the name noted for a definition's hash, or NULL.
+const char *profile_name( minift_cell_t hash ){
+	for ( unsigned i = 0; i < name_count; i++ ){
+		if ( names[i].hash == hash ){
+			return names[i].name;
+		}
+	}
+
+	return NULL;
+}
+
+static void append_name( char *buf, minift_cell_t hash ){
+	const char *name = profile_name( hash );
+	char temp[32];
+
+	if ( name ){
+		append( buf, name );
+		return;
+	}
+
+	snprintf( temp, sizeof(temp), "0x%llx", (unsigned long long)hash );
+	append( buf, temp );
+}
+
+static void fold_entry( minift_vm_t *vm, prof_entry_t *ent, char *buf ){
+	bool first = true;
+
+	buf[0] = '\0';
+
+	for ( unsigned k = 0; k < ent->depth; k++ ){
+		minift_define_t *def = find_define( vm, ent->frames[k] );
+
+		if ( !def ){
+			continue;
+		}
+
+		append( buf, first? "" : ";" );
+		append_name( buf, def->hash );
+		first = false;
+	}
+
+	minift_arc_ent_t *arc = ent->word? minift_archive_lookup( vm, ent->word )
+	                                 : NULL;
+
+	if ( arc ){
+		append( buf, first? "" : ";" );
+		append( buf, arc->name );
+
+	} else if ( first ){
+		// no ip, running the interpreter
+		append( buf, "[interpreter]" );
+	}
+}
+
+static int compare_lines( const void *a, const void *b ){
+	return strcmp( ((const prof_line_t *)a)->text,
+	               ((const prof_line_t *)b)->text );
+}
+
+// Writes the samples in the folded format used by flamegraph.pl, one
+// line per stack, outermost first, followed by the sample count. Samples
+// taken at different places in the same definitions are merged here.
+bool profile_write( minift_vm_t *vm, FILE *fp ){
+	prof_line_t *lines = calloc( PROF_ENTRIES, sizeof(prof_line_t));
+	unsigned count = 0;
+
+	if ( !lines ){
+		return false;
+	}
+
+	for ( unsigned i = 0; i < PROF_ENTRIES; i++ ){
+		if ( entries[i].count ){
+			fold_entry( vm, entries + i, lines[count].text );
+			lines[count++].count = entries[i].count;
+		}
+	}
+
+	qsort( lines, count, sizeof(prof_line_t), compare_lines );
+
+	for ( unsigned i = 0; i < count; ){
+		unsigned long total = 0;
+		unsigned k = i;
+
+		for ( ; k < count && strcmp( lines[k].text, lines[i].text ) == 0; k++ ){
+			total += lines[k].count;
+		}
+
+		fprintf( fp, "%s %lu\n", lines[i].text, total );
+		i = k;
+	}
+
+	if ( prof_dropped ){
+		fprintf( fp, "[dropped] %lu\n", prof_dropped );
+	}
+
+	free( lines );
+	return true;
+}
@@ -0,0 +1,12 @@
+#ifndef _MINIFORTH_POSIX_PROFILE_H
+#define _MINIFORTH_POSIX_PROFILE_H 1
+#include <miniforth/miniforth.h>
+#include <stdio.h>
+
+void profile_start( minift_vm_t *vm, unsigned usecs );
+void profile_stop( void );
+void profile_note_line( const char *line );
+const char *profile_name( minift_cell_t hash );
+bool profile_write( minift_vm_t *vm, FILE *fp );
+
+#endif
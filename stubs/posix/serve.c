@@ -0,0 +1,597 @@
+#define _POSIX_C_SOURCE 200809L
+#include <miniforth/miniforth.h>
+#include "serve.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Evaluation server
+//
+// Listens on a unix socket, and treats everything a client sends up to
+// shutting down it's side of the connection as one request. Each request
+// runs on a worker thread in a fresh clone of the template vm, with it's
+// own stacks, data space, string pool and line space, and anything it
+// prints is streamed back as it runs. The connection is closed once the
+// request finishes, or runs out of it's step budget.
+//
+// The main thread does all of the socket I/O with epoll. Workers only
+// append output to their connection's buffer and wake the main thread
+// through a pipe. All connection state is guarded by the one lock.
+
+enum {
+	SERVE_MAX_REQUEST = 64 * 1024,
+	SERVE_MAX_OUTPUT  = 1024 * 1024,
+	SERVE_DATA_CELLS  = 8192,
+	SERVE_STACK_CELLS = 256,
+	SERVE_POOL_BYTES  = 16384,
+	SERVE_LINE_CELLS  = 512,
+	SERVE_SLICE       = 4096,
+	SERVE_SINK_BYTES  = 4096,
+	SERVE_EVENTS      = 64,
+};
+
+typedef struct conn conn_t;
+
+typedef struct conn {
+	int            fd;
+
+	// request, only touched by the main thread until it's queued
+	char          *in;
+	size_t         in_len;
+	size_t         in_cap;
+
+	// output, appended to by the worker
+	char          *out;
+	size_t         out_len;
+	size_t         out_cap;
+	size_t         out_sent;
+
+	bool           queued;
+	bool           done;
+	bool           broken;
+	bool           ready;
+	bool           polling_out;
+
+	conn_t        *next_work;
+	conn_t        *next_ready;
+} conn_t;
+
+typedef struct worker {
+	pthread_t         thread;
+	minift_cell_t     data[SERVE_DATA_CELLS];
+	minift_cell_t     calls[SERVE_STACK_CELLS];
+	minift_cell_t     params[SERVE_STACK_CELLS];
+	char              strings[SERVE_POOL_BYTES];
+	minift_strpool_t  pool;
+	minift_cell_t     line_space[SERVE_LINE_CELLS];
+	minift_lines_t    lines;
+	minift_vm_t       vm;
+} worker_t;
+
+typedef struct sink {
+	conn_t   *conn;
+	char      buf[SERVE_SINK_BYTES];
+	unsigned  len;
+} sink_t;
+
+static struct {
+	int              listen_fd;
+	int              epoll_fd;
+	int              wake[2];
+
+	pthread_mutex_t  lock;
+	pthread_cond_t   work_cond;
+	conn_t          *work_head;
+	conn_t          *work_tail;
+	conn_t          *ready;
+
+	// closed this time round the event loop, freed at the end of it
+	// in case there are still events for them
+	conn_t          *closed;
+
+	minift_vm_t     *template;
+	unsigned long    budget;
+} server = {
+	.lock      = PTHREAD_MUTEX_INITIALIZER,
+	.work_cond = PTHREAD_COND_INITIALIZER,
+};
+
+// epoll data for things that aren't connections
+static char listen_tag, wake_tag;
+
+// output for the request running on this thread
+static _Thread_local sink_t *cur_sink;
+
+// queues a connection for the main thread to look at, lock held
+static void mark_ready( conn_t *conn ){
+	if ( !conn->ready ){
+		conn->ready      = true;
+		conn->next_ready = server.ready;
+		server.ready     = conn;
+
+		// a full pipe already has a wakeup pending
+		if ( write( server.wake[1], "", 1 ) < 0 && errno != EAGAIN ){
+			perror( "wake" );
+		}
+	}
+}
+
+static bool append( char **buf, size_t *len, size_t *cap,
+                    const char *data, size_t size )
+{
+	if ( *len + size > *cap ){
+		size_t new_cap = *cap? *cap * 2 : 1024;
+
+		while ( new_cap < *len + size ){
+			new_cap *= 2;
+		}
+
+		char *temp = realloc( *buf, new_cap );
+
+		if ( !temp ){
+			return false;
+		}
+
+		*buf = temp;
+		*cap = new_cap;
+	}
+
+	memcpy( *buf + *len, data, size );
+	*len += size;
+
+	return true;
+}
+
+// hands buffered output to the main thread, returns false if the request
+// should be stopped
+static bool flush_sink( sink_t *sink ){
+	conn_t *conn = sink->conn;
+	bool ret = true;
+
+	pthread_mutex_lock( &server.lock );
+
+	if ( conn->broken ){
+		ret = false;
+
+	} else if ( conn->out_len - conn->out_sent + sink->len > SERVE_MAX_OUTPUT
+	         || !append( &conn->out, &conn->out_len, &conn->out_cap,
+	                     sink->buf, sink->len ))
+	{
+		conn->broken = true;
+		ret = false;
+	}
+
+	if ( sink->len ){
+		mark_ready( conn );
+	}
+
+	pthread_mutex_unlock( &server.lock );
+	sink->len = 0;
+
+	return ret;
+}
+
+bool serve_put_char( char c ){
+	sink_t *sink = cur_sink;
+
+	if ( !sink ){
+		return false;
+	}
+
+	sink->buf[sink->len++] = c;
+
+	if ( sink->len == SERVE_SINK_BYTES ){
+		flush_sink( sink );
+	}
+
+	return true;
+}
+
+static bool clone_template( worker_t *w ){
+	minift_stack_t data = {
+		.start = w->data,
+		.end   = w->data + SERVE_DATA_CELLS,
+		.ptr   = w->data,
+	};
+
+	minift_stack_t calls = {
+		.start = w->calls,
+		.end   = w->calls + SERVE_STACK_CELLS,
+		.ptr   = w->calls,
+	};
+
+	minift_stack_t params = {
+		.start = w->params,
+		.end   = w->params + SERVE_STACK_CELLS,
+		.ptr   = w->params,
+	};
+
+	if ( !minift_vm_clone( &w->vm, server.template, &calls, &data, &params )){
+		return false;
+	}
+
+	// the block cache and persistent region can't be shared between
+	// threads, and neither can the trace hook's counters
+	w->vm.blocks  = NULL;
+	w->vm.persist = NULL;
+	w->vm.trace   = NULL;
+
+	// literals compiled into the template stay in it's pool, new ones go
+	// in the worker's own
+	return minift_strpool_init( &w->vm, &w->pool, w->strings, sizeof(w->strings))
+	    && minift_lines_init( &w->vm, &w->lines, w->line_space,
+	                          sizeof(w->line_space));
+}
+
+static void run_request( worker_t *w, conn_t *conn ){
+	minift_vm_t *vm = &w->vm;
+	sink_t sink = { .conn = conn, .len = 0 };
+	unsigned long steps = 0;
+
+	cur_sink = &sink;
+
+	// the template was checked to fit when the server started
+	clone_template( w );
+	minift_feed( vm, conn->in, conn->in_len );
+
+	for (;;){
+		int status = minift_run_for( vm, SERVE_SLICE, 0 );
+
+		// errors are reported in the output and the request carries on,
+		// same as at the prompt
+		if ( status == MINIFT_RUN_HALTED || status == MINIFT_RUN_WAITING ){
+			break;
+		}
+
+		steps += SERVE_SLICE;
+
+		if ( server.budget && steps >= server.budget ){
+			minift_puts( "error: step budget exceeded\n" );
+			break;
+		}
+
+		if ( sink.len && !flush_sink( &sink )){
+			break;
+		}
+	}
+
+	flush_sink( &sink );
+	cur_sink = NULL;
+
+	pthread_mutex_lock( &server.lock );
+	conn->done = true;
+	mark_ready( conn );
+	pthread_mutex_unlock( &server.lock );
+}
+
+static void *worker_main( void *arg ){
+	worker_t *w = arg;
+
+	for (;;){
+		pthread_mutex_lock( &server.lock );
+
+		while ( !server.work_head ){
+			pthread_cond_wait( &server.work_cond, &server.lock );
+		}
+
+		conn_t *conn = server.work_head;
+		server.work_head = conn->next_work;
+
+		if ( !server.work_head ){
+			server.work_tail = NULL;
+		}
+
+		pthread_mutex_unlock( &server.lock );
+
+		run_request( w, conn );
+	}
+
+	return NULL;
+}
+
+static void set_nonblocking( int fd ){
+	fcntl( fd, F_SETFL, fcntl( fd, F_GETFL ) | O_NONBLOCK );
+}
+
+static void poll_conn( conn_t *conn, int op, unsigned events ){
+	struct epoll_event ev = { .events = events, .data.ptr = conn };
+
+	epoll_ctl( server.epoll_fd, op, conn->fd, &ev );
+}
+
+static void close_conn( conn_t *conn ){
+	close( conn->fd );
+	conn->fd         = -1;
+	conn->next_ready = server.closed;
+	server.closed    = conn;
+}
+
+static void free_closed( void ){
+	while ( server.closed ){
+		conn_t *conn = server.closed;
+
+		server.closed = conn->next_ready;
+		free( conn->in );
+		free( conn->out );
+		free( conn );
+	}
+}
+
+// only watched for output once it's queued, stops watching when there's
+// nothing left to send
+static void poll_output( conn_t *conn, bool want ){
+	if ( want != conn->polling_out ){
+		poll_conn( conn, want? EPOLL_CTL_ADD : EPOLL_CTL_DEL, EPOLLOUT );
+		conn->polling_out = want;
+	}
+}
+
+// writes what it can, returns true once the connection is finished with,
+// lock held
+static bool send_output( conn_t *conn ){
+	while ( !conn->broken && conn->out_sent < conn->out_len ){
+		ssize_t n = write( conn->fd, conn->out + conn->out_sent,
+		                   conn->out_len - conn->out_sent );
+
+		if ( n < 0 && errno == EAGAIN ){
+			poll_output( conn, true );
+			return false;
+		}
+
+		if ( n <= 0 ){
+			conn->broken = true;
+			break;
+		}
+
+		conn->out_sent += n;
+	}
+
+	// drop what's been sent so the buffer doesn't keep growing
+	if ( conn->out_sent == conn->out_len ){
+		conn->out_sent = conn->out_len = 0;
+	}
+
+	if ( conn->broken || !conn->out_len ){
+		poll_output( conn, false );
+	}
+
+	return conn->done;
+}
+
+static void queue_request( conn_t *conn ){
+	// a final newline, so the last word is finished
+	if ( !append( &conn->in, &conn->in_len, &conn->in_cap, "\n", 1 )){
+		conn->broken = true;
+	}
+
+	// The worker owns `in` from here on. epoll still reports hangups with
+	// an empty event mask, so the fd is taken out altogether, and a client
+	// that goes away is only noticed when it's output fails to send.
+	poll_conn( conn, EPOLL_CTL_DEL, 0 );
+	conn->queued = true;
+
+	pthread_mutex_lock( &server.lock );
+
+	if ( conn->broken ){
+		conn->done = true;
+		mark_ready( conn );
+
+	} else {
+		conn->next_work = NULL;
+
+		if ( server.work_tail ){
+			server.work_tail->next_work = conn;
+		} else {
+			server.work_head = conn;
+		}
+
+		server.work_tail = conn;
+		pthread_cond_signal( &server.work_cond );
+	}
+
+	pthread_mutex_unlock( &server.lock );
+}
+
+static void read_request( conn_t *conn ){
+	char buf[4096];
+
+	for (;;){
+		ssize_t n = read( conn->fd, buf, sizeof(buf) );
+
+		if ( n < 0 && errno == EAGAIN ){
+			return;
+		}
+
+		if ( n <= 0 ){
+			break;
+		}
+
+		if ( conn->in_len + n > SERVE_MAX_REQUEST
+		  || !append( &conn->in, &conn->in_len, &conn->in_cap, buf, n ))
+		{
+			static const char msg[] = "error: request too large\n";
+
+			if ( write( conn->fd, msg, sizeof(msg) - 1 ) < 0 ){
+				// closing anyway
+			}
+
+			conn->broken = true;
+			break;
+		}
+	}
+
+	queue_request( conn );
+}
+
+static void accept_conns( void ){
+	for (;;){
+		int fd = accept( server.listen_fd, NULL, NULL );
+
+		if ( fd < 0 ){
+			if ( errno != EAGAIN && errno != EINTR ){
+				perror( "accept" );
+			}
+
+			return;
+		}
+
+		conn_t *conn = calloc( 1, sizeof(conn_t) );
+
+		if ( !conn ){
+			close( fd );
+			continue;
+		}
+
+		conn->fd = fd;
+		set_nonblocking( fd );
+		poll_conn( conn, EPOLL_CTL_ADD, EPOLLIN );
+	}
+}
+
+static void service_ready( void ){
+	char buf[64];
+
+	while ( read( server.wake[0], buf, sizeof(buf) ) > 0 );
+
+	pthread_mutex_lock( &server.lock );
+
+	while ( server.ready ){
+		conn_t *conn = server.ready;
+
+		server.ready = conn->next_ready;
+		conn->ready  = false;
+
+		if ( send_output( conn )){
+			close_conn( conn );
+		}
+	}
+
+	pthread_mutex_unlock( &server.lock );
+}
+
+static void service_output( conn_t *conn ){
+	pthread_mutex_lock( &server.lock );
+
+	// connections waiting in the ready list are closed from there
+	if ( send_output( conn ) && !conn->ready ){
+		close_conn( conn );
+	}
+
+	pthread_mutex_unlock( &server.lock );
+}
+
+static int open_socket( const char *path ){
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	int fd = socket( AF_UNIX, SOCK_STREAM, 0 );
+
+	if ( fd < 0 ){
+		perror( "socket" );
+		return -1;
+	}
+
+	if ( strlen( path ) >= sizeof(addr.sun_path) ){
+		fprintf( stderr, "socket path too long\n" );
+		close( fd );
+		return -1;
+	}
+
+	strcpy( addr.sun_path, path );
+	unlink( path );
+
+	if ( bind( fd, (struct sockaddr *)&addr, sizeof(addr) ) < 0
+	  || listen( fd, 128 ) < 0 )
+	{
+		perror( path );
+		close( fd );
+		return -1;
+	}
+
+	set_nonblocking( fd );
+
+	return fd;
+}
+
+int serve( minift_vm_t *template, serve_config_t *config ){
+	worker_t *workers = calloc( config->workers, sizeof(worker_t) );
+
+	if ( !workers ){
+		perror( "workers" );
+		return 1;
+	}
+
+	server.template = template;
+	server.budget   = config->budget;
+
+	// make sure the template fits before any requests come in, clone
+	// errors are reported against the template
+	if ( !clone_template( &workers[0] )){
+		fprintf( stderr, "template vm doesn't fit in a worker\n" );
+		return 1;
+	}
+
+	signal( SIGPIPE, SIG_IGN );
+
+	server.listen_fd = open_socket( config->path );
+	server.epoll_fd  = epoll_create1( 0 );
+
+	if ( server.listen_fd < 0 || server.epoll_fd < 0 || pipe( server.wake ) < 0 ){
+		perror( "serve" );
+		return 1;
+	}
+
+	set_nonblocking( server.wake[0] );
+	set_nonblocking( server.wake[1] );
+
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &listen_tag };
+	epoll_ctl( server.epoll_fd, EPOLL_CTL_ADD, server.listen_fd, &ev );
+
+	ev.data.ptr = &wake_tag;
+	epoll_ctl( server.epoll_fd, EPOLL_CTL_ADD, server.wake[0], &ev );
+
+	for ( unsigned i = 0; i < config->workers; i++ ){
+		pthread_create( &workers[i].thread, NULL, worker_main, workers + i );
+	}
+
+	for (;;){
+		struct epoll_event events[SERVE_EVENTS];
+		int n = epoll_wait( server.epoll_fd, events, SERVE_EVENTS, -1 );
+
+		if ( n < 0 && errno != EINTR ){
+			perror( "epoll_wait" );
+			return 1;
+		}
+
+		for ( int i = 0; i < n; i++ ){
+			void *tag = events[i].data.ptr;
+			conn_t *conn = tag;
+
+			if ( tag == &listen_tag ){
+				accept_conns( );
+
+			} else if ( tag == &wake_tag ){
+				service_ready( );
+
+			} else if ( conn->fd < 0 ){
+				// closed earlier in this batch
+
+			} else if ( conn->queued ){
+				service_output( conn );
+
+			} else {
+				read_request( conn );
+			}
+		}
+
+		free_closed( );
+	}
+
+	return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef _MINIFORTH_POSIX_SERVE_H
+#define _MINIFORTH_POSIX_SERVE_H 1
+#include <miniforth/miniforth.h>
+
+typedef struct serve_config {
+	const char    *path;
+	unsigned       workers;
+	unsigned long  budget;
+} serve_config_t;
+
+int  serve( minift_vm_t *template, serve_config_t *config );
+bool serve_put_char( char c );
+
+#endif
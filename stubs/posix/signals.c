@@ -0,0 +1,65 @@
+#define _POSIX_C_SOURCE 200809L
+#include <miniforth/miniforth.h>
+#include "signals.h"
+#include <signal.h>
+
+// Signal handlers
+//
+// `on-signal ( xt sig -- )` runs a word whenever the process gets signal
+// `sig`. The signal raises the interrupt with the same number, so the word
+// runs at the vm's next safe point, see src/interrupt.c. Signals aren't
+// set to restart system calls, so one arriving while the stub is waiting
+// for input is handled right away rather than after the next line.
+
+static minift_vm_t * volatile signal_vm;
+
+static void on_signal( int sig ){
+	minift_vm_t *vm = signal_vm;
+
+	if ( vm ){
+		minift_interrupt( vm, sig );
+	}
+}
+
+static bool set_handler( minift_vm_t *vm ){
+	minift_cell_t sig  = minift_pop( vm, &vm->param_stack );
+	minift_cell_t word = minift_pop( vm, &vm->param_stack );
+	struct sigaction sa;
+
+	// SIGPROF belongs to the profiler
+	if ( sig == 0 || sig >= MINIFT_INTERRUPTS || sig == SIGPROF ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "can't handle that signal" );
+		return false;
+	}
+
+	sa.sa_handler = word? on_signal : SIG_DFL;
+	sa.sa_flags   = 0;
+	sigemptyset( &sa.sa_mask );
+
+	if ( !minift_on_interrupt( vm, sig, word )){
+		return false;
+	}
+
+	if ( sigaction( sig, &sa, NULL ) < 0 ){
+		minift_error( vm, MINIFT_ERR_RECOVERABLE, "couldn't set signal handler" );
+		return false;
+	}
+
+	return true;
+}
+
+static minift_arc_ent_t signal_entries[] = {
+	{ "on-signal", set_handler, 0 },
+};
+
+static minift_archive_t signal_archive = {
+	.name    = "signals",
+	.entries = signal_entries,
+	.size    = sizeof(signal_entries) / sizeof(minift_arc_ent_t),
+};
+
+// Adds `on-signal` to the vm, which signals are then delivered to.
+void signals_start( minift_vm_t *vm ){
+	signal_vm = vm;
+	minift_archive_add( vm, &signal_archive );
+}
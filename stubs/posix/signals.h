@@ -0,0 +1,7 @@
+#ifndef _MINIFORTH_POSIX_SIGNALS_H
+#define _MINIFORTH_POSIX_SIGNALS_H 1
+#include <miniforth/miniforth.h>
+
+void signals_start( minift_vm_t *vm );
+
+#endif
@@ -1,31 +1,429 @@
+#define _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
 #include <miniforth/stubs.h>
 #include <miniforth/miniforth.h>
+#include "profile.h"
+#include "perf.h"
+#include "serve.h"
+#include "par.h"
+#include "signals.h"
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
+#include <time.h>
+
+enum {
+	// how long tasks run between checks for input, in microseconds
+	INPUT_SLICE = 10000,
+};
 
 static char input_buffer[256];
+static int block_fd = -1;
+static const char *cache_dir = NULL;
 static char *cur_input = NULL;
 
-char minift_get_char( void ){
-	while ( !cur_input || !*cur_input ){
-		if ( isatty( 0 )){
-			printf( "miniforth > " );
+// Input is read a block at a time into `input_raw` and handed out a line
+// at a time, rather than through stdio, so it's known whether there's a
+// whole line to feed without blocking for one.
+static char input_raw[4096];
+static size_t raw_start, raw_end;
+static bool input_done;
+static bool prompted;
+
+static void prompt( void ){
+	if ( !prompted && isatty( 0 )){
+		printf( "miniforth > " );
+		fflush( stdout );
+		prompted = true;
+	}
+}
+
+static const char *line_end( void ){
+	return memchr( input_raw + raw_start, '\n', raw_end - raw_start );
+}
+
+// whether read_line() has something to return straight away
+static bool input_ready( void ){
+	struct pollfd pfd = { .fd = 0, .events = POLLIN };
+
+	return line_end( ) || input_done || poll( &pfd, 1, 0 ) > 0;
+}
+
+// Returns false at the end of input, or if a signal came in first, which
+// leaves `input_done` unset.
+static bool fill_input( void ){
+	memmove( input_raw, input_raw + raw_start, raw_end - raw_start );
+	raw_end  -= raw_start;
+	raw_start = 0;
+
+	ssize_t n = read( 0, input_raw + raw_end, sizeof(input_raw) - raw_end );
+
+	if ( n <= 0 ){
+		input_done = !(n < 0 && errno == EINTR);
+		return false;
+	}
+
+	raw_end += n;
+
+	return true;
+}
+
+// Returns the next line, or as much of it as fits in `input_buffer`.
+static char *read_line( void ){
+	size_t len;
+
+	prompt( );
+
+	while ( !line_end( ) && raw_end - raw_start < sizeof(input_buffer) - 1 ){
+		if ( !fill_input( )){
+			if ( !input_done ){
+				return NULL;
+			}
+
+			break;
 		}
+	}
+
+	const char *end = line_end( );
 
-		cur_input = fgets( input_buffer, sizeof(input_buffer), stdin );
+	len = end? (size_t)(end + 1 - (input_raw + raw_start)) : raw_end - raw_start;
+	len = (len < sizeof(input_buffer) - 1)? len : sizeof(input_buffer) - 1;
+
+	if ( !len ){
+		return NULL;
+	}
+
+	memcpy( input_buffer, input_raw + raw_start, len );
+	input_buffer[len] = '\0';
+	raw_start += len;
+	prompted   = false;
+
+	return input_buffer;
+}
+
+char minift_get_char( void ){
+	while ( !cur_input || !*cur_input ){
+		cur_input = read_line( );
 	}
 
 	return *cur_input++;
 }
 
 void minift_put_char( char c ){
-	putchar( c );
+	// output from server requests goes back to the client
+	if ( !serve_put_char( c )){
+		putchar( c );
+	}
+}
+
+// blocks are stored one after another in the file given with --blocks,
+// anything past the end of the file reads as zeros
+bool minift_block_read( unsigned long block, void *buf ){
+	off_t offset = (off_t)block * MINIFT_BLOCK_SIZE;
+	size_t done = 0;
+
+	if ( block_fd < 0 ){
+		return false;
+	}
+
+	while ( done < MINIFT_BLOCK_SIZE ){
+		ssize_t n = pread( block_fd, (char *)buf + done,
+		                   MINIFT_BLOCK_SIZE - done, offset + done );
+
+		if ( n < 0 ){
+			return false;
+		}
+
+		if ( n == 0 ){
+			memset( (char *)buf + done, 0, MINIFT_BLOCK_SIZE - done );
+			break;
+		}
+
+		done += n;
+	}
+
+	return true;
+}
+
+bool minift_block_write( unsigned long block, void *const *bufs, unsigned count ){
+	struct iovec iov[count];
+	off_t offset = (off_t)block * MINIFT_BLOCK_SIZE;
+	size_t total = (size_t)count * MINIFT_BLOCK_SIZE;
+
+	if ( block_fd < 0 ){
+		return false;
+	}
+
+	for ( unsigned i = 0; i < count; i++ ){
+		iov[i].iov_base = bufs[i];
+		iov[i].iov_len  = MINIFT_BLOCK_SIZE;
+	}
+
+	// regular files don't do short writes short of running out of space
+	return pwritev( block_fd, iov, count, offset ) == (ssize_t)total;
+}
+
+// source files are mapped rather than read, and an empty file gets a
+// static empty string since there's nothing to map
+const char *minift_source_read( const char *name, unsigned long *len ){
+	int fd = open( name, O_RDONLY );
+	struct stat st;
+
+	if ( fd < 0 || fstat( fd, &st ) < 0 ){
+		if ( fd >= 0 ){
+			close( fd );
+		}
+
+		return NULL;
+	}
+
+	*len = st.st_size;
+
+	if ( *len == 0 ){
+		close( fd );
+		return "";
+	}
+
+	void *text = mmap( NULL, *len, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close( fd );
+
+	return (text == MAP_FAILED)? NULL : text;
+}
+
+void minift_source_done( const char *text, unsigned long len ){
+	if ( len ){
+		munmap( (void *)text, len );
+	}
+}
+
+// compiled modules are kept in the directory given with --cache, a file
+// per key
+static void cache_path( char *buf, size_t size, unsigned long key ){
+	snprintf( buf, size, "%s/%016lx.mfm", cache_dir, key );
+}
+
+unsigned long minift_cache_read( unsigned long key, void *buf, unsigned long size ){
+	char path[PATH_MAX];
+	struct stat st;
+	unsigned long done = 0;
+
+	if ( !cache_dir ){
+		return 0;
+	}
+
+	cache_path( path, sizeof(path), key );
+	int fd = open( path, O_RDONLY );
+
+	if ( fd < 0 ){
+		return 0;
+	}
+
+	if ( fstat( fd, &st ) < 0 || (unsigned long)st.st_size > size ){
+		close( fd );
+		return 0;
+	}
+
+	while ( done < (unsigned long)st.st_size ){
+		ssize_t n = read( fd, (char *)buf + done, st.st_size - done );
+
+		if ( n <= 0 ){
+			break;
+		}
+
+		done += n;
+	}
+
+	close( fd );
+
+	return (done == (unsigned long)st.st_size)? done : 0;
+}
+
+// written to a temporary file and renamed into place, so a reader never
+// sees half of one
+bool minift_cache_write( unsigned long key, const void *data, unsigned long size ){
+	char path[PATH_MAX];
+	char temp[PATH_MAX + 16];
+
+	if ( !cache_dir ){
+		return false;
+	}
+
+	cache_path( path, sizeof(path), key );
+	snprintf( temp, sizeof(temp), "%s.%d", path, (int)getpid( ));
+
+	FILE *fp = fopen( temp, "wb" );
+
+	if ( !fp ){
+		return false;
+	}
+
+	bool ok = fwrite( data, 1, size, fp ) == size;
+	ok = (fclose( fp ) == 0) && ok;
+
+	if ( !ok || rename( temp, path ) < 0 ){
+		unlink( temp );
+		return false;
+	}
+
+	return true;
+}
+
+// microseconds
+unsigned long minift_clock( void ){
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return ts.tv_sec * 1000000ul + ts.tv_nsec / 1000;
+}
+
+// runs a file of setup code to completion, before serving or reading input
+static bool load_file( minift_vm_t *vm, const char *path ){
+	FILE *fp = fopen( path, "r" );
+	char line[256];
+
+	if ( !fp ){
+		perror( path );
+		return false;
+	}
+
+	while ( fgets( line, sizeof(line), fp )){
+		minift_feed( vm, line, strlen( line ));
+
+		// in slices, in case it starts tasks that don't finish
+		int status;
+		while (( status = minift_run_for( vm, 0, minift_clock( ) + INPUT_SLICE ))
+		       == MINIFT_RUN_ERROR || status == MINIFT_RUN_YIELDED );
+
+		if ( status == MINIFT_RUN_HALTED ){
+			break;
+		}
+	}
+
+	fclose( fp );
+
+	return true;
+}
+
+// Maps `path` for the vm's persistent region, creating it if needed. The
+// mapping is shared so stores go straight back to the file, and is left
+// for the kernel to write back when the process exits.
+static bool map_persistent( minift_vm_t *vm, minift_persist_t *persist,
+                            const char *path, unsigned long size )
+{
+	int fd = open( path, O_RDWR | O_CREAT, 0644 );
+	struct stat st;
+
+	if ( fd < 0 || fstat( fd, &st ) < 0 ){
+		perror( path );
+		return false;
+	}
+
+	// an existing file keeps it's size unless more is asked for
+	if ( (unsigned long)st.st_size < size && ftruncate( fd, size ) < 0 ){
+		perror( path );
+		close( fd );
+		return false;
+	}
+
+	if ( (unsigned long)st.st_size > size ){
+		size = st.st_size;
+	}
+
+	void *mem = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	close( fd );
+
+	if ( mem == MAP_FAILED ){
+		perror( path );
+		return false;
+	}
+
+	return minift_persist_init( vm, persist, mem, size );
+}
+
+static void usage( const char *name ){
+	fprintf( stderr, "usage: %s [--profile output.folded] [--perf] [--load file.fs]\n"
+	                 "       [--persist file [--persist-size bytes]]\n"
+	                 "       [--blocks file [--block-buffers n]]\n"
+	                 "       [--serve socket [--workers n] [--budget steps]]\n"
+	                 "       [--par threads] [--cache dir]\n",
+	         name );
 }
 
 int main( int argc, char *argv[] ){
-	unsigned long data[1024];
-	unsigned long calls[1024];
-	unsigned long params[1024];
+	minift_cell_t data[1024];
+	minift_cell_t calls[1024];
+	minift_cell_t params[1024];
+	static char strings[16384];
+	minift_strpool_t pool;
+	static minift_cell_t line_space[1024];
+	minift_lines_t lines;
+	const char *profile = NULL;
+	bool perf = false;
+	const char *load = NULL;
+	const char *persist_path = NULL;
+	unsigned long persist_size = 1024 * 1024;
+	minift_persist_t persist;
+	const char *block_path = NULL;
+	unsigned block_buffers = 8;
+	minift_blocks_t blocks;
+	unsigned par_threads = 0;
+	serve_config_t serve_conf = {
+		.path    = NULL,
+		.workers = 4,
+		.budget  = 10000000,
+	};
+
+	for ( int i = 1; i < argc; i++ ){
+		if ( strcmp( argv[i], "--profile" ) == 0 && i + 1 < argc ){
+			profile = argv[++i];
+
+		} else if ( strcmp( argv[i], "--perf" ) == 0 ){
+			perf = true;
+
+		} else if ( strcmp( argv[i], "--persist" ) == 0 && i + 1 < argc ){
+			persist_path = argv[++i];
+
+		} else if ( strcmp( argv[i], "--persist-size" ) == 0 && i + 1 < argc ){
+			persist_size = strtoul( argv[++i], NULL, 0 );
+
+		} else if ( strcmp( argv[i], "--blocks" ) == 0 && i + 1 < argc ){
+			block_path = argv[++i];
+
+		} else if ( strcmp( argv[i], "--block-buffers" ) == 0 && i + 1 < argc ){
+			block_buffers = strtoul( argv[++i], NULL, 0 );
+
+		} else if ( strcmp( argv[i], "--par" ) == 0 && i + 1 < argc ){
+			par_threads = strtoul( argv[++i], NULL, 0 );
+
+		} else if ( strcmp( argv[i], "--cache" ) == 0 && i + 1 < argc ){
+			cache_dir = argv[++i];
+
+		} else if ( strcmp( argv[i], "--load" ) == 0 && i + 1 < argc ){
+			load = argv[++i];
+
+		} else if ( strcmp( argv[i], "--serve" ) == 0 && i + 1 < argc ){
+			serve_conf.path = argv[++i];
+
+		} else if ( strcmp( argv[i], "--workers" ) == 0 && i + 1 < argc ){
+			serve_conf.workers = strtoul( argv[++i], NULL, 0 );
+
+		} else if ( strcmp( argv[i], "--budget" ) == 0 && i + 1 < argc ){
+			serve_conf.budget = strtoul( argv[++i], NULL, 0 );
+
+		} else {
+			usage( argv[0] );
+			return 1;
+		}
+	}
 
 	minift_vm_t foo;
 	minift_stack_t data_stack = {
@@ -47,7 +445,120 @@ int main( int argc, char *argv[] ){
 	};
 
 	minift_init_vm( &foo, &call_stack, &data_stack, &param_stack, NULL );
-	minift_run( &foo );
+	minift_strpool_init( &foo, &pool, strings, sizeof(strings) );
+	minift_lines_init( &foo, &lines, line_space, sizeof(line_space) );
+	signals_start( &foo );
+
+	if ( persist_path && !map_persistent( &foo, &persist, persist_path, persist_size )){
+		return 1;
+	}
+
+	if ( block_path ){
+		unsigned long size = block_buffers
+		                   * (MINIFT_BLOCK_SIZE + sizeof(minift_block_buf_t));
+		void *mem = malloc( size );
+
+		block_fd = open( block_path, O_RDWR | O_CREAT, 0644 );
+
+		if ( block_fd < 0 ){
+			perror( block_path );
+			return 1;
+		}
+
+		if ( !mem || !minift_blocks_init( &foo, &blocks, mem, size )){
+			return 1;
+		}
+	}
+
+	// before loading anything, so the archive is there for it
+	if ( par_threads && !par_start( &foo, par_threads )){
+		return 1;
+	}
+
+	if ( load && !load_file( &foo, load )){
+		return 1;
+	}
+
+	if ( serve_conf.path ){
+		if ( serve_conf.workers == 0 ){
+			usage( argv[0] );
+			return 1;
+		}
+
+		return serve( &foo, &serve_conf );
+	}
+
+	if ( profile ){
+		profile_start( &foo, 1000 );
+	}
+
+	// with a profile as well, the counters are read for every word
+	if ( perf ){
+		perf = perf_start( &foo, profile != NULL );
+	}
+
+	// feed input a line at a time, only blocking here when the vm has
+	// nothing left to do. Tasks can be spawned by any line, so the vm is
+	// always run in slices, and while there are tasks running alongside
+	// the prompt, input is only read once there's some there.
+	for (;;){
+		perf_resume( );
+		int status = minift_run_for( &foo, 0, minift_clock( ) + INPUT_SLICE );
+		perf_pause( );
+
+		if ( status == MINIFT_RUN_HALTED ){
+			break;
+		}
+
+		if ( status == MINIFT_RUN_WAITING ){
+			prompt( );
+
+			if ( foo.task->next != foo.task && !input_ready( )){
+				continue;
+			}
+
+			if ( !read_line( )){
+				// a signal came in, so go back and run it's handler
+				if ( !input_done ){
+					continue;
+				}
+
+				break;
+			}
+
+			if ( profile ){
+				profile_note_line( input_buffer );
+			}
+
+			minift_feed( &foo, input_buffer, strlen( input_buffer ));
+		}
+	}
+
+	// changed blocks are only written back when asked, or here
+	if ( block_path ){
+		minift_blocks_save( &foo );
+	}
+
+	if ( perf ){
+		perf_report( &foo, stderr );
+	}
+
+	if ( profile ){
+		FILE *fp = fopen( profile, "w" );
+
+		profile_stop( );
+
+		if ( !fp ){
+			perror( profile );
+			return 1;
+		}
+
+		if ( !profile_write( &foo, fp )){
+			fprintf( stderr, "couldn't write profile\n" );
+		}
+
+		fclose( fp );
+	}
 
 	return 0;
 }
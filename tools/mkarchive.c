@@ -0,0 +1,269 @@
+// mkarchive: generates a static archive header with precomputed word
+//            hashes and a collision-free perfect hash table.
+//
+// usage: mkarchive <name> < spec > header
+//
+// The spec has one entry per line, "<word> <c function>", in the order
+// they should appear in the archive. Blank lines and lines starting
+// with '#' are ignored. Typed native entries (see src/native.c) add
+// "native <args> <results>", and "pure" if they have no side effects.
+// Other entries can add "parses" if they read from the input, or run
+// input of their own:
+//
+//   +    minift_native_add    native 2 1 pure
+//   :    minift_builtin_compile parses
+//
+// The output defines `<name>[]`, an array of minift_arc_ent_t, and
+// `<name>_phash`, a minift_phash_t to be set as the archive's `phash`.
+//
+// Fails if two words hash to the same value, since one of them would
+// silently shadow the other at runtime.
+//
+// usage: mkarchive -d <prefix> < words > header
+//
+// Defines the hashes of words the library refers to by name, so they're
+// constants rather than hashed when they're needed. Each line is
+// "<word> <name>", and defines `<prefix><name>`:
+//
+//   ;    RETURN      ->   #define HASH_RETURN ((minift_cell_t)0x...ull)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <miniforth/phash.h>
+
+enum {
+	MAX_ENTRIES = 1024,
+	MAX_LINE    = 256,
+	MAX_BITS    = 16,
+	MAX_TRIES   = 1 << 20,
+};
+
+typedef struct entry {
+	char     name[MAX_LINE];
+	char     func[MAX_LINE];
+	uint64_t hash;
+
+	int      native;
+	unsigned args;
+	unsigned results;
+	int      pure;
+	int      parses;
+} entry_t;
+
+static entry_t  entries[MAX_ENTRIES];
+static unsigned n_entries = 0;
+static uint16_t slots[1 << MAX_BITS];
+
+// must match minift_hash(), done in 64 bits so that the result is right
+// for any target; narrower targets just use the low bits
+static uint64_t hash_word( const char *str ){
+	uint64_t hash = 757;
+	int c;
+
+	while (( c = (unsigned char)*str++ )){
+		hash = (hash << 7) + hash + c;
+	}
+
+	return hash;
+}
+
+static int read_spec( FILE *fp ){
+	char line[MAX_LINE];
+	unsigned lineno = 0;
+
+	while ( fgets( line, sizeof(line), fp )){
+		char name[MAX_LINE], func[MAX_LINE], kind[MAX_LINE], flag[MAX_LINE];
+		unsigned args = 0, results = 0;
+		int fields = sscanf( line, "%255s %255s %255s %u %u %255s",
+		                     name, func, kind, &args, &results, flag );
+		lineno++;
+
+		if ( line[0] == '#' || fields < 1 ){
+			continue;
+		}
+
+		int parses = fields == 3 && strcmp( kind, "parses" ) == 0;
+
+		if ( fields != 2 && !parses
+		  && (fields < 5 || strcmp( kind, "native" ) != 0
+		      || (fields == 6 && strcmp( flag, "pure" ) != 0 )))
+		{
+			fprintf( stderr, "mkarchive: %u: expected '<word> <function>"
+			                 " [parses | native <args> <results> [pure]]'\n",
+			                 lineno );
+			return -1;
+		}
+
+		if ( args > 6 || results > 1 ){
+			fprintf( stderr, "mkarchive: %u: natives take at most 6 arguments"
+			                 " and return at most 1 result\n", lineno );
+			return -1;
+		}
+
+		if ( n_entries == MAX_ENTRIES ){
+			fprintf( stderr, "mkarchive: too many entries\n" );
+			return -1;
+		}
+
+		entry_t *ent = entries + n_entries++;
+		strcpy( ent->name, name );
+		strcpy( ent->func, func );
+		ent->hash    = hash_word( name );
+		ent->native  = fields >= 5;
+		ent->args    = args;
+		ent->results = results;
+		ent->pure    = fields == 6;
+		ent->parses  = parses;
+	}
+
+	return 0;
+}
+
+static int check_collisions( void ){
+	int ret = 0;
+
+	for ( unsigned i = 0; i < n_entries; i++ ){
+		for ( unsigned k = i + 1; k < n_entries; k++ ){
+			if ( entries[i].hash == entries[k].hash
+			  || (uint32_t)entries[i].hash == (uint32_t)entries[k].hash )
+			{
+				fprintf( stderr, "mkarchive: hash collision: '%s' and '%s'\n",
+				         entries[i].name, entries[k].name );
+				ret = -1;
+			}
+		}
+	}
+
+	return ret;
+}
+
+static int try_table( uint32_t mult, unsigned bits ){
+	memset( slots, 0, sizeof(uint16_t) << bits );
+
+	for ( unsigned i = 0; i < n_entries; i++ ){
+		uint32_t slot = minift_phash_slot( entries[i].hash, mult, bits );
+
+		if ( slots[slot] ){
+			return 0;
+		}
+
+		slots[slot] = i + 1;
+	}
+
+	return 1;
+}
+
+static int find_table( uint32_t *mult, unsigned *bits ){
+	unsigned min_bits = 1;
+
+	while (( 1u << min_bits ) < n_entries ){
+		min_bits++;
+	}
+
+	for ( unsigned b = min_bits; b <= MAX_BITS; b++ ){
+		uint32_t m = 0x9e3779b9;
+
+		for ( unsigned tries = 0; tries < MAX_TRIES; tries++ ){
+			if ( try_table( m | 1, b )){
+				*mult = m | 1;
+				*bits = b;
+				return 0;
+			}
+
+			m = m * 1664525 + 1013904223;
+		}
+	}
+
+	fprintf( stderr, "mkarchive: couldn't find a perfect hash\n" );
+	return -1;
+}
+
+static int print_defines( FILE *fp, const char *prefix ){
+	char line[MAX_LINE];
+	unsigned lineno = 0;
+
+	printf( "// generated by tools/mkarchive, do not edit\n\n" );
+
+	while ( fgets( line, sizeof(line), fp )){
+		char word[MAX_LINE], name[MAX_LINE];
+		int fields = sscanf( line, "%255s %255s", word, name );
+		lineno++;
+
+		if ( line[0] == '#' || fields < 1 ){
+			continue;
+		}
+
+		if ( fields != 2 ){
+			fprintf( stderr, "mkarchive: %u: expected '<word> <name>'\n", lineno );
+			return -1;
+		}
+
+		printf( "#define %s%s ((minift_cell_t)0x%016llxull)\n",
+		        prefix, name, (unsigned long long)hash_word( word ));
+	}
+
+	return 0;
+}
+
+int main( int argc, char *argv[] ){
+	uint32_t mult;
+	unsigned bits;
+
+	if ( argc == 3 && strcmp( argv[1], "-d" ) == 0 ){
+		return print_defines( stdin, argv[2] )? 1 : 0;
+	}
+
+	if ( argc < 2 ){
+		fprintf( stderr, "usage: %s <name> < spec > header\n"
+		                 "       %s -d <prefix> < words > header\n",
+		         argv[0], argv[0] );
+		return 1;
+	}
+
+	const char *name = argv[1];
+
+	if ( read_spec( stdin ) || check_collisions( ) || find_table( &mult, &bits )){
+		return 1;
+	}
+
+	printf( "// generated by tools/mkarchive, do not edit\n\n" );
+	printf( "static minift_arc_ent_t %s[] = {\n", name );
+
+	for ( unsigned i = 0; i < n_entries; i++ ){
+		entry_t *ent = entries + i;
+
+		if ( ent->native ){
+			printf( "\t{ \"%s\", NULL, (minift_cell_t)0x%016llxull,"
+			        " (minift_native_t)%s, %u, %u, %s },\n",
+			        ent->name, (unsigned long long)ent->hash, ent->func,
+			        ent->args, ent->results,
+			        ent->pure? "MINIFT_NATIVE_PURE" : "0" );
+
+		} else if ( ent->parses ){
+			printf( "\t{ \"%s\", %s, (minift_cell_t)0x%016llxull,"
+			        " NULL, 0, 0, MINIFT_ENTRY_PARSES },\n",
+			        ent->name, ent->func, (unsigned long long)ent->hash );
+
+		} else {
+			printf( "\t{ \"%s\", %s, (minift_cell_t)0x%016llxull },\n",
+			        ent->name, ent->func, (unsigned long long)ent->hash );
+		}
+	}
+
+	printf( "};\n\n" );
+	printf( "static const uint16_t %s_slots[%u] = {", name, 1u << bits );
+
+	for ( unsigned i = 0; i < (1u << bits); i++ ){
+		printf( "%s%u,", (i % 16)? " " : "\n\t", slots[i] );
+	}
+
+	printf( "\n};\n\n" );
+	printf( "static const minift_phash_t %s_phash = {\n", name );
+	printf( "\t.slots = %s_slots,\n", name );
+	printf( "\t.mult  = 0x%08xu,\n", mult );
+	printf( "\t.bits  = %u,\n", bits );
+	printf( "};\n" );
+
+	return 0;
+}